@@ -0,0 +1,494 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           alloc_check.c
+ * Date:                30th November 2023
+ *
+ * Description: Allocation-free check of the library "dknn.h" on glibc hosts. Interposes malloc, calloc,
+                realloc, free and the aligned allocators in the executable, so every heap call of the
+                process is counted, the ones made inside the C library included. Every stage runs the
+                classification or training loop of one mode: warm-up iterations first, so one-time
+                allocations such as stdio buffers are left out, then the measured iterations. The
+                measured iterations must not allocate; the allocations, bytes and frees of every stage
+                and the peak RSS after it are reported, and the exit status is 1 when a stage
+                allocated.
+ *
+ *              Build: cc -std=c99 -O2 -I. bench/alloc_check.c dknn.c -lm -o dknn_alloc_check
+ *              Usage: dknn_alloc_check [--iterations 1000] [--warmup 10]
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "dknn.h"
+
+#define CHECK_ROWS              (4096)
+#define CHECK_DIM               (16)
+#define CHECK_CLASSES           (3)
+#define CHECK_WIDE              (256)       //input features of the random projection
+#define CHECK_WIDE_ROWS         (256)
+#define CHECK_NONZEROS          (4)         //nonzeros per sparse row
+#define CHECK_POOL              (4)
+
+// Interposition -----------------------------------------------------------------
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *pointer);
+
+static volatile int tracking;
+static unsigned long allocations;
+static unsigned long allocatedBytes;
+static unsigned long frees;
+
+static void countAllocation(size_t size)
+{
+    if(tracking)
+    {
+        (void)__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+        (void)__atomic_fetch_add(&allocatedBytes, (unsigned long)size, __ATOMIC_RELAXED);
+    }
+}
+
+void *malloc(size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    countAllocation(size);
+    *pointer = __libc_memalign(alignment, size);
+
+    return (*pointer != NULL) ? 0 : ENOMEM;
+}
+
+void free(void *pointer)
+{
+    if(tracking && (pointer != NULL))
+    {
+        (void)__atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED);
+    }
+    __libc_free(pointer);
+}
+
+
+// Stages ------------------------------------------------------------------------
+typedef struct checkStateType
+{
+    dataPoint_t points[CHECK_ROWS];
+    classCenter_t centers[CHECK_CLASSES];
+    dilPar_t DPs[CHECK_CLASSES];
+    int pointCounts[CHECK_CLASSES];
+    bitPoint_t bitPoints[CHECK_ROWS];
+    bitCenter_t bitCenters[CHECK_CLASSES];
+    bitVote_t votes[CHECK_CLASSES];
+    float rows[CHECK_ROWS * CHECK_DIM];
+    float columns[CHECK_DIM * CHECK_ROWS];
+    int class[CHECK_ROWS];
+    int predicted[CHECK_ROWS];
+    colData_t data;
+    vecModel_t model;
+    float modelCenters[CHECK_CLASSES * CHECK_DIM];
+    float sqNorms[CHECK_CLASSES];
+    dilPar_t modelDPs[CHECK_CLASSES];
+    float sums[CHECK_CLASSES * CHECK_DIM];
+    float counts[CHECK_CLASSES];
+    int rowPtr[CHECK_ROWS + 1];
+    int colIdx[CHECK_ROWS * CHECK_NONZEROS];
+    float values[CHECK_ROWS * CHECK_NONZEROS];
+    csrMatrix_t sparse;
+    float wide[CHECK_WIDE_ROWS * CHECK_WIDE];
+    projection_t proj;
+    int colPtr[CHECK_WIDE + 1];
+    int16_t *entries;
+    streamTrainer_t trainer;
+    double trainerSpace[STREAM_TRAINER_DOUBLES(CHECK_CLASSES, CHECK_DIM)];
+    coreset_t coreset;
+    float coresetPoints[CORESET_FLOATS(CHECK_CLASSES, CHECK_DIM, CORESET_SIZE)];
+    double coresetStats[CORESET_DOUBLES(CHECK_CLASSES, CHECK_DIM)];
+    sampler_t sampler;
+    int samplerSpace[SAMPLER_INTS(CHECK_CLASSES, CHECK_ROWS)];
+    int indices[BATCH_SIZE];
+    float batchColumns[CHECK_DIM * BATCH_SIZE];
+    int batchClass[BATCH_SIZE];
+    colData_t batch;
+    assembler_t assembler;
+    arena_t arena;
+    uint8_t *memory;
+    batchPool_t pool;
+    int iteration;
+} checkState_t;
+
+typedef struct checkStageType
+{
+    const char *name;
+    void (*run)(checkState_t *state);
+} checkStage_t;
+
+volatile int checkSink;
+
+static void runClassifyDataPoint(checkState_t *state)
+{
+    for(int point=0; point<BATCH_SIZE; point++)
+    {
+        checkSink += classifyDataPoint(&state->points[(state->iteration * BATCH_SIZE + point) % CHECK_ROWS], state->DPs, state->centers, CHECK_CLASSES);
+    }
+}
+
+static void runTrainDataPoints(checkState_t *state)
+{
+    dataPoint_t *batch = &state->points[(state->iteration * BATCH_SIZE) % (CHECK_ROWS - BATCH_SIZE)];
+    int *points[CHECK_CLASSES] = {&state->pointCounts[0], &state->pointCounts[1], &state->pointCounts[2]};
+
+    setCircleCenters(batch, state->centers, points);
+    for(int point=0; point<BATCH_SIZE; point++)
+    {
+        modifyDilutionPars(state->DPs, batch[point].class, calcDistance(batch[point], state->centers[batch[point].class]));
+    }
+}
+
+static void runClassifyBitPoint(checkState_t *state)
+{
+    for(int point=0; point<BATCH_SIZE; point++)
+    {
+        checkSink += classifyBitPoint(&state->bitPoints[(state->iteration * BATCH_SIZE + point) % CHECK_ROWS], state->DPs, state->bitCenters, CHECK_CLASSES);
+    }
+}
+
+static void runTrainBitPoints(checkState_t *state)
+{
+    setBitCircleCenters(&state->bitPoints[(state->iteration * BATCH_SIZE) % (CHECK_ROWS - BATCH_SIZE)], state->bitCenters, state->votes, CHECK_CLASSES);
+}
+
+static void runClassifyVectorPoint(checkState_t *state)
+{
+    for(int point=0; point<BATCH_SIZE; point++)
+    {
+        checkSink += classifyVectorPoint(&state->rows[((state->iteration * BATCH_SIZE + point) % CHECK_ROWS) * CHECK_DIM], &state->model);
+    }
+}
+
+static void runClassifySparsePoint(checkState_t *state)
+{
+    for(int point=0; point<BATCH_SIZE; point++)
+    {
+        checkSink += classifySparsePoint(&state->sparse, (state->iteration * BATCH_SIZE + point) % CHECK_ROWS, &state->model);
+    }
+}
+
+static void runClassifyColumnBatch(checkState_t *state)
+{
+    classifyColumnBatch(&state->data, (state->iteration * BATCH_SIZE) % (CHECK_ROWS - BATCH_SIZE), BATCH_SIZE, &state->model, state->predicted);
+}
+
+static void runClassifyProjectedBatch(checkState_t *state)
+{
+    classifyProjectedBatch(state->wide, CHECK_WIDE_ROWS, &state->proj, &state->model, state->predicted);
+}
+
+static void runTrainColumns(checkState_t *state)
+{
+    int first = (state->iteration * BATCH_SIZE) % (CHECK_ROWS - BATCH_SIZE);
+
+    accumulateColumnCenters(&state->data, first, BATCH_SIZE, &state->model, state->sums, state->counts);
+    finalizeVectorCenters(&state->model, state->sums, state->counts);
+    modifyColumnDilutionPars(&state->data, first, BATCH_SIZE, &state->model);
+}
+
+static void runStreamTraining(checkState_t *state)
+{
+    initStreamTrainer(&state->trainer, &state->model, state->trainerSpace);
+    streamCenterPass(&state->trainer, &state->data);
+    finishCenterPass(&state->trainer);
+    streamDilutionPass(&state->trainer, &state->data);
+    finishDilutionPass(&state->trainer, 1);
+}
+
+static void runCoreset(checkState_t *state)
+{
+    offerCoresetBatch(&state->coreset, &state->data);
+}
+
+static void runSampler(checkState_t *state)
+{
+    int count = nextSampleBatch(&state->sampler, state->indices, BATCH_SIZE);
+
+    gatherColumnBatch(&state->data, state->indices, count, &state->batch);
+    accumulateColumnCenters(&state->batch, 0, count, &state->model, state->sums, state->counts);
+}
+
+static void runAssembler(checkState_t *state)
+{
+    const dataPoint_t *batch;
+    int chunk = 1 + (state->iteration % (3 * BATCH_SIZE)); //chunks of every length up to three batches
+
+    feedBatchAssembler(&state->assembler, &state->points[(state->iteration * 7) % (CHECK_ROWS - chunk)], chunk);
+    while(nextAssembledBatch(&state->assembler, &batch) != 0)
+    {
+        int *points[CHECK_CLASSES] = {&state->pointCounts[0], &state->pointCounts[1], &state->pointCounts[2]};
+
+        setCircleCenters((dataPoint_t *)batch, state->centers, points);
+    }
+}
+
+static void runBatchPool(checkState_t *state)
+{
+    colData_t *batches[CHECK_POOL];
+
+    for(int index=0; index<CHECK_POOL; index++)
+    {
+        batches[index] = acquireBatch(&state->pool);
+    }
+    for(int index=CHECK_POOL-1; index>=0; index--)
+    {
+        releaseBatch(&state->pool, batches[index]);
+    }
+}
+
+static const checkStage_t stages[] =
+{
+    {"classifyDataPoint",       runClassifyDataPoint},
+    {"setCircleCenters",        runTrainDataPoints},
+    {"classifyBitPoint",        runClassifyBitPoint},
+    {"setBitCircleCenters",     runTrainBitPoints},
+    {"classifyVectorPoint",     runClassifyVectorPoint},
+    {"classifySparsePoint",     runClassifySparsePoint},
+    {"classifyColumnBatch",     runClassifyColumnBatch},
+    {"classifyProjectedBatch",  runClassifyProjectedBatch},
+    {"trainColumnBatch",        runTrainColumns},
+    {"streamTrainer",           runStreamTraining},
+    {"offerCoresetBatch",       runCoreset},
+    {"nextSampleBatch",         runSampler},
+    {"nextAssembledBatch",      runAssembler},
+    {"acquireBatch",            runBatchPool},
+};
+
+static uint64_t checkRandom = 0x9E3779B97F4A7C15ULL;
+
+static float uniform(void) //xorshift64*, [0, 1)
+{
+    checkRandom ^= checkRandom >> 12;
+    checkRandom ^= checkRandom << 25;
+    checkRandom ^= checkRandom >> 27;
+
+    return (float)((checkRandom * 0x2545F4914F6CDD1DULL) >> 40) / (float)16777216.0;
+}
+
+static int setupState(checkState_t *state)
+{
+    int *points[CHECK_CLASSES] = {&state->pointCounts[0], &state->pointCounts[1], &state->pointCounts[2]};
+    int entries;
+
+    for(int row=0; row<CHECK_ROWS; row++)
+    {
+        int class = row % CHECK_CLASSES;
+
+        state->class[row] = class;
+        state->points[row].class = class;
+        state->points[row].xCoord = (float)(class * 4) + uniform();
+        state->points[row].yCoord = (float)(class * 4) + uniform();
+        state->bitPoints[row].class = class;
+        for(int word=0; word<BIT_WORDS; word++)
+        {
+            state->bitPoints[row].bits[word] = (class == 0) ? 0 : ((class == 1) ? 0x00000000FFFFFFFFULL : ~0ULL);
+            state->bitPoints[row].bits[word] ^= 1ULL << (row % 64);
+        }
+        for(int feature=0; feature<CHECK_DIM; feature++)
+        {
+            float value = (float)(class * 3) + uniform();
+
+            state->rows[(row * CHECK_DIM) + feature] = value;
+            state->columns[(feature * CHECK_ROWS) + row] = value;
+        }
+        state->rowPtr[row] = row * CHECK_NONZEROS;
+        for(int nonzero=0; nonzero<CHECK_NONZEROS; nonzero++)
+        {
+            state->colIdx[(row * CHECK_NONZEROS) + nonzero] = (class * CHECK_NONZEROS) + nonzero;
+            state->values[(row * CHECK_NONZEROS) + nonzero] = (float)1.0 + uniform();
+        }
+    }
+    state->rowPtr[CHECK_ROWS] = CHECK_ROWS * CHECK_NONZEROS;
+    for(int index=0; index<(CHECK_WIDE_ROWS * CHECK_WIDE); index++)
+    {
+        state->wide[index] = uniform();
+    }
+
+    for(int class=0; class<CHECK_CLASSES; class++)
+    {
+        initClassCenter(&state->centers[class]);
+        initDilutionParameters(&state->DPs[class]);
+        initBitCenter(&state->bitCenters[class], &state->votes[class]);
+    }
+    setCircleCenters(state->points, state->centers, points);
+    setBitCircleCenters(state->bitPoints, state->bitCenters, state->votes, CHECK_CLASSES);
+
+    state->data.rows = CHECK_ROWS;
+    state->data.cols = CHECK_DIM;
+    state->data.stride = CHECK_ROWS;
+    state->data.columns = state->columns;
+    state->data.class = state->class;
+    initVectorModel(&state->model, CHECK_CLASSES, CHECK_DIM, state->modelCenters, state->sqNorms, state->modelDPs);
+    accumulateColumnCenters(&state->data, 0, CHECK_ROWS, &state->model, state->sums, state->counts);
+    finalizeVectorCenters(&state->model, state->sums, state->counts);
+    modifyColumnDilutionPars(&state->data, 0, CHECK_ROWS, &state->model);
+
+    state->sparse.rows = CHECK_ROWS;
+    state->sparse.cols = CHECK_DIM;
+    state->sparse.rowPtr = state->rowPtr;
+    state->sparse.colIdx = state->colIdx;
+    state->sparse.values = state->values;
+    state->sparse.class = state->class;
+
+    entries = initRandomProjection(&state->proj, 1234u, CHECK_WIDE, CHECK_DIM, NULL, NULL);
+    state->entries = malloc((size_t)entries * sizeof(int16_t));
+    (void)initRandomProjection(&state->proj, 1234u, CHECK_WIDE, CHECK_DIM, state->colPtr, state->entries);
+
+    initCoreset(&state->coreset, CHECK_CLASSES, CHECK_DIM, CORESET_SIZE, 1u, state->coresetPoints, state->coresetStats);
+    initBatchSampler(&state->sampler, state->class, CHECK_ROWS, CHECK_CLASSES, SAMPLER_BALANCED, 1u, state->samplerSpace);
+    state->batch.rows = BATCH_SIZE;
+    state->batch.cols = CHECK_DIM;
+    state->batch.stride = BATCH_SIZE;
+    state->batch.columns = state->batchColumns;
+    state->batch.class = state->batchClass;
+    initBatchAssembler(&state->assembler);
+
+    state->memory = malloc(batchPoolBytes(CHECK_POOL, BATCH_SIZE, CHECK_DIM) + ARENA_ALIGN);
+    if((state->entries == NULL) || (state->memory == NULL))
+    {
+        return -1;
+    }
+    initArena(&state->arena, state->memory, batchPoolBytes(CHECK_POOL, BATCH_SIZE, CHECK_DIM) + ARENA_ALIGN);
+
+    return initBatchPool(&state->pool, &state->arena, CHECK_POOL, BATCH_SIZE, CHECK_DIM);
+}
+
+static long peakRss(void) //KiB, VmHWM of this image, ru_maxrss can carry the peak of the exec'ing process
+{
+    char status[4096];
+    int fd = open("/proc/self/status", O_RDONLY);
+    ssize_t length = (fd >= 0) ? read(fd, status, sizeof(status) - 1) : -1;
+    const char *found;
+    struct rusage usage;
+
+    if(fd >= 0)
+    {
+        (void)close(fd);
+    }
+    if(length > 0)
+    {
+        status[length] = '\0';
+        if((found = strstr(status, "VmHWM:")) != NULL)
+        {
+            return strtol(found + 6, NULL, 10);
+        }
+    }
+
+    return (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    checkState_t *state;
+    int iterations = 1000;
+    int warmup = 10;
+    int failed = 0;
+    long rss;
+
+    for(int index=1; index<argc; index+=2)
+    {
+        const char *value = (index + 1 < argc) ? argv[index + 1] : "";
+
+        if(strcmp(argv[index], "--iterations") == 0)    iterations = atoi(value);
+        else if(strcmp(argv[index], "--warmup") == 0)   warmup = atoi(value);
+        else                                            iterations = 0;
+
+        if((iterations < 1) || (warmup < 0))
+        {
+            (void)fprintf(stderr, "usage: %s [--iterations 1000] [--warmup 10]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    setLogLevel(LOG_WARNING); //decisions of classifyDataPoint would print to stdout on every iteration
+    rss = peakRss();
+    tracking = 1;
+    state = calloc(1, sizeof(checkState_t));
+    if((state == NULL) || (setupState(state) != 0))
+    {
+        (void)fprintf(stderr, "%s: setup failed\n", argv[0]);
+        return 1;
+    }
+    tracking = 0;
+    (void)fprintf(stderr, "%-24s %12s %12s %8s %14s %10s  %s\n", "stage", "allocations", "bytes", "frees", "peak RSS KiB", "growth", "verdict");
+    (void)fprintf(stderr, "%-24s %12lu %12lu %8lu %14ld %+10ld  %s\n", "setup", allocations, allocatedBytes, frees, peakRss(), peakRss() - rss, "allowed");
+
+    for(size_t stage=0; stage<(sizeof(stages) / sizeof(stages[0])); stage++)
+    {
+        for(state->iteration=0; state->iteration<warmup; state->iteration++)
+        {
+            stages[stage].run(state);
+        }
+
+        rss = peakRss();
+        allocations = 0;
+        allocatedBytes = 0;
+        frees = 0;
+        tracking = 1;
+        for(state->iteration=warmup; state->iteration<(warmup + iterations); state->iteration++)
+        {
+            stages[stage].run(state);
+        }
+        tracking = 0;
+
+        failed |= (allocations != 0) || (frees != 0);
+        (void)fprintf(stderr, "%-24s %12lu %12lu %8lu %14ld %+10ld  %s\n", stages[stage].name, allocations, allocatedBytes, frees,
+                      peakRss(), peakRss() - rss, ((allocations != 0) || (frees != 0)) ? "ALLOCATES" : "ok");
+    }
+
+    free(state->entries);
+    free(state->memory);
+    free(state);
+
+    return failed ? 1 : 0;
+}
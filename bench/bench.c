@@ -0,0 +1,501 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           bench.c
+ * Date:                30th November 2023
+ *
+ * Description: Micro and macro benchmarks of the library "dknn.h" on POSIX hosts. Microbenchmarks time
+                calcDistance, baseFunction, checkOverConfidenceCircle and classifyDataPoint one call at
+                a time, macrobenchmarks time batch classification and training with the columnar
+                functions over every combination of class count, dimension, batch size and thread
+                count. Each result reports ns/point, points/s and p50/p99/p999 latency, and the
+                results are written as JSON so runs of different builds can be compared.
+ *
+ *              Build: cc -std=c99 -O2 -I. bench/bench.c bench/bench_perf.c dknn.c -lm -lpthread -o dknn_bench
+ *              Usage: dknn_bench [--classes 3,8] [--dims 2,16,64] [--batch 50,256] [--threads 1,2]
+ *                                [--samples 2000] [--filter micro|macro] [--out results.json]
+ *
+ *              Where perf_event_open is permitted, every result also has cycles, instructions, L1D
+ *              and LLC misses and branch misses per point, counted around its whole sample loop, so
+ *              the counts include the clock reads between samples.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dknn.h"
+#include "bench_perf.h"
+
+#define BENCH_MAX_LIST          (16)        //values per swept parameter
+#define BENCH_MAX_THREADS       (256)
+#define BENCH_MICRO_REPS        (16)        //calls timed together by one microbenchmark sample
+#define BENCH_MICRO_SCALE       (10)        //microbenchmarks take this many times the samples
+#define BENCH_KEPT_SAMPLES      (256)       //raw samples written to JSON per result
+#define BENCH_INPUTS            (1024)      //distinct inputs cycled through by microbenchmarks
+
+#if BATCH_SIZE >= BENCH_INPUTS
+#error "BATCH_SIZE must be smaller than BENCH_INPUTS"
+#endif
+
+typedef struct benchListType
+{
+    int count;
+    int values[BENCH_MAX_LIST];
+} benchList_t;
+
+typedef struct benchOptionsType
+{
+    benchList_t classes;
+    benchList_t dims;
+    benchList_t batches;
+    benchList_t threads;
+    int samples;
+    const char *filter;     //NULL, "micro" or "macro"
+    const char *out;        //NULL for stdout
+} benchOptions_t;
+
+typedef struct benchResultType
+{
+    const char *name;
+    const char *kind;
+    int classes;
+    int dim;
+    int batch;
+    int threads;
+    int samples;
+    double *sampleNs;       //ns per point of every sample
+    double wallNs;          //wall time of all samples of all threads
+    double points;          //points processed by all samples of all threads
+    perfCounters_t counters;
+} benchResult_t;
+
+typedef struct benchWorkType
+{
+    const colData_t *data;
+    const vecModel_t *model;
+    int train;              //1 for training batches, 0 for classification
+    int batch;
+    int samples;
+    int thread;
+    int threads;
+    double *sampleNs;       //samples entries of this thread
+    pthread_barrier_t *start;
+    perfCounters_t counters;
+} benchWork_t;
+
+volatile float benchSink;
+
+static double nowNs(void)
+{
+    struct timespec now;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static uint64_t benchRandom = 0x2545F4914F6CDD1DULL;
+
+static float uniform(void) //xorshift64*, [0, 1)
+{
+    benchRandom ^= benchRandom >> 12;
+    benchRandom ^= benchRandom << 25;
+    benchRandom ^= benchRandom >> 27;
+
+    return (float)((benchRandom * 0x2545F4914F6CDD1DULL) >> 40) / (float)16777216.0;
+}
+
+static int parseList(const char *text, benchList_t *list)
+{
+    char *end;
+
+    list->count = 0;
+    while((*text != '\0') && (list->count < BENCH_MAX_LIST))
+    {
+        long value = strtol(text, &end, 10);
+
+        if((end == text) || (value < 1))
+        {
+            return -1;
+        }
+        list->values[list->count++] = (int)value;
+        text = (*end == ',') ? (end + 1) : end;
+    }
+
+    return (list->count > 0) ? 0 : -1;
+}
+
+static int compareDouble(const void *one, const void *other)
+{
+    double a = *(const double *)one;
+    double b = *(const double *)other;
+
+    return (a > b) - (a < b);
+}
+
+static double percentile(const double sorted[], int count, double fraction)
+{
+    int index = (int)ceil(fraction * (double)count) - 1;
+
+    index = (index < 0) ? 0 : index;
+    index = (index >= count) ? (count - 1) : index;
+
+    return sorted[index];
+}
+
+static void writeResult(FILE *json, const benchResult_t *result, int first)
+{
+    double *sorted = malloc((size_t)result->samples * sizeof(double));
+    double total = 0;
+    int stride = (result->samples + BENCH_KEPT_SAMPLES - 1) / BENCH_KEPT_SAMPLES;
+
+    for(int index=0; index<result->samples; index++)
+    {
+        sorted[index] = result->sampleNs[index];
+        total += result->sampleNs[index];
+    }
+    qsort(sorted, (size_t)result->samples, sizeof(double), compareDouble);
+
+    (void)fprintf(json, "%s\n    {\"name\": \"%s\", \"kind\": \"%s\", \"classes\": %d, \"dim\": %d, \"batch\": %d, \"threads\": %d,\n",
+                  first ? "" : ",", result->name, result->kind, result->classes, result->dim, result->batch, result->threads);
+    (void)fprintf(json, "     \"samples\": %d, \"ns_per_point\": %.3f, \"points_per_s\": %.1f, \"p50_ns\": %.3f, \"p99_ns\": %.3f, \"p999_ns\": %.3f,\n",
+                  result->samples, total / (double)result->samples, result->points / (result->wallNs * 1e-9),
+                  percentile(sorted, result->samples, 0.50), percentile(sorted, result->samples, 0.99), percentile(sorted, result->samples, 0.999));
+    (void)fprintf(json, "     ");
+    writePerfCounters(json, &result->counters, result->points);
+    (void)fprintf(json, ",\n     \"sample_ns\": [");
+    for(int index=0; index<result->samples; index+=stride)
+    {
+        (void)fprintf(json, "%s%.3f", (index == 0) ? "" : ", ", result->sampleNs[index]);
+    }
+    (void)fprintf(json, "]}");
+
+    free(sorted);
+}
+
+static void runMicro(FILE *json, const benchOptions_t *opts, int *first)
+{
+    static const char *names[5] = {"calcDistance", "baseFunction", "checkOverConfidenceCircle", "classifyDataPoint", "setCircleCenters"};
+    int samples = opts->samples * BENCH_MICRO_SCALE;
+    dataPoint_t points[BENCH_INPUTS];
+    float distances[BENCH_INPUTS];
+    classCenter_t circleCenters[3]; //setCircleCenters writes classes 0, 1 and 2 whatever --classes says
+
+    for(int index=0; index<BENCH_INPUTS; index++)
+    {
+        points[index].xCoord = uniform() * (float)20.0;
+        points[index].yCoord = uniform() * (float)20.0;
+        points[index].class = index % 3;
+        distances[index] = uniform() * (float)20.0;
+    }
+
+    for(int classIndex=0; classIndex<opts->classes.count; classIndex++)
+    {
+        int classes = opts->classes.values[classIndex];
+        classCenter_t *centers = malloc((size_t)classes * sizeof(classCenter_t));
+        dilPar_t *DPs = malloc((size_t)classes * sizeof(dilPar_t));
+
+        for(int class=0; class<classes; class++)
+        {
+            centers[class].xCoord = uniform() * (float)20.0;
+            centers[class].yCoord = uniform() * (float)20.0;
+            initDilutionParameters(&DPs[class]);
+            DPs[class].overconfidence = uniform() * (float)5.0;
+        }
+
+        for(int function=0; function<5; function++)
+        {
+            int perCall = (function == 4) ? BATCH_SIZE : 1;
+            benchResult_t result = {names[function], "micro", classes, 2, perCall, 1, samples, NULL, 0, 0, {{0}, {0}, {0}}};
+            int reps = (function >= 3) ? 1 : BENCH_MICRO_REPS;
+            int input = 0;
+            double begin;
+
+            if((function != 3) && (classIndex > 0)) //only classifyDataPoint depends on the class count
+            {
+                continue;
+            }
+            if(function == 4) //setCircleCenters only handles classes 0, 1 and 2
+            {
+                result.classes = 3;
+            }
+
+            result.sampleNs = malloc((size_t)samples * sizeof(double));
+            (void)openPerfCounters(&result.counters);
+            startPerfCounters(&result.counters);
+            begin = nowNs();
+            for(int sample=0; sample<samples; sample++)
+            {
+                double start = nowNs();
+                float sink = 0;
+
+                for(int rep=0; rep<reps; rep++, input=(input + 1) & (BENCH_INPUTS - 1))
+                {
+                    switch(function)
+                    {
+                        case 0: sink += calcDistance(points[input], centers[input % classes]); break;
+                        case 1: sink += baseFunction(distances[input], DPs[input % classes]); break;
+                        case 2: sink += (float)checkOverConfidenceCircle(distances[input], DPs[input % classes]); break;
+                        case 3: sink += (float)classifyDataPoint(&points[input], DPs, centers, classes); break;
+                        default:
+                        {
+                            int counts[3] = {0, 0, 0};
+                            int *pointCounts[3] = {&counts[0], &counts[1], &counts[2]};
+
+                            setCircleCenters(&points[(sample * BATCH_SIZE) % (BENCH_INPUTS - BATCH_SIZE)], circleCenters, pointCounts);
+                            sink += circleCenters[0].xCoord;
+                            break;
+                        }
+                    }
+                }
+                benchSink = sink;
+                result.sampleNs[sample] = (nowNs() - start) / (double)(reps * perCall);
+            }
+            result.wallNs = nowNs() - begin;
+            stopPerfCounters(&result.counters);
+            closePerfCounters(&result.counters);
+            result.points = (double)samples * (double)reps * (double)perCall;
+
+            writeResult(json, &result, *first);
+            *first = 0;
+            free(result.sampleNs);
+        }
+
+        free(centers);
+        free(DPs);
+    }
+}
+
+static void *macroWorker(void *argument)
+{
+    benchWork_t *work = argument;
+    const colData_t *data = work->data;
+    int dim = work->model->dim;
+    int classes = work->model->classes;
+    int *predicted = malloc((size_t)work->batch * sizeof(int));
+    float *sums = malloc((size_t)(classes * dim) * sizeof(float));
+    float *counts = malloc((size_t)classes * sizeof(float));
+    dilPar_t *DPs = malloc((size_t)classes * sizeof(dilPar_t));
+    vecModel_t model = *work->model;    //private dilution parameters, shared centers
+    int span = data->rows - work->batch + 1;
+
+    (void)memcpy(DPs, work->model->DPs, (size_t)classes * sizeof(dilPar_t));
+    (void)memset(sums, 0, (size_t)(classes * dim) * sizeof(float));
+    (void)memset(counts, 0, (size_t)classes * sizeof(float));
+    model.DPs = DPs;
+
+    (void)openPerfCounters(&work->counters);
+    (void)pthread_barrier_wait(work->start);
+    startPerfCounters(&work->counters);
+
+    for(int sample=0; sample<work->samples; sample++)
+    {
+        int first = (int)((((long long)sample * work->threads) + work->thread) * work->batch % span);
+        double start = nowNs();
+
+        if(work->train == 1)
+        {
+            accumulateColumnCenters(data, first, work->batch, &model, sums, counts);
+            modifyColumnDilutionPars(data, first, work->batch, &model);
+        }
+        else
+        {
+            classifyColumnBatch(data, first, work->batch, &model, predicted);
+        }
+        work->sampleNs[sample] = (nowNs() - start) / (double)work->batch;
+    }
+
+    stopPerfCounters(&work->counters);
+    closePerfCounters(&work->counters);
+    benchSink = (float)predicted[0] + sums[0] + DPs[0].spread;
+
+    free(predicted);
+    free(sums);
+    free(counts);
+    free(DPs);
+
+    return NULL;
+}
+
+static void makeData(colData_t *data, vecModel_t *model, int rows, int classes, int dim)
+{
+    float *sums = calloc((size_t)(classes * dim), sizeof(float));
+    float *counts = calloc((size_t)classes, sizeof(float));
+    float *means = malloc((size_t)(classes * dim) * sizeof(float));
+
+    data->rows = rows;
+    data->cols = dim;
+    data->stride = rows;
+    data->columns = malloc((size_t)rows * (size_t)dim * sizeof(float));
+    data->class = malloc((size_t)rows * sizeof(int));
+
+    for(int index=0; index<(classes * dim); index++)
+    {
+        means[index] = uniform() * (float)10.0;
+    }
+    for(int row=0; row<rows; row++) //gaussian-ish blobs, sum of three uniforms
+    {
+        int class = row % classes;
+
+        data->class[row] = class;
+        for(int feature=0; feature<dim; feature++)
+        {
+            data->columns[(feature * rows) + row] = means[(class * dim) + feature] + uniform() + uniform() + uniform() - (float)1.5;
+        }
+    }
+
+    initVectorModel(model, classes, dim, malloc((size_t)(classes * dim) * sizeof(float)), malloc((size_t)classes * sizeof(float)), malloc((size_t)classes * sizeof(dilPar_t)));
+    accumulateColumnCenters(data, 0, rows, model, sums, counts);
+    finalizeVectorCenters(model, sums, counts);
+    modifyColumnDilutionPars(data, 0, rows, model);
+
+    free(sums);
+    free(counts);
+    free(means);
+}
+
+static void freeData(colData_t *data, vecModel_t *model)
+{
+    free(data->columns);
+    free(data->class);
+    free(model->centers);
+    free(model->sqNorms);
+    free(model->DPs);
+}
+
+static void runMacro(FILE *json, const benchOptions_t *opts, int *first)
+{
+    for(int classIndex=0; classIndex<opts->classes.count; classIndex++)
+    {
+        for(int dimIndex=0; dimIndex<opts->dims.count; dimIndex++)
+        {
+            int classes = opts->classes.values[classIndex];
+            int dim = opts->dims.values[dimIndex];
+            int maxBatch = 0;
+            colData_t data;
+            vecModel_t model;
+
+            for(int index=0; index<opts->batches.count; index++)
+            {
+                maxBatch = (opts->batches.values[index] > maxBatch) ? opts->batches.values[index] : maxBatch;
+            }
+            makeData(&data, &model, (maxBatch * 64 > 65536) ? (maxBatch * 64) : 65536, classes, dim);
+
+            for(int train=0; train<2; train++)
+            {
+                for(int batchIndex=0; batchIndex<opts->batches.count; batchIndex++)
+                {
+                    for(int threadIndex=0; threadIndex<opts->threads.count; threadIndex++)
+                    {
+                        int threads = opts->threads.values[threadIndex];
+                        benchResult_t result = {train ? "trainColumnBatch" : "classifyColumnBatch", "macro", classes, dim,
+                                                opts->batches.values[batchIndex], threads, opts->samples * threads, NULL, 0, 0, {{0}, {0}, {0}}};
+                        benchWork_t work[BENCH_MAX_THREADS];
+                        pthread_t ids[BENCH_MAX_THREADS];
+                        pthread_barrier_t start;
+                        double begin;
+
+                        result.sampleNs = malloc((size_t)result.samples * sizeof(double));
+                        (void)pthread_barrier_init(&start, NULL, (unsigned)threads + 1);
+                        for(int thread=0; thread<threads; thread++)
+                        {
+                            work[thread] = (benchWork_t){&data, &model, train, result.batch, opts->samples, thread, threads,
+                                                         &result.sampleNs[thread * opts->samples], &start, {{0}, {0}, {0}}};
+                            (void)pthread_create(&ids[thread], NULL, macroWorker, &work[thread]);
+                        }
+                        begin = nowNs();
+                        (void)pthread_barrier_wait(&start);
+                        for(int thread=0; thread<threads; thread++)
+                        {
+                            (void)pthread_join(ids[thread], NULL);
+                        }
+                        result.wallNs = nowNs() - begin;
+                        result.points = (double)result.samples * (double)result.batch;
+                        result.counters = work[0].counters;
+                        for(int thread=1; thread<threads; thread++)
+                        {
+                            addPerfCounters(&result.counters, &work[thread].counters);
+                        }
+                        (void)pthread_barrier_destroy(&start);
+
+                        writeResult(json, &result, *first);
+                        *first = 0;
+                        free(result.sampleNs);
+                    }
+                }
+            }
+
+            freeData(&data, &model);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    benchOptions_t opts = {{2, {3, 8}}, {3, {2, 16, 64}}, {2, {50, 256}}, {1, {1}}, 2000, NULL, NULL};
+    FILE *json;
+    int first = 1;
+
+    for(int index=1; index<argc; index++)
+    {
+        const char *value = (index + 1 < argc) ? argv[index + 1] : "";
+        int bad = 0;
+
+        if(strcmp(argv[index], "--classes") == 0)       bad = parseList(value, &opts.classes);
+        else if(strcmp(argv[index], "--dims") == 0)     bad = parseList(value, &opts.dims);
+        else if(strcmp(argv[index], "--batch") == 0)    bad = parseList(value, &opts.batches);
+        else if(strcmp(argv[index], "--threads") == 0)  bad = parseList(value, &opts.threads);
+        else if(strcmp(argv[index], "--samples") == 0)  bad = ((opts.samples = atoi(value)) < 1) ? -1 : 0;
+        else if(strcmp(argv[index], "--filter") == 0)   opts.filter = value;
+        else if(strcmp(argv[index], "--out") == 0)      opts.out = value;
+        else bad = -1;
+
+        for(int thread=0; thread<opts.threads.count; thread++)
+        {
+            bad = (opts.threads.values[thread] > BENCH_MAX_THREADS) ? -1 : bad;
+        }
+        if(bad != 0)
+        {
+            (void)fprintf(stderr, "usage: %s [--classes 3,8] [--dims 2,16,64] [--batch 50,256] [--threads 1,2]"
+                                  " [--samples 2000] [--filter micro|macro] [--out results.json]\n", argv[0]);
+            return 2;
+        }
+        index++;
+    }
+
+    json = (opts.out != NULL) ? fopen(opts.out, "w") : stdout;
+    if(json == NULL)
+    {
+        perror("dknn_bench");
+        return 1;
+    }
+    setLogLevel(LOG_WARNING); //decisions of classifyDataPoint are not part of the measurement
+
+    (void)fprintf(json, "{\"benchmark\": \"dknn\", \"compiler\": \"%s\", \"batch_size\": %d, \"results\": [", __VERSION__, BATCH_SIZE);
+    if((opts.filter == NULL) || (strcmp(opts.filter, "micro") == 0))
+    {
+        runMicro(json, &opts, &first);
+    }
+    if((opts.filter == NULL) || (strcmp(opts.filter, "macro") == 0))
+    {
+        runMacro(json, &opts, &first);
+    }
+    (void)fprintf(json, "\n]}\n");
+
+    return (fclose(json) == 0) ? 0 : 1;
+}
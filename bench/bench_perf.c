@@ -0,0 +1,233 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           bench_perf.c
+ * Date:                30th November 2023
+ *
+ * Description: Source file of the hardware performance counters used by the benchmarks, see
+                "bench_perf.h". Every event is opened on its own, so one unsupported event does not
+                take the others down, and counts are scaled by enabled over running time when the
+                kernel multiplexes more events than the hardware has counters.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <unistd.h>
+#include "bench_perf.h"
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char *const perfEventNames[PERF_EVENTS] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+#if defined(__linux__)
+static const struct perfEventType
+{
+    uint32_t type;
+    uint64_t config;
+} perfEvents[PERF_EVENTS] =
+{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static double readScaled(int fd) //value * enabled / running
+{
+    uint64_t reading[3];
+
+    if(read(fd, reading, sizeof(reading)) != (ssize_t)sizeof(reading))
+    {
+        return 0;
+    }
+
+    return (reading[2] > 0) ? ((double)reading[0] * ((double)reading[1] / (double)reading[2])) : 0;
+}
+#endif
+
+/**
+ * @brief Open the performance counters of the calling thread.
+ *
+ * @param counters A pointer to the 'perfCounters_t' structure to initialize.
+ *
+ * @return The number of available counters, 0 if none are, e.g. without Linux, in containers or with
+ *         kernel.perf_event_paranoid above 2.
+ *
+ * @code
+ *   // Example usage:
+ *   perfCounters_t counters;
+ *   (void)openPerfCounters(&counters);
+ *   startPerfCounters(&counters);
+ *   // Measured region...
+ *   stopPerfCounters(&counters);
+ *   closePerfCounters(&counters);
+ * @endcode
+ */
+int openPerfCounters(perfCounters_t *counters)
+{
+    int available = 0;
+
+    for(int event=0; event<PERF_EVENTS; event++)
+    {
+        counters->fd[event] = -1;
+        counters->values[event] = 0;
+        counters->started[event] = 0;
+
+#if defined(__linux__)
+        {
+            struct perf_event_attr attr;
+
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = perfEvents[event].type;
+            attr.config = perfEvents[event].config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            counters->fd[event] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            available += (counters->fd[event] >= 0) ? 1 : 0;
+        }
+#endif
+    }
+
+    return available;
+}
+
+/**
+ * @brief Mark the start of a measured region.
+ *
+ * @param counters A pointer to the 'perfCounters_t' structure of the calling thread.
+ *
+ * @code
+ *   // Example usage:
+ *   startPerfCounters(&counters);
+ * @endcode
+ */
+void startPerfCounters(perfCounters_t *counters)
+{
+#if defined(__linux__)
+    for(int event=0; event<PERF_EVENTS; event++)
+    {
+        counters->started[event] = (counters->fd[event] >= 0) ? readScaled(counters->fd[event]) : 0;
+    }
+#else
+    (void)counters;
+#endif
+}
+
+/**
+ * @brief Mark the end of a measured region and add its counts to 'counters->values'.
+ *
+ * @param counters A pointer to the 'perfCounters_t' structure of the calling thread.
+ *
+ * @code
+ *   // Example usage:
+ *   stopPerfCounters(&counters);
+ * @endcode
+ */
+void stopPerfCounters(perfCounters_t *counters)
+{
+#if defined(__linux__)
+    for(int event=0; event<PERF_EVENTS; event++)
+    {
+        if(counters->fd[event] >= 0)
+        {
+            counters->values[event] += readScaled(counters->fd[event]) - counters->started[event];
+        }
+    }
+#else
+    (void)counters;
+#endif
+}
+
+/**
+ * @brief Add the counts of one thread to a total.
+ *
+ * @param total    A pointer to the 'perfCounters_t' structure of the total. A counter is available
+ *                 in the total only if it is available in every added thread.
+ * @param counters A pointer to the 'perfCounters_t' structure of the thread.
+ *
+ * @code
+ *   // Example usage:
+ *   addPerfCounters(&total, &work[thread].counters);
+ * @endcode
+ */
+void addPerfCounters(perfCounters_t *total, const perfCounters_t *counters)
+{
+    for(int event=0; event<PERF_EVENTS; event++)
+    {
+        total->fd[event] = (counters->fd[event] >= 0) ? total->fd[event] : -1;
+        total->values[event] += counters->values[event];
+    }
+}
+
+/**
+ * @brief Write counts per point as a JSON object member.
+ *
+ * @param json     The output stream.
+ * @param counters A pointer to the 'perfCounters_t' structure.
+ * @param points   The number of points processed in the measured regions.
+ *
+ * @note Writes '"counters": {"cycles": 12.5, ...}' with null for unavailable counters, and an
+ *       'ipc' member when cycles and instructions are both available.
+ *
+ * @code
+ *   // Example usage:
+ *   writePerfCounters(json, &counters, (double)samples * (double)batch);
+ * @endcode
+ */
+void writePerfCounters(FILE *json, const perfCounters_t *counters, double points)
+{
+    (void)fprintf(json, "\"counters\": {");
+    for(int event=0; event<PERF_EVENTS; event++)
+    {
+        if(counters->fd[event] >= 0)
+        {
+            (void)fprintf(json, "%s\"%s\": %.4f", (event == 0) ? "" : ", ", perfEventNames[event], counters->values[event] / points);
+        }
+        else
+        {
+            (void)fprintf(json, "%s\"%s\": null", (event == 0) ? "" : ", ", perfEventNames[event]);
+        }
+    }
+    if((counters->fd[0] >= 0) && (counters->fd[1] >= 0) && (counters->values[0] > 0))
+    {
+        (void)fprintf(json, ", \"ipc\": %.4f", counters->values[1] / counters->values[0]);
+    }
+    (void)fprintf(json, "}");
+}
+
+/**
+ * @brief Close the performance counters of a thread.
+ *
+ * @param counters A pointer to the 'perfCounters_t' structure to close. The counts stay readable.
+ *
+ * @code
+ *   // Example usage:
+ *   closePerfCounters(&counters);
+ * @endcode
+ */
+void closePerfCounters(perfCounters_t *counters)
+{
+    for(int event=0; event<PERF_EVENTS; event++)
+    {
+        if(counters->fd[event] >= 0)
+        {
+            (void)close(counters->fd[event]);
+        }
+    }
+}
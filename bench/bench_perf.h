@@ -0,0 +1,46 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           bench_perf.h
+ * Date:                30th November 2023
+ *
+ * Description: Header file of the hardware performance counters used by the benchmarks. Counts cycles,
+                instructions, L1 data cache misses, last level cache misses and branch misses of the
+                calling thread with perf_event_open on Linux. Counters the kernel, the hardware or
+                the permissions do not provide are reported as unavailable, and the benchmarks then
+                report wall-clock numbers only.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#ifndef DML_BENCH_PERF_H
+#define DML_BENCH_PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PERF_EVENTS             (5)
+
+typedef struct perfCountersType
+{
+    int fd[PERF_EVENTS];            //-1 for unavailable counters
+    double values[PERF_EVENTS];     //counts between start and stop, scaled for multiplexing
+    double started[PERF_EVENTS];
+} perfCounters_t;
+
+extern const char *const perfEventNames[PERF_EVENTS];
+
+int openPerfCounters(perfCounters_t *counters);
+void startPerfCounters(perfCounters_t *counters);
+void stopPerfCounters(perfCounters_t *counters);
+void addPerfCounters(perfCounters_t *total, const perfCounters_t *counters);
+void writePerfCounters(FILE *json, const perfCounters_t *counters, double points);
+void closePerfCounters(perfCounters_t *counters);
+
+#endif //DML_BENCH_PERF_H
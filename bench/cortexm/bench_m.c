@@ -0,0 +1,106 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           bench_m.c
+ * Date:                30th November 2023
+ *
+ * Description: Workload of the Cortex-M benchmark images run under QEMU by "run.sh". BENCH_MODE picks
+                what the image does after the common setup, BENCH_RUNS times:
+                0: nothing, the baseline subtracted from the other modes
+                1: classifyDataPoint on one data point
+                2: classifyColumnBatch on one data point, the same decision without printing
+                3: one training batch of BATCH_SIZE data points with setCircleCenters and
+                   modifyDilutionPars
+                The instructions a mode executes on top of the baseline, divided by BENCH_RUNS, are
+                the instructions per operation.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#include <stdint.h>
+#include "dknn.h"
+
+#ifndef BENCH_MODE
+#define BENCH_MODE      (0)
+#endif
+#ifndef BENCH_RUNS
+#define BENCH_RUNS      (100)
+#endif
+#define BENCH_CLASSES   (3)
+
+static dataPoint_t dataPack[BATCH_SIZE];
+static classCenter_t classCenters[BENCH_CLASSES];
+static dilPar_t dilutionPars[BENCH_CLASSES];
+static float columns[2 * BATCH_SIZE];
+static int predicted[BATCH_SIZE];
+static uint32_t seed = 12345u;
+volatile int benchSink;
+
+static float nextCoord(int class) //class clusters around (4 * class, 2 * class)
+{
+    seed = (seed * 1664525u) + 1013904223u;
+
+    return (float)(4 * class) + ((float)(seed >> 16) / (float)65536.0) - (float)0.5;
+}
+
+int main(void)
+{
+    int pointCounts[BENCH_CLASSES] = {0, 0, 0};
+    vecModel_t model;
+    float centers[2 * BENCH_CLASSES];
+    float sqNorms[BENCH_CLASSES];
+    colData_t batch = {1, 2, BATCH_SIZE, columns, NULL};
+
+    for(int index=0; index<BATCH_SIZE; index++)
+    {
+        dataPack[index].class = index % BENCH_CLASSES;
+        dataPack[index].xCoord = nextCoord(dataPack[index].class);
+        dataPack[index].yCoord = nextCoord(dataPack[index].class) * (float)0.5;
+        columns[index] = dataPack[index].xCoord;
+        columns[BATCH_SIZE + index] = dataPack[index].yCoord;
+    }
+    for(int index=0; index<BENCH_CLASSES; index++)
+    {
+        initClassCenter(&classCenters[index]);
+        initDilutionParameters(&dilutionPars[index]);
+        centers[(2 * index)] = (float)(4 * index);
+        centers[(2 * index) + 1] = (float)(2 * index);
+    }
+    initVectorModel(&model, BENCH_CLASSES, 2, centers, sqNorms, dilutionPars);
+    updateCenterNorms(&model);
+
+    for(int run=0; run<BENCH_RUNS; run++)
+    {
+#if BENCH_MODE == 1
+        benchSink = classifyDataPoint(&dataPack[run % BATCH_SIZE], dilutionPars, classCenters, BENCH_CLASSES);
+#elif BENCH_MODE == 2
+        classifyColumnBatch(&batch, run % BATCH_SIZE, 1, &model, predicted);
+        benchSink = predicted[0];
+#elif BENCH_MODE == 3
+        int *points[BENCH_CLASSES] = {&pointCounts[0], &pointCounts[1], &pointCounts[2]};
+
+        setCircleCenters(dataPack, classCenters, points);
+        for(int index=0; index<BATCH_SIZE; index++)
+        {
+            int class = dataPack[index].class;
+
+            modifyDilutionPars(dilutionPars, class, calcDistance(dataPack[index], classCenters[class]));
+        }
+        benchSink = pointCounts[0];
+#else
+        benchSink = run;
+#endif
+    }
+
+    (void)pointCounts;
+    (void)batch;
+    (void)predicted;
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#!/bin/sh
+#
+# Cortex-M0 and Cortex-M4F benchmark of "dknn.c" under QEMU.
+#
+# Usage: bench/cortexm/run.sh [--update]
+#
+# Builds bench_m.c for both targets, runs the images under qemu-system-arm with the "insn" TCG plugin
+# and reports instructions per operation, measured as the difference to the baseline image divided
+# by RUNS, together with the .text, .data and .bss size of dknn.o for each target and the static
+# configurations of tools/memory_report.sh. Exits with 1 if a value exceeds its limit in the
+# thresholds file, or if an instruction count is measured without a limit to check it against.
+# With --update, the instruction limits are rewritten from this run.
+#
+# Environment:
+#   CROSS          toolchain prefix (default arm-none-eabi-)
+#   QEMU           emulator (default qemu-system-arm)
+#   QEMU_PLUGIN    path of libinsn.so from the QEMU build (contrib/plugins), required: the script
+#                  exits with 2 without it rather than pass with no instruction counts
+#   RUNS           operations per image (default 100)
+#   THRESHOLDS     thresholds file (default bench/cortexm/thresholds)
+#
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+CROSS=${CROSS:-arm-none-eabi-}
+QEMU=${QEMU:-qemu-system-arm}
+QEMU_PLUGIN=${QEMU_PLUGIN:-}
+RUNS=${RUNS:-100}
+THRESHOLDS=${THRESHOLDS:-$HERE/thresholds}
+UPDATE=0
+[ "$1" = "--update" ] && UPDATE=1
+for tool in "${CROSS}gcc" "${CROSS}size" "$QEMU"; do
+    command -v "$tool" >/dev/null || { echo "run.sh: $tool not found" >&2; exit 2; }
+done
+if [ ! -f "$QEMU_PLUGIN" ]; then
+    echo "run.sh: QEMU_PLUGIN must name the insn plugin (libinsn.so) of the QEMU build" >&2
+    exit 2
+fi
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+targetFlags()
+{
+    case "$1" in
+        m0) echo "-mcpu=cortex-m0 -mthumb" ;;
+        m4) echo "-mcpu=cortex-m4 -mthumb -mfloat-abi=hard -mfpu=fpv4-sp-d16" ;;
+    esac
+}
+
+targetMachine()
+{
+    case "$1" in
+        m0) echo "microbit" ;;
+        m4) echo "mps2-an386" ;;
+    esac
+}
+
+LINK="-nostartfiles --specs=nano.specs --specs=nosys.specs -u _printf_float -Wl,--gc-sections"
+
+build() # $1 target, $2 mode
+{
+    # shellcheck disable=SC2046,SC2086
+    "${CROSS}gcc" $(targetFlags "$1") -std=c99 -Os -ffunction-sections -fdata-sections \
+        -DBENCH_MODE="$2" -DBENCH_RUNS="$RUNS" -I"$ROOT" \
+        "$HERE/bench_m.c" "$HERE/startup.c" "$ROOT/dknn.c" \
+        -L"$HERE" -T"$1.ld" $LINK -lm -o "$OUT/$1_$2.elf"
+}
+
+instructions() # $1 target, $2 mode
+{
+    timeout 600 "$QEMU" -M "$(targetMachine "$1")" -nographic -monitor none -serial null \
+        -semihosting-config enable=on,target=native -kernel "$OUT/$1_$2.elf" \
+        -plugin "$QEMU_PLUGIN" -d plugin -D "$OUT/$1_$2.log" >/dev/null 2>&1 || return 1
+    sed -n 's/^.*insns: *\([0-9][0-9]*\).*$/\1/p' "$OUT/$1_$2.log" | tail -n 1
+}
+
+limit() # $1 target, $2 metric
+{
+    awk -v t="$1" -v m="$2" '$1 == t && $2 == m { print $3 }' "$THRESHOLDS"
+}
+
+status=0
+: > "$OUT/measured"
+printf '%-6s %-10s %12s %12s  %s\n' "target" "metric" "value" "limit" "status"
+
+for target in m0 m4; do
+    # shellcheck disable=SC2046
+    "${CROSS}gcc" $(targetFlags "$target") -std=c99 -Os -c "$ROOT/dknn.c" -o "$OUT/$target.o"
+    set -- $("${CROSS}size" "$OUT/$target.o" | awk 'NR == 2 { print $1, $2, $3 }')
+    text=$1; data=$2; bss=$3
+    echo "$target text $text" >> "$OUT/measured"
+    echo "$target data $data" >> "$OUT/measured"
+    echo "$target bss $bss" >> "$OUT/measured"
+    echo "$target flash $(( text + data ))" >> "$OUT/measured"
+    echo "$target ram $(( data + bss ))" >> "$OUT/measured"
+
+    for mode in 0 1 2 3; do
+        build "$target" "$mode"
+    done
+    base=$(instructions "$target" 0) || { echo "$target: baseline image failed" >&2; exit 2; }
+    for pair in 1:classify 2:quiet 3:train; do
+        mode=${pair%%:*}
+        count=$(instructions "$target" "$mode") || { echo "$target: mode $mode image failed" >&2; exit 2; }
+        echo "$target ${pair#*:} $(( (count - base) / RUNS ))" >> "$OUT/measured"
+    done
+done
+
+while read -r target metric value; do
+    bound=$(limit "$target" "$metric")
+    verdict="-"
+    if [ -n "$bound" ]; then
+        verdict="ok"
+        if [ "$value" -gt "$bound" ]; then
+            verdict="REGRESSION"
+            status=1
+        fi
+    else
+        case "$metric" in
+            classify|quiet|train)
+                verdict="NO LIMIT"  # an unchecked instruction count would hide every regression
+                status=1
+                ;;
+        esac
+    fi
+    printf '%-6s %-10s %12d %12s  %s\n' "$target" "$metric" "$value" "${bound:--}" "$verdict"
+done < "$OUT/measured"
+
+for target in m0 m4; do
+    echo
+    echo "static configurations, $target:"
+    CC="${CROSS}gcc" CFLAGS="$(targetFlags "$target") -std=c99 -Os" \
+        LDFLAGS="-L$HERE -T$target.ld -nostartfiles --specs=nano.specs --specs=nosys.specs $HERE/startup.c" \
+        "$ROOT/tools/memory_report.sh" || status=1
+done
+
+if [ "$UPDATE" = 1 ]; then
+    grep -v -E '^[a-z0-9]+[[:space:]]+(classify|quiet|train)[[:space:]]' "$THRESHOLDS" > "$OUT/thresholds"
+    awk '$2 == "classify" || $2 == "quiet" || $2 == "train" { printf "%-11s %-11s %d\n", $1, $2, ($3 * 105 + 99) / 100 }' \
+        "$OUT/measured" >> "$OUT/thresholds"
+    cp "$OUT/thresholds" "$THRESHOLDS"
+    echo
+    echo "instruction limits written to $THRESHOLDS"
+    status=0
+fi
+
+exit $status
@@ -0,0 +1,86 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           startup.c
+ * Date:                30th November 2023
+ *
+ * Description: Minimal Cortex-M startup code of the QEMU benchmark images. Holds the vector table,
+                copies '.data' to RAM, clears '.bss', enables the FPU when the image uses it, calls
+                main and reports its return value to QEMU through semihosting, which ends the
+                emulation.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#include <stdint.h>
+
+#define SEMIHOSTING_EXIT_EXTENDED   (0x20)      //SYS_EXIT_EXTENDED, carries the exit code on 32-bit targets
+#define APPLICATION_EXIT            (0x20026)   //ADP_Stopped_ApplicationExit
+
+extern uint32_t __data_load__;
+extern uint32_t __data_start__;
+extern uint32_t __data_end__;
+extern uint32_t __bss_start__;
+extern uint32_t __bss_end__;
+extern uint32_t __stack_top__;
+
+int main(void);
+void Reset_Handler(void);
+void Fault_Handler(void);
+
+static void semihostingExit(int code)
+{
+    uint32_t block[2] = {APPLICATION_EXIT, (uint32_t)code};
+    register uint32_t reason __asm__("r0") = SEMIHOSTING_EXIT_EXTENDED;
+    register uint32_t *argument __asm__("r1") = block;
+
+    __asm__ volatile("bkpt 0xAB" : : "r"(reason), "r"(argument) : "memory");
+
+    for(;;)
+    {
+        //
+    }
+}
+
+__attribute__((section(".vectors"), used)) static void (*const vectorTable[16])(void) =
+{
+    (void (*)(void))&__stack_top__,
+    Reset_Handler,
+    Fault_Handler,      //NMI
+    Fault_Handler,      //HardFault
+    Fault_Handler,      //MemManage
+    Fault_Handler,      //BusFault
+    Fault_Handler,      //UsageFault
+};
+
+void Reset_Handler(void)
+{
+    uint32_t *source = &__data_load__;
+
+    for(uint32_t *target=&__data_start__; target<&__data_end__; target++)
+    {
+        *target = *source++;
+    }
+    for(uint32_t *target=&__bss_start__; target<&__bss_end__; target++)
+    {
+        *target = 0;
+    }
+
+#if defined(__ARM_FP)
+    *(volatile uint32_t *)0xE000ED88u |= (0xFu << 20); //CPACR: full access to CP10 and CP11
+    __asm__ volatile("dsb\n\tisb");
+#endif
+
+    semihostingExit(main());
+}
+
+void Fault_Handler(void)
+{
+    semihostingExit(0xFA);
+}
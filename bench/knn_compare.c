@@ -0,0 +1,591 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           knn_compare.c
+ * Date:                30th November 2023
+ *
+ * Description: Accuracy versus throughput comparison of DkNN against exact kNN on POSIX hosts. Trains
+                DkNN models for a sweep of initial SPREAD and OVERCONFIDENCE values, and an exact kNN
+                baseline both as a brute force scan and as a k-d tree index, on the same dataset
+                files. Reports accuracy, model bytes, training time and queries/s of each, and marks
+                the configurations on the Pareto frontier of accuracy, queries/s and model bytes,
+                which is what deployments are sized from.
+ *
+ *              Build: cc -std=c99 -O2 -I. bench/knn_compare.c dknn.c dknn_io.c -lm -lpthread -o knn_compare
+ *              Usage: knn_compare --train train.dknn [--test test.dknn | --holdout 0.2] [--k 5]
+ *                                 [--queries 10000] [--epochs 1] [--spread 0.5,1.442,4]
+ *                                 [--overconfidence 0.1,1,10] [--json results.json]
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include "dknn_io.h"
+
+#define COMPARE_MAX_K           (64)
+#define COMPARE_MAX_SWEEP       (16)
+#define COMPARE_MAX_RESULTS     (COMPARE_MAX_SWEEP * COMPARE_MAX_SWEEP + 2)
+#define COMPARE_LEAF_ROWS       (16)        //rows per k-d tree leaf
+#define COMPARE_MIN_TIMING_NS   (1e8)       //query sets are repeated until they take this long
+
+typedef struct compareResultType
+{
+    char name[64];
+    double spread;
+    double overconfidence;
+    double accuracy;
+    double modelBytes;
+    double trainSeconds;
+    double queriesPerSecond;
+    int pareto;
+} compareResult_t;
+
+typedef struct kdNodeType
+{
+    int first;
+    int count;
+    int split;          //feature of the split, -1 for a leaf
+    float value;
+    int left;
+    int right;
+} kdNode_t;
+
+typedef struct knnModelType
+{
+    int rows;
+    int dim;
+    int classes;
+    float *points;      //rows * dim, row-major, in k-d tree order
+    int *class;
+    kdNode_t *nodes;
+    int nodeCount;
+} knnModel_t;
+
+typedef struct neighborsType
+{
+    int count;
+    int k;
+    float sqDistance[COMPARE_MAX_K];    //ascending
+    int class[COMPARE_MAX_K];
+} neighbors_t;
+
+static double nowNs(void)
+{
+    struct timespec now;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static int parseDoubles(const char *text, double values[])
+{
+    int count = 0;
+    char *end;
+
+    while((*text != '\0') && (count < COMPARE_MAX_SWEEP))
+    {
+        values[count] = strtod(text, &end);
+        if((end == text) || (values[count] <= 0))
+        {
+            return -1;
+        }
+        count++;
+        text = (*end == ',') ? (end + 1) : end;
+    }
+
+    return count;
+}
+
+static void offerNeighbor(neighbors_t *neighbors, float sqDistance, int class) //insertion into the ascending list
+{
+    int index;
+
+    if((neighbors->count == neighbors->k) && (sqDistance >= neighbors->sqDistance[neighbors->k - 1]))
+    {
+        return;
+    }
+
+    index = (neighbors->count < neighbors->k) ? neighbors->count++ : (neighbors->k - 1);
+    while((index > 0) && (neighbors->sqDistance[index - 1] > sqDistance))
+    {
+        neighbors->sqDistance[index] = neighbors->sqDistance[index - 1];
+        neighbors->class[index] = neighbors->class[index - 1];
+        index--;
+    }
+    neighbors->sqDistance[index] = sqDistance;
+    neighbors->class[index] = class;
+}
+
+static int voteNeighbors(const neighbors_t *neighbors, int classes, int votes[]) //majority, ties to the nearest
+{
+    int best = -1;
+
+    for(int class=0; class<classes; class++)
+    {
+        votes[class] = 0;
+    }
+    for(int index=0; index<neighbors->count; index++)
+    {
+        votes[neighbors->class[index]]++;
+    }
+    for(int index=0; index<neighbors->count; index++)
+    {
+        int class = neighbors->class[index];
+
+        best = ((best < 0) || (votes[class] > votes[best])) ? class : best;
+    }
+
+    return best;
+}
+
+static float rowSqDistance(const float *one, const float *other, int dim)
+{
+    float sum = 0;
+
+    for(int feature=0; feature<dim; feature++)
+    {
+        float difference = one[feature] - other[feature];
+
+        sum += difference * difference;
+    }
+
+    return sum;
+}
+
+static void selectMedian(knnModel_t *model, int *order, int count, int median, int split) //quickselect on one feature
+{
+    int low = 0;
+    int high = count - 1;
+
+    while(low < high)
+    {
+        float pivot = model->points[(order[(low + high) / 2] * model->dim) + split];
+        int left = low;
+        int right = high;
+
+        while(left <= right)
+        {
+            while(model->points[(order[left] * model->dim) + split] < pivot)
+            {
+                left++;
+            }
+            while(model->points[(order[right] * model->dim) + split] > pivot)
+            {
+                right--;
+            }
+            if(left <= right)
+            {
+                int swap = order[left];
+
+                order[left++] = order[right];
+                order[right--] = swap;
+            }
+        }
+        if(median <= right)
+        {
+            high = right;
+        }
+        else if(median >= left)
+        {
+            low = left;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+static int buildNode(knnModel_t *model, int *order, int first, int count)
+{
+    int node = model->nodeCount++;
+    int split = 0;
+    float widest = -1;
+
+    model->nodes[node] = (kdNode_t){first, count, -1, 0, -1, -1};
+    if(count <= COMPARE_LEAF_ROWS)
+    {
+        return node;
+    }
+
+    for(int feature=0; feature<model->dim; feature++) //split the widest feature
+    {
+        float min = FLT_MAX;
+        float max = -FLT_MAX;
+
+        for(int index=first; index<(first + count); index++)
+        {
+            float value = model->points[(order[index] * model->dim) + feature];
+
+            min = (value < min) ? value : min;
+            max = (value > max) ? value : max;
+        }
+        if((max - min) > widest)
+        {
+            widest = max - min;
+            split = feature;
+        }
+    }
+
+    selectMedian(model, &order[first], count, count / 2, split);
+    model->nodes[node].split = split;
+    model->nodes[node].value = model->points[(order[first + (count / 2)] * model->dim) + split];
+    model->nodes[node].left = buildNode(model, order, first, count / 2);
+    model->nodes[node].right = buildNode(model, order, first + (count / 2), count - (count / 2));
+
+    return node;
+}
+
+static void buildKnn(knnModel_t *model, const colData_t *train, int rows, int classes)
+{
+    float *points = malloc((size_t)rows * (size_t)train->cols * sizeof(float));
+    int *class = malloc((size_t)rows * sizeof(int));
+    int *order = malloc((size_t)rows * sizeof(int));
+
+    model->rows = rows;
+    model->dim = train->cols;
+    model->classes = classes;
+    model->points = malloc((size_t)rows * (size_t)train->cols * sizeof(float));
+    model->class = malloc((size_t)rows * sizeof(int));
+    model->nodes = malloc((size_t)(((2 * rows) / COMPARE_LEAF_ROWS) + 2) * 2 * sizeof(kdNode_t));
+    model->nodeCount = 0;
+
+    model->rows = 0;
+    for(int row=0; row<rows; row++) //labeled rows only
+    {
+        if((train->class[row] < 0) || (train->class[row] >= classes))
+        {
+            continue;
+        }
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            model->points[(model->rows * model->dim) + feature] = train->columns[(feature * train->stride) + row];
+        }
+        model->class[model->rows] = train->class[row];
+        order[model->rows] = model->rows;
+        model->rows++;
+    }
+    rows = model->rows;
+
+    (void)buildNode(model, order, 0, rows);
+
+    for(int index=0; index<rows; index++) //store rows in tree order, leaves become contiguous
+    {
+        (void)memcpy(&points[index * model->dim], &model->points[order[index] * model->dim], (size_t)model->dim * sizeof(float));
+        class[index] = model->class[order[index]];
+    }
+    free(model->points);
+    free(model->class);
+    free(order);
+    model->points = points;
+    model->class = class;
+}
+
+static void searchNode(const knnModel_t *model, int node, const float *query, neighbors_t *neighbors)
+{
+    const kdNode_t *current = &model->nodes[node];
+    float difference;
+
+    if(current->split < 0)
+    {
+        for(int row=current->first; row<(current->first + current->count); row++)
+        {
+            offerNeighbor(neighbors, rowSqDistance(query, &model->points[row * model->dim], model->dim), model->class[row]);
+        }
+        return;
+    }
+
+    difference = query[current->split] - current->value;
+    searchNode(model, (difference < 0) ? current->left : current->right, query, neighbors);
+    if((neighbors->count < neighbors->k) || ((difference * difference) < neighbors->sqDistance[neighbors->k - 1]))
+    {
+        searchNode(model, (difference < 0) ? current->right : current->left, query, neighbors);
+    }
+}
+
+static int classifyKnn(const knnModel_t *model, const float *query, int k, int indexed, int votes[])
+{
+    neighbors_t neighbors;
+
+    neighbors.count = 0;
+    neighbors.k = k;
+
+    if(indexed == 1)
+    {
+        searchNode(model, 0, query, &neighbors);
+    }
+    else
+    {
+        for(int row=0; row<model->rows; row++)
+        {
+            offerNeighbor(&neighbors, rowSqDistance(query, &model->points[row * model->dim], model->dim), model->class[row]);
+        }
+    }
+
+    return voteNeighbors(&neighbors, model->classes, votes);
+}
+
+static double accuracyOf(const int predicted[], const int class[], int count)
+{
+    int correct = 0;
+    int labeled = 0;
+
+    for(int row=0; row<count; row++)
+    {
+        labeled += (class[row] >= 0) ? 1 : 0;
+        correct += ((class[row] >= 0) && (predicted[row] == class[row])) ? 1 : 0;
+    }
+
+    return (labeled > 0) ? ((double)correct / (double)labeled) : 0;
+}
+
+static void markPareto(compareResult_t results[], int count) //no other result is at least as good in all three and better in one
+{
+    for(int one=0; one<count; one++)
+    {
+        results[one].pareto = 1;
+        for(int other=0; (other < count) && results[one].pareto; other++)
+        {
+            const compareResult_t *a = &results[one];
+            const compareResult_t *b = &results[other];
+            int noWorse = (b->accuracy >= a->accuracy) && (b->queriesPerSecond >= a->queriesPerSecond) && (b->modelBytes <= a->modelBytes);
+            int better = (b->accuracy > a->accuracy) || (b->queriesPerSecond > a->queriesPerSecond) || (b->modelBytes < a->modelBytes);
+
+            results[one].pareto = (noWorse && better) ? 0 : 1;
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    (void)fprintf(stderr, "usage: %s --train train.dknn [--test test.dknn | --holdout 0.2] [--k 5] [--queries 10000] [--epochs 1]"
+                          " [--spread 0.5,1.442,4] [--overconfidence 0.1,1,10] [--json results.json]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *trainPath = NULL;
+    const char *testPath = NULL;
+    const char *jsonPath = NULL;
+    double holdout = 0.2;
+    int k = 5;
+    int queries = 10000;
+    int epochs = 1;
+    double spreads[COMPARE_MAX_SWEEP] = {0.5, SPREAD, 4.0};
+    double overconfidences[COMPARE_MAX_SWEEP] = {0.1, 1.0, OVERCONFIDENCE};
+    int spreadCount = 3;
+    int overconfidenceCount = 3;
+    compareResult_t results[COMPARE_MAX_RESULTS];
+    int resultCount = 0;
+    dsFile_t trainFile;
+    dsFile_t testFile;
+    colData_t train;
+    colData_t test;
+    int classes;
+    int *predicted;
+    int *votes;
+    float *query;
+
+    for(int index=1; index<argc; index+=2)
+    {
+        const char *value = (index + 1 < argc) ? argv[index + 1] : NULL;
+
+        if(value == NULL)                                       { usage(argv[0]); return 2; }
+        else if(strcmp(argv[index], "--train") == 0)            trainPath = value;
+        else if(strcmp(argv[index], "--test") == 0)             testPath = value;
+        else if(strcmp(argv[index], "--holdout") == 0)          holdout = atof(value);
+        else if(strcmp(argv[index], "--k") == 0)                k = atoi(value);
+        else if(strcmp(argv[index], "--queries") == 0)          queries = atoi(value);
+        else if(strcmp(argv[index], "--epochs") == 0)           epochs = atoi(value);
+        else if(strcmp(argv[index], "--spread") == 0)           spreadCount = parseDoubles(value, spreads);
+        else if(strcmp(argv[index], "--overconfidence") == 0)   overconfidenceCount = parseDoubles(value, overconfidences);
+        else if(strcmp(argv[index], "--json") == 0)             jsonPath = value;
+        else                                                    { usage(argv[0]); return 2; }
+    }
+    if((trainPath == NULL) || (k < 1) || (k > COMPARE_MAX_K) || (queries < 1) || (epochs < 0) ||
+       (spreadCount < 1) || (overconfidenceCount < 1) || (holdout <= 0) || (holdout >= 1))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if((openDatasetFile(trainPath, &trainFile) != 0) || (trainFile.data.class == NULL) ||
+       ((testPath != NULL) && ((openDatasetFile(testPath, &testFile) != 0) || (testFile.data.class == NULL) || (testFile.data.cols != trainFile.data.cols))))
+    {
+        (void)fprintf(stderr, "%s: cannot open labeled dataset files\n", argv[0]);
+        return 1;
+    }
+
+    train = trainFile.data;
+    if(testPath != NULL)
+    {
+        test = testFile.data;
+    }
+    else //hold out the last rows, as a view into the same mapping
+    {
+        int kept = (int)((double)train.rows * (1.0 - holdout));
+
+        test = train;
+        test.rows = train.rows - kept;
+        test.columns = &train.columns[kept];
+        test.class = &train.class[kept];
+        train.rows = kept;
+    }
+    queries = (queries < test.rows) ? queries : test.rows;
+    classes = trainFile.classes;
+    predicted = malloc((size_t)queries * sizeof(int));
+    votes = malloc((size_t)(classes + 1) * sizeof(int));
+    query = malloc((size_t)train.cols * sizeof(float));
+
+    (void)fprintf(stderr, "train %d rows, test %d queries, %d features, %d classes, k %d\n", train.rows, queries, train.cols, classes, k);
+
+    for(int spreadIndex=0; spreadIndex<spreadCount; spreadIndex++)  //DkNN sweep
+    {
+        for(int ocIndex=0; ocIndex<overconfidenceCount; ocIndex++)
+        {
+            compareResult_t *result = &results[resultCount++];
+            float *centers = malloc((size_t)(classes * train.cols) * sizeof(float));
+            float *sqNorms = malloc((size_t)classes * sizeof(float));
+            float *sums = calloc((size_t)(classes * train.cols), sizeof(float));
+            float *counts = calloc((size_t)classes, sizeof(float));
+            dilPar_t *DPs = malloc((size_t)classes * sizeof(dilPar_t));
+            vecModel_t model;
+            double start = nowNs();
+            double elapsed;
+            long runs = 0;
+
+            initVectorModel(&model, classes, train.cols, centers, sqNorms, DPs);
+            for(int class=0; class<classes; class++)
+            {
+                DPs[class].spread = (float)spreads[spreadIndex];
+                DPs[class].overconfidence = (float)overconfidences[ocIndex];
+            }
+            accumulateColumnCenters(&train, 0, train.rows, &model, sums, counts);
+            finalizeVectorCenters(&model, sums, counts);
+            for(int epoch=0; epoch<epochs; epoch++)
+            {
+                modifyColumnDilutionPars(&train, 0, train.rows, &model);
+            }
+
+            (void)snprintf(result->name, sizeof(result->name), "dknn");
+            result->spread = spreads[spreadIndex];
+            result->overconfidence = overconfidences[ocIndex];
+            result->trainSeconds = (nowNs() - start) * 1e-9;
+            result->modelBytes = (double)classes * (double)(((size_t)train.cols * sizeof(float)) + sizeof(float) + sizeof(dilPar_t));
+
+            start = nowNs();
+            do
+            {
+                classifyColumnBatch(&test, 0, queries, &model, predicted);
+                runs++;
+                elapsed = nowNs() - start;
+            } while(elapsed < COMPARE_MIN_TIMING_NS);
+            result->queriesPerSecond = (double)runs * (double)queries / (elapsed * 1e-9);
+            result->accuracy = accuracyOf(predicted, test.class, queries);
+
+            free(centers);
+            free(sqNorms);
+            free(sums);
+            free(counts);
+            free(DPs);
+        }
+    }
+
+    for(int indexed=0; indexed<2; indexed++) //exact kNN, brute force then k-d tree
+    {
+        compareResult_t *result = &results[resultCount++];
+        knnModel_t knn;
+        double start = nowNs();
+        double elapsed;
+        long runs = 0;
+
+        buildKnn(&knn, &train, train.rows, classes);
+        (void)snprintf(result->name, sizeof(result->name), indexed ? "knn-kdtree" : "knn-brute");
+        result->spread = 0;
+        result->overconfidence = 0;
+        result->trainSeconds = (nowNs() - start) * 1e-9;
+        result->modelBytes = (double)train.rows * (double)(((size_t)train.cols * sizeof(float)) + sizeof(int))
+                           + (indexed ? ((double)knn.nodeCount * (double)sizeof(kdNode_t)) : 0);
+
+        start = nowNs();
+        do
+        {
+            for(int row=0; row<queries; row++)
+            {
+                for(int feature=0; feature<train.cols; feature++)
+                {
+                    query[feature] = test.columns[(feature * test.stride) + row];
+                }
+                predicted[row] = classifyKnn(&knn, query, k, indexed, votes);
+            }
+            runs++;
+            elapsed = nowNs() - start;
+        } while(elapsed < COMPARE_MIN_TIMING_NS);
+        result->queriesPerSecond = (double)runs * (double)queries / (elapsed * 1e-9);
+        result->accuracy = accuracyOf(predicted, test.class, queries);
+
+        free(knn.points);
+        free(knn.class);
+        free(knn.nodes);
+    }
+
+    markPareto(results, resultCount);
+
+    (void)printf("%-12s %9s %9s %9s %14s %12s %14s  %s\n", "model", "spread", "overconf", "accuracy", "model bytes", "train s", "queries/s", "pareto");
+    for(int index=0; index<resultCount; index++)
+    {
+        const compareResult_t *result = &results[index];
+
+        (void)printf("%-12s %9.3f %9.3f %9.4f %14.0f %12.4f %14.0f  %s\n", result->name, result->spread, result->overconfidence,
+                     result->accuracy, result->modelBytes, result->trainSeconds, result->queriesPerSecond, result->pareto ? "*" : "");
+    }
+
+    if(jsonPath != NULL)
+    {
+        FILE *json = fopen(jsonPath, "w");
+
+        if(json == NULL)
+        {
+            perror(jsonPath);
+            return 1;
+        }
+        (void)fprintf(json, "{\"train_rows\": %d, \"queries\": %d, \"dim\": %d, \"classes\": %d, \"k\": %d, \"epochs\": %d, \"results\": [",
+                      train.rows, queries, train.cols, classes, k, epochs);
+        for(int index=0; index<resultCount; index++)
+        {
+            const compareResult_t *result = &results[index];
+
+            (void)fprintf(json, "%s\n    {\"model\": \"%s\", \"spread\": %g, \"overconfidence\": %g, \"accuracy\": %.6f, \"model_bytes\": %.0f,"
+                                " \"train_s\": %.6f, \"queries_per_s\": %.1f, \"pareto\": %s}",
+                          (index == 0) ? "" : ",", result->name, result->spread, result->overconfidence, result->accuracy,
+                          result->modelBytes, result->trainSeconds, result->queriesPerSecond, result->pareto ? "true" : "false");
+        }
+        (void)fprintf(json, "\n]}\n");
+        (void)fclose(json);
+    }
+
+    free(predicted);
+    free(votes);
+    free(query);
+    closeDatasetFile(&trainFile);
+    if(testPath != NULL)
+    {
+        closeDatasetFile(&testFile);
+    }
+
+    return 0;
+}
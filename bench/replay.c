@@ -0,0 +1,346 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           replay.c
+ * Date:                30th November 2023
+ *
+ * Description: Query trace replay of the library "dknn.h" on POSIX hosts. Replays a trace captured
+                with 'traceCapture_t' (see "dknn_io.h") against a vector model trained from a dataset
+                file, and reports the latency distribution under that load. The replay is open loop:
+                every query has an intended start time, at its recorded arrival time scaled by
+                'speed' or at a fixed 'rate', and is issued then whether or not earlier queries are
+                done. Latencies are measured from the intended start, so time spent queued behind a
+                slow query is counted instead of hidden (coordinated omission); the service time
+                alone is reported next to it. Queries are issued in order of their intended start,
+                measured from the earliest record, even if a trace holds records out of order. The
+                model id of a record only selects its row in the per-model counts, every query is
+                classified with the one trained model.
+ *
+ *              Build: cc -std=c99 -O2 -I. bench/replay.c dknn.c dknn_io.c -lm -lpthread -o dknn_replay
+ *              Usage: dknn_replay --trace queries.trace --train train.dknn [--speed 1] [--rate 0]
+ *                                 [--workers 1] [--json replay.json]
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "dknn_io.h"
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#define REPLAY_MAX_WORKERS      (256)
+#define REPLAY_SPIN_NS          (200000)    //last stretch before a start is spun instead of slept
+#define REPLAY_LEAD_NS          (1000000)   //intended start of the first query after the workers are up
+#define REPLAY_MAX_MODELS       (16)        //model ids listed separately, the rest are summed
+
+typedef struct replayQueryType
+{
+    uint64_t intended;          //intended start since 'origin'
+    uint64_t record;            //index of the record in the trace
+} replayQuery_t;
+
+typedef struct replayRunType
+{
+    const queryTrace_t *trace;
+    const vecModel_t *model;
+    const replayQuery_t *queries; //records, sorted by intended start
+    uint64_t origin;
+    uint64_t next;              //next record to issue
+    double *latency;            //records, completion minus intended start
+    double *service;            //records, completion minus actual start
+    pthread_barrier_t start;
+} replayRun_t;
+
+volatile int replaySink;
+
+static uint64_t nowNs(void)
+{
+    struct timespec now;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000000u) + (uint64_t)now.tv_nsec;
+}
+
+static void waitUntil(uint64_t target)
+{
+    uint64_t now = nowNs();
+
+    if(target > (now + REPLAY_SPIN_NS))
+    {
+        struct timespec wake;
+        uint64_t sleepTo = target - REPLAY_SPIN_NS;
+
+        wake.tv_sec = (time_t)(sleepTo / 1000000000u);
+        wake.tv_nsec = (long)(sleepTo % 1000000000u);
+        (void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+    while(nowNs() < target)
+    {
+    }
+}
+
+static void *replayWorker(void *argument)
+{
+    replayRun_t *run = argument;
+
+    (void)pthread_barrier_wait(&run->start);
+
+    for(;;)
+    {
+        uint64_t index = __atomic_fetch_add(&run->next, 1u, __ATOMIC_RELAXED);
+        uint64_t intended;
+        uint64_t begin;
+        uint64_t end;
+        traceRecord_t record;
+
+        if(index >= run->trace->records)
+        {
+            break;
+        }
+
+        intended = run->origin + run->queries[index].intended;
+        getTraceRecord(run->trace, run->queries[index].record, &record);
+        waitUntil(intended);
+
+        begin = nowNs();
+        replaySink = classifyVectorPoint(record.point, run->model);
+        end = nowNs();
+
+        run->latency[index] = (double)(end - intended);
+        run->service[index] = (double)(end - begin);
+    }
+    releaseHotCounters();
+
+    return NULL;
+}
+
+static int compareDouble(const void *one, const void *other)
+{
+    double left = *(const double *)one;
+    double right = *(const double *)other;
+
+    return (left > right) - (left < right);
+}
+
+static int compareQuery(const void *one, const void *other)
+{
+    uint64_t left = ((const replayQuery_t *)one)->intended;
+    uint64_t right = ((const replayQuery_t *)other)->intended;
+
+    return (left > right) - (left < right);
+}
+
+static double percentile(const double sorted[], uint64_t count, double fraction)
+{
+    uint64_t index = (uint64_t)(fraction * (double)(count - 1) + 0.5);
+
+    return sorted[(index < count) ? index : (count - 1)];
+}
+
+static int trainModel(const char *path, int dim, vecModel_t *model)
+{
+    dsFile_t file;
+    streamTrainer_t trainer;
+    double *workspace;
+    int classes;
+    int retVal;
+
+    if(openDatasetFile(path, &file) != 0)
+    {
+        return -1;
+    }
+    classes = file.classes;
+    closeDatasetFile(&file);
+    if(classes < 1)
+    {
+        return -1;
+    }
+
+    initVectorModel(model, classes, dim, malloc((size_t)(classes * dim) * sizeof(float)), malloc((size_t)classes * sizeof(float)),
+                    malloc((size_t)classes * sizeof(dilPar_t)));
+    workspace = malloc((size_t)STREAM_TRAINER_DOUBLES(classes, dim) * sizeof(double));
+    if((model->centers == NULL) || (model->sqNorms == NULL) || (model->DPs == NULL) || (workspace == NULL))
+    {
+        return -1;
+    }
+    initStreamTrainer(&trainer, model, workspace);
+    retVal = trainDatasetFile(path, 0, &trainer, EPOCH);
+    free(workspace);
+
+    return retVal;
+}
+
+static void writeDistribution(FILE *json, const char *name, const double sorted[], uint64_t count)
+{
+    (void)fprintf(json, "\"%s\": {\"p50_ns\": %.0f, \"p90_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f}", name,
+                  percentile(sorted, count, 0.50), percentile(sorted, count, 0.90), percentile(sorted, count, 0.99),
+                  percentile(sorted, count, 0.999), sorted[count - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *tracePath = NULL;
+    const char *trainPath = NULL;
+    const char *jsonPath = NULL;
+    double speed = 1.0;
+    double rate = 0;
+    int workers = 1;
+    queryTrace_t trace;
+    vecModel_t model;
+    replayRun_t run;
+    pthread_t ids[REPLAY_MAX_WORKERS];
+    replayQuery_t *queries;
+    uint64_t perModel[REPLAY_MAX_MODELS + 1] = {0};
+    uint64_t first = UINT64_MAX;
+    uint64_t finished;
+    double span;
+    FILE *json;
+
+    for(int index=1; index<argc; index+=2)
+    {
+        const char *value = (index + 1 < argc) ? argv[index + 1] : NULL;
+
+        if(value == NULL)                               workers = 0;
+        else if(strcmp(argv[index], "--trace") == 0)    tracePath = value;
+        else if(strcmp(argv[index], "--train") == 0)    trainPath = value;
+        else if(strcmp(argv[index], "--speed") == 0)    speed = atof(value);
+        else if(strcmp(argv[index], "--rate") == 0)     rate = atof(value);
+        else if(strcmp(argv[index], "--workers") == 0)  workers = atoi(value);
+        else if(strcmp(argv[index], "--json") == 0)     jsonPath = value;
+        else                                            workers = 0;
+    }
+    if((tracePath == NULL) || (trainPath == NULL) || (speed <= 0) || (rate < 0) || (workers < 1) || (workers > REPLAY_MAX_WORKERS))
+    {
+        (void)fprintf(stderr, "usage: %s --trace queries.trace --train train.dknn [--speed 1] [--rate 0] [--workers 1] [--json replay.json]\n", argv[0]);
+        return 2;
+    }
+
+    if((openTraceFile(tracePath, &trace) != 0) || (trace.records == 0))
+    {
+        (void)fprintf(stderr, "%s: not a trace file or empty\n", tracePath);
+        return 1;
+    }
+    if(trainModel(trainPath, trace.dim, &model) != 0)
+    {
+        (void)fprintf(stderr, "%s: cannot train a model of %d features\n", trainPath, trace.dim);
+        return 1;
+    }
+
+    queries = malloc(trace.records * sizeof(replayQuery_t));
+    run.latency = malloc(trace.records * sizeof(double));
+    run.service = malloc(trace.records * sizeof(double));
+    if((queries == NULL) || (run.latency == NULL) || (run.service == NULL))
+    {
+        return 1;
+    }
+    for(uint64_t index=0; index<trace.records; index++) //the earliest record is the origin, whatever its position
+    {
+        traceRecord_t record;
+
+        getTraceRecord(&trace, index, &record);
+        first = (record.timeNs < first) ? record.timeNs : first;
+    }
+    for(uint64_t index=0; index<trace.records; index++)
+    {
+        traceRecord_t record;
+
+        getTraceRecord(&trace, index, &record);
+        queries[index].record = index;
+        queries[index].intended = (uint64_t)((double)(record.timeNs - first) / speed);
+        perModel[(record.modelId < REPLAY_MAX_MODELS) ? record.modelId : REPLAY_MAX_MODELS]++;
+    }
+    qsort(queries, trace.records, sizeof(replayQuery_t), compareQuery);
+    for(uint64_t index=0; (rate > 0) && (index<trace.records); index++) //fixed rate, in arrival order
+    {
+        queries[index].intended = (uint64_t)((double)index * 1e9 / rate);
+    }
+
+#if defined(__linux__)
+    (void)prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL); //wake up on time, the default slack is 50 us
+#endif
+    run.trace = &trace;
+    run.model = &model;
+    run.queries = queries;
+    run.next = 0;
+    (void)pthread_barrier_init(&run.start, NULL, (unsigned)workers + 1);
+    for(int worker=0; worker<workers; worker++)
+    {
+        (void)pthread_create(&ids[worker], NULL, replayWorker, &run);
+    }
+    run.origin = nowNs() + REPLAY_LEAD_NS;
+    (void)pthread_barrier_wait(&run.start);
+    for(int worker=0; worker<workers; worker++)
+    {
+        (void)pthread_join(ids[worker], NULL);
+    }
+    finished = nowNs();
+    (void)pthread_barrier_destroy(&run.start);
+
+    span = (trace.records > 1) ? ((double)queries[trace.records - 1].intended * 1e-9) : 0;
+    qsort(run.latency, trace.records, sizeof(double), compareDouble);
+    qsort(run.service, trace.records, sizeof(double), compareDouble);
+
+    (void)printf("%llu queries of %d features, %d worker(s), offered %.1f queries/s, achieved %.1f queries/s\n",
+                 (unsigned long long)trace.records, trace.dim, workers, (span > 0) ? ((double)(trace.records - 1) / span) : 0.0,
+                 (double)trace.records / ((double)(finished - run.origin) * 1e-9));
+    (void)printf("%-10s %12s %12s %12s %12s %12s\n", "ns", "p50", "p90", "p99", "p99.9", "max");
+    (void)printf("%-10s %12.0f %12.0f %12.0f %12.0f %12.0f\n", "latency", percentile(run.latency, trace.records, 0.50),
+                 percentile(run.latency, trace.records, 0.90), percentile(run.latency, trace.records, 0.99),
+                 percentile(run.latency, trace.records, 0.999), run.latency[trace.records - 1]);
+    (void)printf("%-10s %12.0f %12.0f %12.0f %12.0f %12.0f\n", "service", percentile(run.service, trace.records, 0.50),
+                 percentile(run.service, trace.records, 0.90), percentile(run.service, trace.records, 0.99),
+                 percentile(run.service, trace.records, 0.999), run.service[trace.records - 1]);
+    for(int id=0; id<=REPLAY_MAX_MODELS; id++)
+    {
+        if(perModel[id] != 0)
+        {
+            (void)printf("model %s%d: %llu queries\n", (id == REPLAY_MAX_MODELS) ? ">=" : "", id, (unsigned long long)perModel[id]);
+        }
+    }
+
+    if(jsonPath != NULL)
+    {
+        if((json = fopen(jsonPath, "w")) == NULL)
+        {
+            perror(jsonPath);
+            return 1;
+        }
+        (void)fprintf(json, "{\"benchmark\": \"dknn-replay\", \"queries\": %llu, \"dim\": %d, \"workers\": %d, \"speed\": %g, \"rate\": %g,"
+                            " \"offered_per_s\": %.1f, \"achieved_per_s\": %.1f,\n ",
+                      (unsigned long long)trace.records, trace.dim, workers, speed, rate,
+                      (span > 0) ? ((double)(trace.records - 1) / span) : 0.0, (double)trace.records / ((double)(finished - run.origin) * 1e-9));
+        writeDistribution(json, "latency", run.latency, trace.records);
+        (void)fprintf(json, ",\n ");
+        writeDistribution(json, "service", run.service, trace.records);
+        (void)fprintf(json, "}\n");
+        if(fclose(json) != 0)
+        {
+            return 1;
+        }
+    }
+
+    closeTraceFile(&trace);
+    free(queries);
+    free(run.latency);
+    free(run.service);
+    free(model.centers);
+    free(model.sqNorms);
+    free(model.DPs);
+
+    return 0;
+}
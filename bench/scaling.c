@@ -0,0 +1,555 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           scaling.c
+ * Date:                30th November 2023
+ *
+ * Description: Thread scaling and contention benchmark of the library "dknn.h" on Linux hosts. Runs
+                parallel classification and training over every combination of thread count,
+                pinning policy and batch size, and reports throughput, speedup and efficiency over
+                one thread, and the throughput of every thread. Training accumulates every batch
+                privately and merges it into one of three layouts of the center sums, and comparing
+                them exposes the two usual scaling limits:
+                private   sums of every thread padded to their own cache lines, the reference
+                packed    sums of all threads interleaved value by value, so every cache line holds
+                          the same value of neighbouring threads; slower than private only through
+                          false sharing
+                locked    one shared set of sums merged under a mutex after every batch, with the
+                          contended acquisitions and the time spent waiting for the lock
+                The results and the false sharing and lock contention findings are written as JSON
+                ready for plotting.
+ *
+ *              Build: cc -std=c99 -O2 -I. bench/scaling.c dknn.c -lm -lpthread -o dknn_scaling
+ *              Usage: dknn_scaling [--threads 1,2,4,8] [--pinning none,compact,scatter] [--batch 50,1024]
+ *                                  [--modes classify,private,packed,locked] [--batches 2000]
+ *                                  [--classes 4] [--dim 8] [--out scaling.json]
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dknn.h"
+
+#define SCALE_MAX_LIST          (32)
+#define SCALE_MAX_THREADS       (1024)
+#define SCALE_LINE              (64)        //cache line bytes, private sums start on their own line
+#define SCALE_ROWS              (1 << 18)   //rows of the synthetic data
+#define SCALE_FALSE_SHARING     (0.90)      //packed below this share of private throughput is reported
+#define SCALE_CONTENDED         (0.10)      //contended lock acquisitions above this share are reported
+#define SCALE_WAITING           (0.05)      //lock waiting above this share of thread time is reported
+
+enum scaleModeType {SCALE_CLASSIFY, SCALE_PRIVATE, SCALE_PACKED, SCALE_LOCKED, SCALE_MODES};
+enum scalePinningType {PIN_NONE, PIN_COMPACT, PIN_SCATTER, PIN_POLICIES};
+
+static const char *const modeNames[SCALE_MODES] = {"classify", "private", "packed", "locked"};
+static const char *const pinningNames[PIN_POLICIES] = {"none", "compact", "scatter"};
+
+typedef struct scaleListType
+{
+    int count;
+    int values[SCALE_MAX_LIST];
+} scaleList_t;
+
+typedef struct scaleRunType
+{
+    const colData_t *data;
+    const vecModel_t *model;
+    int mode;
+    int batch;
+    int batches;            //per thread
+    int threads;
+    float *packedSums;      //classes * dim * threads, thread-minor, packed mode
+    float *packedCounts;    //classes * threads, thread-minor, packed mode
+    float *sharedSums;      //classes * dim, locked mode
+    float *sharedCounts;    //classes, locked mode
+    pthread_mutex_t lock;
+    pthread_barrier_t start;
+} scaleRun_t;
+
+typedef struct scaleWorkType
+{
+    scaleRun_t *run;
+    int thread;
+    int cpu;                //-1 when not pinned
+    double seconds;
+    long acquisitions;
+    long contended;
+    double waitNs;
+} scaleWork_t;
+
+typedef struct scaleResultType
+{
+    int mode;
+    int pinning;
+    int batch;
+    int threads;
+    double pointsPerSecond;
+    double *threadPointsPerSecond;
+    long acquisitions;
+    long contended;
+    double waitShare;       //share of thread time spent waiting for the lock
+} scaleResult_t;
+
+volatile float scaleSink;
+
+static double nowNs(void)
+{
+    struct timespec now;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+static uint64_t scaleRandom = 0x9E3779B97F4A7C15ULL;
+
+static float uniform(void) //xorshift64*, [0, 1)
+{
+    scaleRandom ^= scaleRandom >> 12;
+    scaleRandom ^= scaleRandom << 25;
+    scaleRandom ^= scaleRandom >> 27;
+
+    return (float)((scaleRandom * 0x2545F4914F6CDD1DULL) >> 40) / (float)16777216.0;
+}
+
+static int parseList(const char *text, scaleList_t *list)
+{
+    char *end;
+
+    list->count = 0;
+    while((*text != '\0') && (list->count < SCALE_MAX_LIST))
+    {
+        long value = strtol(text, &end, 10);
+
+        if((end == text) || (value < 1))
+        {
+            return -1;
+        }
+        list->values[list->count++] = (int)value;
+        text = (*end == ',') ? (end + 1) : end;
+    }
+
+    return (list->count > 0) ? 0 : -1;
+}
+
+static int parseNames(const char *text, const char *const names[], int count, int selected[])
+{
+    int any = 0;
+
+    for(int index=0; index<count; index++)
+    {
+        size_t length = strlen(names[index]);
+        const char *found = strstr(text, names[index]);
+
+        selected[index] = (found != NULL) && ((found == text) || (found[-1] == ',')) && ((found[length] == ',') || (found[length] == '\0'));
+        any |= selected[index];
+    }
+
+    return any ? 0 : -1;
+}
+
+static int cpuFor(int pinning, int thread, int threads, const int cpus[], int cpuCount)
+{
+    int half = (cpuCount + 1) / 2;
+
+    (void)threads;
+    switch(pinning)
+    {
+        case PIN_COMPACT: return cpus[thread % cpuCount];
+        case PIN_SCATTER: return cpus[(((thread % 2) * half) + ((thread % cpuCount) / 2)) % cpuCount]; //alternate halves of the CPU list
+        default: return -1;
+    }
+}
+
+static void *scaleWorker(void *argument)
+{
+    scaleWork_t *work = argument;
+    scaleRun_t *run = work->run;
+    const vecModel_t *model = run->model;
+    int values = model->classes * model->dim;
+    size_t privateBytes = ((((size_t)(values + model->classes) * sizeof(float)) + SCALE_LINE - 1) / SCALE_LINE) * SCALE_LINE;
+    float *private = aligned_alloc(SCALE_LINE, privateBytes);
+    float *own = aligned_alloc(SCALE_LINE, privateBytes);
+    int *predicted = aligned_alloc(SCALE_LINE, ((((size_t)run->batch * sizeof(int)) + SCALE_LINE - 1) / SCALE_LINE) * SCALE_LINE);
+    float *sums = private;
+    float *counts = private + values;
+    int span = run->data->rows - run->batch + 1;
+    double start;
+
+    if(work->cpu >= 0)
+    {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(work->cpu, &set);
+        (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    (void)memset(private, 0, privateBytes);
+    (void)memset(own, 0, privateBytes);
+
+    (void)pthread_barrier_wait(&run->start);
+    start = nowNs();
+
+    for(int batch=0; batch<run->batches; batch++)
+    {
+        int first = (int)((((long long)batch * run->threads) + work->thread) * run->batch % span);
+
+        if(run->mode == SCALE_CLASSIFY)
+        {
+            classifyColumnBatch(run->data, first, run->batch, model, predicted);
+            continue;
+        }
+
+        (void)memset(private, 0, privateBytes); //batch sums are private, the merge target depends on the mode
+        accumulateColumnCenters(run->data, first, run->batch, model, sums, counts);
+
+        if(run->mode == SCALE_PRIVATE)
+        {
+            for(int index=0; index<(values + model->classes); index++)
+            {
+                own[index] += private[index];
+            }
+        }
+        else if(run->mode == SCALE_PACKED)
+        {
+            for(int index=0; index<values; index++)
+            {
+                run->packedSums[(index * run->threads) + work->thread] += sums[index];
+            }
+            for(int index=0; index<model->classes; index++)
+            {
+                run->packedCounts[(index * run->threads) + work->thread] += counts[index];
+            }
+        }
+        else
+        {
+            if(pthread_mutex_trylock(&run->lock) != 0)
+            {
+                double waitStart = nowNs();
+
+                (void)pthread_mutex_lock(&run->lock);
+                work->waitNs += nowNs() - waitStart;
+                work->contended++;
+            }
+            for(int index=0; index<values; index++)
+            {
+                run->sharedSums[index] += sums[index];
+            }
+            for(int index=0; index<model->classes; index++)
+            {
+                run->sharedCounts[index] += counts[index];
+            }
+            (void)pthread_mutex_unlock(&run->lock);
+            work->acquisitions++;
+        }
+    }
+
+    work->seconds = (nowNs() - start) * 1e-9;
+    scaleSink = (float)predicted[0] + sums[0] + own[0];
+
+    free(private);
+    free(own);
+    free(predicted);
+    releaseHotCounters(); //every run starts fresh threads
+
+    return NULL;
+}
+
+static void runScale(scaleRun_t *run, int pinning, const int cpus[], int cpuCount, scaleResult_t *result)
+{
+    int threads = run->threads;
+    int values = run->model->classes * run->model->dim;
+    pthread_t *ids = malloc((size_t)threads * sizeof(pthread_t));
+    scaleWork_t *work = calloc((size_t)threads, sizeof(scaleWork_t));
+    double begin;
+    double wall;
+    double busy = 0;
+
+    run->packedSums = calloc((size_t)threads * (size_t)values, sizeof(float));
+    run->packedCounts = calloc((size_t)threads * (size_t)run->model->classes, sizeof(float));
+    run->sharedSums = calloc((size_t)values, sizeof(float));
+    run->sharedCounts = calloc((size_t)run->model->classes, sizeof(float));
+    (void)pthread_mutex_init(&run->lock, NULL);
+    (void)pthread_barrier_init(&run->start, NULL, (unsigned)threads + 1);
+
+    for(int thread=0; thread<threads; thread++)
+    {
+        work[thread].run = run;
+        work[thread].thread = thread;
+        work[thread].cpu = cpuFor(pinning, thread, threads, cpus, cpuCount);
+        (void)pthread_create(&ids[thread], NULL, scaleWorker, &work[thread]);
+    }
+    begin = nowNs();
+    (void)pthread_barrier_wait(&run->start);
+    for(int thread=0; thread<threads; thread++)
+    {
+        (void)pthread_join(ids[thread], NULL);
+    }
+    wall = (nowNs() - begin) * 1e-9;
+
+    result->pointsPerSecond = (double)threads * (double)run->batches * (double)run->batch / wall;
+    result->threadPointsPerSecond = malloc((size_t)threads * sizeof(double));
+    result->acquisitions = 0;
+    result->contended = 0;
+    result->waitShare = 0;
+    for(int thread=0; thread<threads; thread++)
+    {
+        result->threadPointsPerSecond[thread] = (double)run->batches * (double)run->batch / work[thread].seconds;
+        result->acquisitions += work[thread].acquisitions;
+        result->contended += work[thread].contended;
+        result->waitShare += work[thread].waitNs * 1e-9;
+        busy += work[thread].seconds;
+    }
+    result->waitShare = (busy > 0) ? (result->waitShare / busy) : 0;
+
+    (void)pthread_barrier_destroy(&run->start);
+    (void)pthread_mutex_destroy(&run->lock);
+    free(run->packedSums);
+    free(run->packedCounts);
+    free(run->sharedSums);
+    free(run->sharedCounts);
+    free(ids);
+    free(work);
+}
+
+static void makeData(colData_t *data, vecModel_t *model, int classes, int dim)
+{
+    float *sums = calloc((size_t)(classes * dim), sizeof(float));
+    float *counts = calloc((size_t)classes, sizeof(float));
+
+    data->rows = SCALE_ROWS;
+    data->cols = dim;
+    data->stride = SCALE_ROWS;
+    data->columns = malloc((size_t)SCALE_ROWS * (size_t)dim * sizeof(float));
+    data->class = malloc((size_t)SCALE_ROWS * sizeof(int));
+    for(int row=0; row<SCALE_ROWS; row++)
+    {
+        data->class[row] = row % classes;
+        for(int feature=0; feature<dim; feature++)
+        {
+            data->columns[(feature * SCALE_ROWS) + row] = (float)(data->class[row] * 3) + uniform();
+        }
+    }
+
+    initVectorModel(model, classes, dim, malloc((size_t)(classes * dim) * sizeof(float)), malloc((size_t)classes * sizeof(float)), malloc((size_t)classes * sizeof(dilPar_t)));
+    accumulateColumnCenters(data, 0, SCALE_ROWS, model, sums, counts);
+    finalizeVectorCenters(model, sums, counts);
+    modifyColumnDilutionPars(data, 0, SCALE_ROWS, model);
+
+    free(sums);
+    free(counts);
+}
+
+static int compareInt(const void *one, const void *other)
+{
+    return *(const int *)one - *(const int *)other;
+}
+
+static const scaleResult_t *findResult(const scaleResult_t results[], int count, int mode, int pinning, int batch, int threads)
+{
+    for(int index=0; index<count; index++)
+    {
+        if((results[index].mode == mode) && (results[index].pinning == pinning) && (results[index].batch == batch) && (results[index].threads == threads))
+        {
+            return &results[index];
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    scaleList_t threadList = {0, {0}};
+    scaleList_t batchList = {2, {50, 1024}};
+    int modes[SCALE_MODES] = {1, 1, 1, 1};
+    int pinnings[PIN_POLICIES] = {1, 1, 1};
+    int batches = 2000;
+    int classes = 4;
+    int dim = 8;
+    const char *out = NULL;
+    int cpus[CPU_SETSIZE];
+    int cpuCount = 0;
+    cpu_set_t allowed;
+    colData_t data;
+    vecModel_t model;
+    scaleResult_t *results;
+    int resultCount = 0;
+    int findings = 0;
+    FILE *json;
+
+    CPU_ZERO(&allowed);
+    (void)sched_getaffinity(0, sizeof(allowed), &allowed);
+    for(int cpu=0; cpu<CPU_SETSIZE; cpu++)
+    {
+        if(CPU_ISSET(cpu, &allowed))
+        {
+            cpus[cpuCount++] = cpu;
+        }
+    }
+    for(int threads=1; (threads <= cpuCount) && (threadList.count < SCALE_MAX_LIST); threads*=2)
+    {
+        threadList.values[threadList.count++] = threads;
+    }
+    if(threadList.values[threadList.count - 1] != cpuCount)
+    {
+        threadList.values[threadList.count++] = cpuCount;
+    }
+
+    for(int index=1; index<argc; index+=2)
+    {
+        const char *value = (index + 1 < argc) ? argv[index + 1] : "";
+        int bad = 0;
+
+        if(strcmp(argv[index], "--threads") == 0)       bad = parseList(value, &threadList);
+        else if(strcmp(argv[index], "--batch") == 0)    bad = parseList(value, &batchList);
+        else if(strcmp(argv[index], "--modes") == 0)    bad = parseNames(value, modeNames, SCALE_MODES, modes);
+        else if(strcmp(argv[index], "--pinning") == 0)  bad = parseNames(value, pinningNames, PIN_POLICIES, pinnings);
+        else if(strcmp(argv[index], "--batches") == 0)  bad = ((batches = atoi(value)) < 1) ? -1 : 0;
+        else if(strcmp(argv[index], "--classes") == 0)  bad = ((classes = atoi(value)) < 1) ? -1 : 0;
+        else if(strcmp(argv[index], "--dim") == 0)      bad = ((dim = atoi(value)) < 1) ? -1 : 0;
+        else if(strcmp(argv[index], "--out") == 0)      out = value;
+        else bad = -1;
+
+        if(bad != 0)
+        {
+            (void)fprintf(stderr, "usage: %s [--threads 1,2,4,8] [--pinning none,compact,scatter] [--batch 50,1024]"
+                                  " [--modes classify,private,packed,locked] [--batches 2000] [--classes 4] [--dim 8] [--out scaling.json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if(threadList.values[0] != 1) //speedups are relative to one thread
+    {
+        threadList.values[threadList.count < SCALE_MAX_LIST ? threadList.count++ : (SCALE_MAX_LIST - 1)] = 1;
+    }
+    qsort(threadList.values, (size_t)threadList.count, sizeof(int), compareInt);
+    for(int index=0; index<batchList.count; index++)
+    {
+        if(batchList.values[index] > (SCALE_ROWS / 2))
+        {
+            (void)fprintf(stderr, "%s: batches up to %d rows\n", argv[0], SCALE_ROWS / 2);
+            return 2;
+        }
+    }
+    if(threadList.values[threadList.count - 1] > SCALE_MAX_THREADS)
+    {
+        (void)fprintf(stderr, "%s: at most %d threads\n", argv[0], SCALE_MAX_THREADS);
+        return 2;
+    }
+
+    makeData(&data, &model, classes, dim);
+    results = calloc((size_t)(SCALE_MODES * PIN_POLICIES * SCALE_MAX_LIST * SCALE_MAX_LIST), sizeof(scaleResult_t));
+
+    for(int mode=0; mode<SCALE_MODES; mode++)
+    {
+        for(int pinning=0; (modes[mode] != 0) && (pinning < PIN_POLICIES); pinning++)
+        {
+            for(int batchIndex=0; (pinnings[pinning] != 0) && (batchIndex < batchList.count); batchIndex++)
+            {
+                for(int threadIndex=0; threadIndex<threadList.count; threadIndex++)
+                {
+                    scaleRun_t run;
+                    scaleResult_t *result = &results[resultCount++];
+
+                    memset(&run, 0, sizeof(run));
+                    run.data = &data;
+                    run.model = &model;
+                    run.mode = mode;
+                    run.batch = batchList.values[batchIndex];
+                    run.batches = batches;
+                    run.threads = threadList.values[threadIndex];
+
+                    result->mode = mode;
+                    result->pinning = pinning;
+                    result->batch = run.batch;
+                    result->threads = run.threads;
+                    runScale(&run, pinning, cpus, cpuCount, result);
+
+                    (void)fprintf(stderr, "%-8s %-7s batch %5d threads %4d: %12.0f points/s\n", modeNames[mode], pinningNames[pinning],
+                                  run.batch, run.threads, result->pointsPerSecond);
+                }
+            }
+        }
+    }
+
+    json = (out != NULL) ? fopen(out, "w") : stdout;
+    if(json == NULL)
+    {
+        perror(out);
+        return 1;
+    }
+
+    (void)fprintf(json, "{\"benchmark\": \"dknn-scaling\", \"cpus\": %d, \"classes\": %d, \"dim\": %d, \"batches_per_thread\": %d,\n \"results\": [",
+                  cpuCount, classes, dim, batches);
+    for(int index=0; index<resultCount; index++)
+    {
+        const scaleResult_t *result = &results[index];
+        const scaleResult_t *single = findResult(results, resultCount, result->mode, result->pinning, result->batch, 1);
+        double speedup = result->pointsPerSecond / single->pointsPerSecond;
+
+        (void)fprintf(json, "%s\n  {\"mode\": \"%s\", \"pinning\": \"%s\", \"batch\": %d, \"threads\": %d, \"points_per_s\": %.1f,"
+                            " \"speedup\": %.4f, \"efficiency\": %.4f, \"lock_acquisitions\": %ld, \"lock_contended\": %ld,"
+                            " \"lock_wait_share\": %.4f, \"thread_points_per_s\": [",
+                      (index == 0) ? "" : ",", modeNames[result->mode], pinningNames[result->pinning], result->batch, result->threads,
+                      result->pointsPerSecond, speedup, speedup / (double)result->threads, result->acquisitions, result->contended, result->waitShare);
+        for(int thread=0; thread<result->threads; thread++)
+        {
+            (void)fprintf(json, "%s%.1f", (thread == 0) ? "" : ", ", result->threadPointsPerSecond[thread]);
+        }
+        (void)fprintf(json, "]}");
+    }
+
+    (void)fprintf(json, "\n ],\n \"findings\": [");
+    for(int index=0; index<resultCount; index++)
+    {
+        const scaleResult_t *result = &results[index];
+
+        if((result->mode == SCALE_PACKED) && (result->threads > 1))
+        {
+            const scaleResult_t *private = findResult(results, resultCount, SCALE_PRIVATE, result->pinning, result->batch, result->threads);
+            double ratio = (private != NULL) ? (result->pointsPerSecond / private->pointsPerSecond) : 1.0;
+
+            if(ratio < SCALE_FALSE_SHARING)
+            {
+                (void)fprintf(json, "%s\n  {\"type\": \"false_sharing\", \"pinning\": \"%s\", \"batch\": %d, \"threads\": %d, \"packed_over_private\": %.4f}",
+                              (findings++ == 0) ? "" : ",", pinningNames[result->pinning], result->batch, result->threads, ratio);
+            }
+        }
+        if((result->mode == SCALE_LOCKED) && (result->acquisitions > 0) &&
+           ((((double)result->contended / (double)result->acquisitions) > SCALE_CONTENDED) || (result->waitShare > SCALE_WAITING)))
+        {
+            (void)fprintf(json, "%s\n  {\"type\": \"lock_contention\", \"pinning\": \"%s\", \"batch\": %d, \"threads\": %d, \"contended_share\": %.4f, \"wait_share\": %.4f}",
+                          (findings++ == 0) ? "" : ",", pinningNames[result->pinning], result->batch, result->threads,
+                          (double)result->contended / (double)result->acquisitions, result->waitShare);
+        }
+    }
+    (void)fprintf(json, "\n ]}\n");
+
+    for(int index=0; index<resultCount; index++)
+    {
+        free(results[index].threadPointsPerSecond);
+    }
+    free(results);
+    free(data.columns);
+    free(data.class);
+    free(model.centers);
+    free(model.sqNorms);
+    free(model.DPs);
+
+    return ((out != NULL) && (fclose(json) != 0)) ? 1 : 0;
+}
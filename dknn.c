@@ -21,12 +21,159 @@
  */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "dknn.h"
+#include "dknn_probes.h"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 #define NUM_OF_CLASSES      (4)
 
+#if COUNTERS_ENABLED
+#if (COUNTERS_THREADS > 1) && defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
+#define COUNTERS_LOCAL      _Thread_local
+#elif (COUNTERS_THREADS > 1) && defined(__GNUC__)
+#define COUNTERS_LOCAL      __thread
+#endif
+
+typedef union counterSlotType //one or more whole cache lines, so threads never share a line
+{
+    hotCounters_t counters;
+    uint8_t line[(sizeof(hotCounters_t) + 63u) & ~(size_t)63u];
+} counterSlot_t;
+
+static counterSlot_t counterSlots[COUNTERS_THREADS];
+
+#if defined(COUNTERS_LOCAL)
+static int counterOwned[COUNTERS_THREADS];  //1 while a thread holds the slot, the last slot is shared
+static COUNTERS_LOCAL hotCounters_t *threadCounters;
+
+static hotCounters_t *localCounters(void) //the slot of the calling thread, claimed on first use
+{
+    for(int slot=0; (threadCounters == NULL) && (slot < (COUNTERS_THREADS - 1)); slot++)
+    {
+        int expected = 0;
+
+        if(__atomic_compare_exchange_n(&counterOwned[slot], &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            threadCounters = &counterSlots[slot].counters;
+        }
+    }
+    if(threadCounters == NULL) //every slot is held, count atomically on the shared one
+    {
+        threadCounters = &counterSlots[COUNTERS_THREADS - 1].counters;
+    }
+
+    return threadCounters;
+}
+
+static void countAdd(uint64_t *counter, uint64_t steps)
+{
+    if(threadCounters == &counterSlots[COUNTERS_THREADS - 1].counters)
+    {
+        (void)__atomic_fetch_add(counter, steps, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        *counter += steps;
+    }
+}
+#else
+#define localCounters()     (&counterSlots[0].counters)
+#define countAdd(counter, steps)            (*(counter) += (steps))
+#endif
+
+#define COUNT(field)                        countAdd(&localCounters()->field, 1u)
+#define COUNT_BY(field, steps)              countAdd(&localCounters()->field, (uint64_t)(steps))
+#define COUNT_CLASS(field, class)           do { if((unsigned)(class) < COUNTERS_CLASSES) { countAdd(&localCounters()->field[class], 1u); } } while(0)
+#define COUNT_CLASS_BY(field, class, steps) do { if((unsigned)(class) < COUNTERS_CLASSES) { countAdd(&localCounters()->field[class], (uint64_t)(steps)); } } while(0)
+#else
+#define COUNT(field)                        ((void)0)
+#define COUNT_BY(field, steps)              ((void)0)
+#define COUNT_CLASS(field, class)           ((void)0)
+#define COUNT_CLASS_BY(field, class, steps) ((void)0)
+#endif
+
+#if defined(__GNUC__) && defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+#define LOAD_ACQUIRE(value)                 __atomic_load_n(&(value), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(value, stored)        __atomic_store_n(&(value), (stored), __ATOMIC_RELEASE)
+#define CLAIM(value, expected, desired)     __atomic_compare_exchange_n(&(value), &(expected), (desired), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define FETCH_ADD(value, amount)            __atomic_fetch_add(&(value), (amount), __ATOMIC_RELAXED)
+#else //single-threaded targets, e.g. Cortex-M0 without atomic instructions
+#define LOAD_ACQUIRE(value)                 (value)
+#define STORE_RELEASE(value, stored)        ((value) = (stored))
+#define CLAIM(value, expected, desired)     (((value) == (expected)) ? (((value) = (desired)), 1) : (((expected) = (value)), 0))
+#define FETCH_ADD(value, amount)            (((value) += (amount)) - (amount))
+#endif
+
+typedef struct logSlotType
+{
+    uint32_t turn;              //sequence number of the slot minus its index, so zero-initialized slots are free
+    int severity;
+    char text[LOG_MESSAGE];
+} logSlot_t;
+
+typedef char logSlotsCheck_t[((LOG_SLOTS & (LOG_SLOTS - 1)) == 0) ? 1 : -1]; //does not compile unless LOG_SLOTS is a power of two
+
+#if LOG_SLOTS > 0
+static logSlot_t logRing[LOG_SLOTS];
+static uint32_t logHead;        //next message to write, shared by every producer
+static uint32_t logTail;        //next message to drain, one consumer at a time
+
+typedef char logRingBudgetCheck_t[((sizeof(staticModel_t) + sizeof(logRing)) <= MEMORY_BUDGET) ? 1 : -1]; //does not compile if the ring and the static model are over budget
+#endif
+
+#if LOG_TO_RING
+#define LOG_DEFAULT_SINK    ringLogSink
+#else
+static void printLogSink(int severity, const char *message, void *context) //default sink of hosted builds
+{
+    (void)severity;
+    (void)context;
+    (void)printf("%s\n", message);
+}
+
+#define LOG_DEFAULT_SINK    printLogSink
+#endif
+
+static uint32_t logDropped;
+static uint32_t logSampled;
+static uint32_t logEvery = 1;
+static int logLevel = LOG_INFO;
+static logSink_t logSink = LOG_DEFAULT_SINK;
+static void *logContext;
+
+static int logEnabled(int severity)
+{
+    return severity <= logLevel;
+}
+
+static int logSamplePoint(void) //1 for one data point in 'logEvery'
+{
+    return (logEvery <= 1) || ((FETCH_ADD(logSampled, 1u) % logEvery) == 0);
+}
+
+static void logMessage(int severity, const char *format, ...)
+{
+    va_list arguments;
+    char text[LOG_MESSAGE];
+
+    if(!logEnabled(severity))
+    {
+        return;
+    }
+
+    va_start(arguments, format);
+    (void)vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    logSink(severity, text, logContext);
+}
+
 /*int handledBatches[3] = {0, 0, 0}; //resting, training, and panic
 dilPar_t RDP, TDP, PDP; //dilution parameters of resting, training and panic cases.
 classCenter_t RC, TC, PC;*/
@@ -88,6 +235,9 @@ void initClassCenter(classCenter_t *class)
  *
  * @return Returns 1 if the batch is incomplete (a dataPoint is NULL), otherwise returns 0.
  *
+ * @note Short batches do not have to be dropped: setBatchCircleCenters takes the batch length,
+ *       and a batch assembler turns chunks of any size into batches without losing the tail.
+ *
  * @code
  *   // Example usage:
  *   dataPoint_t* batch = getDataBatch(); // Assuming 'dataPoint_t' represents a data batch.
@@ -102,7 +252,10 @@ int dropIncompleteBatch(dataPoint_t *dataPoint)
     int retVal;
 
     retVal = (dataPoint == NULL) ? 1 : 0;
-    (void)puts("INVALID BATCH FOUND ******************************");
+    if(retVal == 1)
+    {
+        logMessage(LOG_WARNING, "INVALID BATCH FOUND ******************************");
+    }
 
     return retVal;
 }
@@ -135,6 +288,32 @@ int dropIncompleteBatch(dataPoint_t *dataPoint)
 #define SPREAD_L      (0.0050)
 #define OVRCNF_H      (0.0500)
 #define OVRCNF_L      (0.2500)
+static void stepDilutionPars(dilPar_t DP[], int class, float distance) //same rule as below, for any class index
+{
+    if(distance > DP[class].overconfidence)
+    {
+        DP[class].spread += (float)SPREAD_H;
+        COUNT_CLASS(spreadUpdates, class);
+    }
+    else if(distance < DP[class].overconfidence)
+    {
+        DP[class].overconfidence += (float)OVRCNF_H;
+        COUNT_CLASS(overconfidenceUpdates, class);
+    }
+    else
+    {
+        //
+    }
+}
+
+static void stepDilutionParsBy(dilPar_t DP[], int class, float inside, float outside) //the rule above for many distances at once
+{
+    DP[class].spread += (float)SPREAD_H * outside;
+    DP[class].overconfidence += (float)OVRCNF_H * inside;
+    COUNT_CLASS_BY(spreadUpdates, class, outside + (float)0.5);
+    COUNT_CLASS_BY(overconfidenceUpdates, class, inside + (float)0.5);
+}
+
 void modifyDilutionPars(dilPar_t DP[], int class, float distance)
 {
     if(class == 0) //if resting pulse data
@@ -142,10 +321,12 @@ void modifyDilutionPars(dilPar_t DP[], int class, float distance)
         if(distance > DP[0].overconfidence)
         {
             DP[0].spread += (float)SPREAD_H;
+            COUNT_CLASS(spreadUpdates, 0);
         }
         else if(distance < DP[0].overconfidence)
         {
             DP[0].overconfidence += (float)OVRCNF_H;
+            COUNT_CLASS(overconfidenceUpdates, 0);
         }
         else
         {
@@ -157,10 +338,12 @@ void modifyDilutionPars(dilPar_t DP[], int class, float distance)
         if(distance > DP[1].overconfidence)
         {
             DP[1].spread += (float)SPREAD_H;
+            COUNT_CLASS(spreadUpdates, 1);
         }
         else if(distance < DP[1].overconfidence)
         {
             DP[1].overconfidence += (float)OVRCNF_H;
+            COUNT_CLASS(overconfidenceUpdates, 1);
         }
         else
         {
@@ -172,10 +355,12 @@ void modifyDilutionPars(dilPar_t DP[], int class, float distance)
         if(distance > DP[2].overconfidence)
         {
             DP[2].spread += (float)SPREAD_H;
+            COUNT_CLASS(spreadUpdates, 2);
         }
         else if(distance < DP[2].overconfidence)
         {
             DP[2].overconfidence += (float)OVRCNF_H;
+            COUNT_CLASS(overconfidenceUpdates, 2);
         }
         else
         {
@@ -192,6 +377,70 @@ void modifyDilutionPars(dilPar_t DP[], int class, float distance)
 #undef OVRCNF_H
 #undef OVRCNF_L
 
+static void mergeCircleCenters(const dataPoint_t dataPack[], int count, classCenter_t classCenter[], int *points[], float centerWeight[]) //running mean of each class, starting from 'centerWeight' points
+{
+    for(int loopVar=0; loopVar < count; loopVar++) //calculate center
+    {
+        int class = dataPack[loopVar].class;
+
+        if((class < 0) || (class > 2))
+        {
+            continue;
+        }
+
+        if(centerWeight[class] != 0)
+        {
+            classCenter[class].xCoord = ((centerWeight[class] * classCenter[class].xCoord) + dataPack[loopVar].xCoord) / (centerWeight[class] + 1);
+            classCenter[class].yCoord = ((centerWeight[class] * classCenter[class].yCoord) + dataPack[loopVar].yCoord) / (centerWeight[class] + 1);
+        }
+        else //if(centerWeight == 0)
+        {
+            classCenter[class].xCoord = dataPack[loopVar].xCoord;
+            classCenter[class].yCoord = dataPack[loopVar].yCoord;
+        }
+        centerWeight[class]++;
+
+        (*points[class])++;
+    }
+}
+
+/**
+ * @brief Set the center coordinates for different classes based on a batch of any length.
+ *
+ * This function is setCircleCenters for batches of 'count' data points, so the tail of a dataset
+ * or of a stream does not have to be padded or dropped. The batch is merged into the existing
+ * centers: every center stays the mean of all '*points[class]' points merged into it so far.
+ *
+ * @param dataPack    An array of 'count' 'dataPoint_t' structures representing data points.
+ * @param count       The number of data points in the batch.
+ * @param classCenter An array of 'classCenter_t' structures representing class centers.
+ * @param points      An array of integer pointers to the number of points merged into each class,
+ *                    zeroed before the first batch.
+ *
+ * @code
+ *   // Example usage:
+ *   int counts[3] = {0, 0, 0};
+ *   int *pointCounts[3] = {&counts[0], &counts[1], &counts[2]};
+ *   int tail = numPoints % BATCH_SIZE;
+ *   for(int first=0; first<(numPoints - tail); first+=BATCH_SIZE)
+ *   {
+ *       setBatchCircleCenters(&dataPoints[first], BATCH_SIZE, classCenters, pointCounts);
+ *   }
+ *   setBatchCircleCenters(&dataPoints[numPoints - tail], tail, classCenters, pointCounts);
+ *   // The centers are the means of all 'numPoints' data points.
+ * @endcode
+ */
+void setBatchCircleCenters(const dataPoint_t dataPack[], int count, classCenter_t classCenter[], int *points[])
+{
+    float centerWeight[3] = {(float)*points[0], (float)*points[1], (float)*points[2]}; //points merged so far
+
+    DKNN_PROBE1(train__batch__start, count);
+
+    mergeCircleCenters(dataPack, count, classCenter, points, centerWeight);
+
+    DKNN_PROBE1(train__batch__done, count);
+}
+
 /**
  * @brief Set the center coordinates for different classes based on data points.
  *
@@ -204,7 +453,7 @@ void modifyDilutionPars(dilPar_t DP[], int class, float distance)
  *
  * @note The function calculates the center coordinates for each class separately based on
  *       the provided data points. It updates the class center coordinates and increments
- *       the count of points in each class.
+ *       the count of points in each class. Use setBatchCircleCenters to merge batches instead.
  *
  * @code
  *   // Example usage:
@@ -217,87 +466,9 @@ void modifyDilutionPars(dilPar_t DP[], int class, float distance)
  */
 void setCircleCenters(dataPoint_t dataPack[], classCenter_t classCenter[], int *points[])
 {
-    float centerCoords[2] = {0, 0};
-    float centerWeight[3] = {0, 0, 0};
-
-
-    for(int loopVar=0; loopVar < BATCH_SIZE; loopVar++) //calculate center
-    {
-        if(dataPack[loopVar].class == 0)
-        {
-            if(centerWeight[0] != 0)
-            {
-                centerCoords[0] = ((centerWeight[0] * classCenter[0].xCoord) + dataPack[loopVar].xCoord) / (centerWeight[0] + 1);
-                centerCoords[1] = ((centerWeight[0] * classCenter[0].yCoord) + dataPack[loopVar].yCoord) / (centerWeight[0] + 1);
-                centerWeight[0]++;
-            }
-            else //if(centerWeight == 0)
-            {
-                centerCoords[0] = dataPack[loopVar].xCoord;
-                centerCoords[1] = dataPack[loopVar].yCoord;
-                centerWeight[0]++;
-            }
-
-            //assign center coords
-            classCenter[0].xCoord = centerCoords[0];
-            classCenter[0].yCoord = centerCoords[1];
-            //clean coordinate buffer
-            centerCoords[0] = 0;
-            centerCoords[1] = 0;
-
-            *points[0]++;
-        }
-
-        if(dataPack[loopVar].class == 1)
-        {
-            if(centerWeight[1] != 0)
-            {
-                centerCoords[0] = ((centerWeight[1] * classCenter[1].xCoord) + dataPack[loopVar].xCoord) / (centerWeight[1] + 1);
-                centerCoords[1] = ((centerWeight[1] * classCenter[1].yCoord) + dataPack[loopVar].yCoord) / (centerWeight[1] + 1);
-                centerWeight[1]++;
-            }
-            else //if(centerWeight == 0)
-            {
-                centerCoords[0] = dataPack[loopVar].xCoord;
-                centerCoords[1] = dataPack[loopVar].yCoord;
-                centerWeight[1]++;
-            }
-
-            //assign center coords
-            classCenter[1].xCoord = centerCoords[0];
-            classCenter[1].yCoord = centerCoords[1];
-            //clean coordinate buffer
-            centerCoords[0] = 0;
-            centerCoords[1] = 0;
-
-            *points[1]++;
-        }
-
-        if(dataPack[loopVar].class == 2)
-        {
-            if(centerWeight[2] != 0)
-            {
-                centerCoords[0] = ((centerWeight[2] * classCenter[2].xCoord) + dataPack[loopVar].xCoord) / (centerWeight[2] + 1);
-                centerCoords[1] = ((centerWeight[2] * classCenter[2].yCoord) + dataPack[loopVar].yCoord) / (centerWeight[2] + 1);
-                centerWeight[2]++;
-            }
-            else //if(centerWeight == 0)
-            {
-                centerCoords[0] = dataPack[loopVar].xCoord;
-                centerCoords[1] = dataPack[loopVar].yCoord;
-                centerWeight[2]++;
-            }
+    float centerWeight[3] = {0, 0, 0}; //every call replaces the centers
 
-            //assign center coords
-            classCenter[2].xCoord = centerCoords[0];
-            classCenter[2].yCoord = centerCoords[1];
-            //clean coordinate buffer
-            centerCoords[0] = 0;
-            centerCoords[1] = 0;
-
-            *points[2]++;
-        }
-    }
+    mergeCircleCenters(dataPack, BATCH_SIZE, classCenter, points, centerWeight);
 }
 
 /**
@@ -415,6 +586,9 @@ int checkOverConfidenceCircle(float distance, dilPar_t dilutionPars)
  *
  * @return The index of the class with the highest confidence for the input data point.
  *
+ * @note The decision is logged at LOG_INFO and the confidence of every class at LOG_DEBUG, for
+ *       one data point in the setLogSampling period, through the log sink (see setLogSink).
+ *
  * @code
  *   // Example usage:
  *   dataPoint_t myDataPoint; // Assuming 'dataPoint_t' represents a data point.
@@ -429,8 +603,13 @@ int classifyDataPoint(dataPoint_t *dataPoint, dilPar_t DPs[], classCenter_t CCs[
 {
     int retVal = 0;
     float maxConf = 0;
+    int sampled = logEnabled(LOG_INFO) && logSamplePoint();
 
-    (void)printf("results for test data at [%f, %f]:\n", dataPoint->xCoord, dataPoint->yCoord);
+    COUNT(pointsClassified);
+    if(sampled)
+    {
+        logMessage(LOG_DEBUG, "results for test data at [%f, %f]:", dataPoint->xCoord, dataPoint->yCoord);
+    }
 
     for(int index=0; index<argNum; index++)
     {
@@ -442,13 +621,18 @@ int classifyDataPoint(dataPoint_t *dataPoint, dilPar_t DPs[], classCenter_t CCs[
         if(checkOCC == 1)
         {
             indexResult = 1;
+            COUNT_CLASS(overconfidenceHits, index);
         }
         else
         {
             indexResult = baseFunction(distance, DPs[index]);
+            COUNT(baseFunctionCalls);
         }
 
-        (void)printf("class %d has confidence value of %f\n", index+1, indexResult);
+        if(sampled)
+        {
+            logMessage(LOG_DEBUG, "class %d has confidence value of %f", index+1, indexResult);
+        }
 
         if(index == 0)
         {
@@ -461,8 +645,3145 @@ int classifyDataPoint(dataPoint_t *dataPoint, dilPar_t DPs[], classCenter_t CCs[
             maxConf = (maxConf < indexResult) ? indexResult : maxConf;
         }
     }
-    (void)printf("input data belongs to class %d\tconfidence: %f\n", retVal, maxConf);
-    (void)puts(" ");
+    COUNT_CLASS(wins, retVal);
+    DKNN_PROBE2(classify__point, retVal, (int)(maxConf * (float)1000000.0));
+    if(sampled)
+    {
+        logMessage(LOG_INFO, "input data belongs to class %d\tconfidence: %f", retVal, maxConf);
+    }
 
     return retVal;
 }
+
+/**
+ * @brief Initialize a binary class center and its bit votes.
+ *
+ * This function clears every bit of the binary class center represented by the 'bitCenter_t'
+ * structure 'class', and resets the per-bit vote counters in 'votes' that are used to build
+ * the center by majority vote.
+ *
+ * @param class A pointer to the 'bitCenter_t' structure representing the class.
+ * @param votes A pointer to the 'bitVote_t' structure of the class, can be NULL.
+ *
+ * @note Passing NULL for 'votes' only clears the center, e.g. for inference-only builds.
+ *
+ * @code
+ *   // Example usage:
+ *   bitCenter_t class;
+ *   bitVote_t votes;
+ *   initBitCenter(&class, &votes);
+ *   // All bits of 'class' are now 0 and 'votes' holds no samples.
+ * @endcode
+ */
+void initBitCenter(bitCenter_t *class, bitVote_t *votes)
+{
+    for(int word=0; word<BIT_WORDS; word++)
+    {
+        class->bits[word] = 0;
+    }
+
+    if(votes != NULL)
+    {
+        for(int bit=0; bit<BIT_FEATURES; bit++)
+        {
+            votes->ones[bit] = 0;
+        }
+        votes->total = 0;
+    }
+}
+
+/**
+ * @brief Set the class prototypes of binary features based on a batch of any length.
+ *
+ * This function is setBitCircleCenters for batches of 'count' data points.
+ *
+ * @param dataPack    An array of 'count' 'bitPoint_t' structures representing data points.
+ * @param count       The number of data points in the batch.
+ * @param classCenter An array of 'bitCenter_t' structures representing class prototypes.
+ * @param votes       An array of 'bitVote_t' structures keeping the bit votes of each class.
+ * @param argNum      The number of classes.
+ *
+ * @code
+ *   // Example usage:
+ *   setBitBatchCenters(dataPoints, tail, classCenters, classVotes, 3);
+ * @endcode
+ */
+void setBitBatchCenters(const bitPoint_t dataPack[], int count, bitCenter_t classCenter[], bitVote_t votes[], int argNum)
+{
+    DKNN_PROBE1(train__batch__start, count);
+
+    for(int loopVar=0; loopVar < count; loopVar++) //accumulate bit votes
+    {
+        int class = dataPack[loopVar].class;
+
+        if((class < 0) || (class >= argNum))
+        {
+            continue;
+        }
+
+        for(int bit=0; bit<BIT_FEATURES; bit++)
+        {
+            votes[class].ones[bit] += (uint32_t)((dataPack[loopVar].bits[bit >> 6] >> (bit & 63)) & 1u);
+        }
+        votes[class].total++;
+    }
+
+    for(int class=0; class<argNum; class++) //majority vote per bit
+    {
+        if(votes[class].total == 0)
+        {
+            continue;
+        }
+
+        for(int word=0; word<BIT_WORDS; word++)
+        {
+            uint64_t bits = 0;
+
+            for(int bit=0; (bit < 64) && ((word * 64) + bit < BIT_FEATURES); bit++)
+            {
+                if((2u * votes[class].ones[(word * 64) + bit]) > votes[class].total)
+                {
+                    bits |= ((uint64_t)1 << bit);
+                }
+            }
+            classCenter[class].bits[word] = bits;
+        }
+    }
+
+    DKNN_PROBE1(train__batch__done, count);
+}
+
+/**
+ * @brief Set the binary prototypes of the classes based on a batch of bit-packed data points.
+ *
+ * This function adds the bits of every data point in the batch to the vote counters of its
+ * class, and then sets every bit of the class prototype to the majority value seen so far.
+ * The majority prototype is the bit vector with the smallest total Hamming distance to the
+ * samples of the class, which is the binary counterpart of the mean used by setCircleCenters.
+ *
+ * @param dataPack    An array of 'bitPoint_t' structures representing data points.
+ * @param classCenter An array of 'bitCenter_t' structures representing class prototypes.
+ * @param votes       An array of 'bitVote_t' structures keeping the bit votes of each class.
+ * @param argNum      The number of classes.
+ *
+ * @note Votes are kept across calls, so successive batches and epochs refine the same prototype.
+ *       Data points with a class outside [0, argNum) are ignored. Ties resolve to 0.
+ *
+ * @code
+ *   // Example usage:
+ *   bitPoint_t dataPoints[BATCH_SIZE]; // Assuming 'dataPoints' holds a batch of fingerprints.
+ *   bitCenter_t classCenters[3];
+ *   bitVote_t classVotes[3];
+ *   for(int i=0; i<3; i++) initBitCenter(&classCenters[i], &classVotes[i]);
+ *   setBitCircleCenters(dataPoints, classCenters, classVotes, 3);
+ *   // Calculate and set class prototypes based on data points...
+ * @endcode
+ */
+void setBitCircleCenters(bitPoint_t dataPack[], bitCenter_t classCenter[], bitVote_t votes[], int argNum)
+{
+    setBitBatchCenters(dataPack, BATCH_SIZE, classCenter, votes, argNum);
+}
+
+/**
+ * @brief Count the set bits of a 64-bit word.
+ *
+ * This function returns the population count of 'word'. It maps to the hardware popcount
+ * instruction when the compiler provides one, and to a branch-free SWAR sequence otherwise,
+ * so it stays usable on cores without a popcount instruction such as the Cortex-M0.
+ *
+ * @param word The word whose set bits are counted.
+ *
+ * @return The number of bits set in 'word'.
+ *
+ * @code
+ *   // Example usage:
+ *   int bits = popCount64(0xF0);
+ *   // 'bits' will be 4.
+ * @endcode
+ */
+int popCount64(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+
+    return (int)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/**
+ * @brief Calculate the Hamming distance between a bit-packed data point and a binary class center.
+ *
+ * This function counts the bits that differ between 'one' and 'classCenter'. The returned value
+ * plays the role of the Euclidean distance of calcDistance, so it can be handed directly to
+ * baseFunction and checkOverConfidenceCircle, with dilution parameters expressed in bits.
+ *
+ * @param one         A pointer to the 'bitPoint_t' structure representing a data point.
+ * @param classCenter A pointer to the 'bitCenter_t' structure representing a class prototype.
+ *
+ * @return The number of differing bits between the data point and the class prototype.
+ *
+ * @note When built with AVX-512 VPOPCNTDQ support, eight words are compared per instruction and
+ *       the remaining words are handled with a masked load, so no padding is required.
+ *
+ * @code
+ *   // Example usage:
+ *   bitPoint_t dataPoint; // Assuming 'dataPoint' holds a fingerprint.
+ *   bitCenter_t center; // Assuming 'center' holds a class prototype.
+ *   float distance = calcHammingDistance(&dataPoint, &center);
+ *   // Calculate the Hamming distance between 'dataPoint' and 'center'...
+ * @endcode
+ */
+float calcHammingDistance(const bitPoint_t *one, const bitCenter_t *classCenter)
+{
+    int distance = 0;
+    int word = 0;
+
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+    __m512i counts = _mm512_setzero_si512();
+
+    for(; (word + 8) <= BIT_WORDS; word += 8)
+    {
+        __m512i bitsOne = _mm512_loadu_si512((const void *)&one->bits[word]);
+        __m512i bitsCenter = _mm512_loadu_si512((const void *)&classCenter->bits[word]);
+
+        counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(_mm512_xor_si512(bitsOne, bitsCenter)));
+    }
+
+    if(word < BIT_WORDS)
+    {
+        __mmask8 tail = (__mmask8)((1u << (BIT_WORDS - word)) - 1u);
+        __m512i bitsOne = _mm512_maskz_loadu_epi64(tail, (const void *)&one->bits[word]);
+        __m512i bitsCenter = _mm512_maskz_loadu_epi64(tail, (const void *)&classCenter->bits[word]);
+
+        counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(_mm512_xor_si512(bitsOne, bitsCenter)));
+        word = BIT_WORDS;
+    }
+
+    distance = (int)_mm512_reduce_add_epi64(counts);
+#endif
+
+    for(; word<BIT_WORDS; word++)
+    {
+        distance += popCount64(one->bits[word] ^ classCenter->bits[word]);
+    }
+
+    return (float)distance;
+}
+
+/**
+ * @brief Classify a bit-packed data point using DkNN with Hamming distances.
+ *
+ * This function is the binary feature counterpart of classifyDataPoint. The confidence of a class
+ * is 1 inside its overconfidence circle and baseFunction of the Hamming distance outside of it,
+ * and the class with the highest confidence is returned.
+ *
+ * @param dataPoint A pointer to the 'bitPoint_t' structure representing the data point to classify.
+ * @param DPs       An array of 'dilPar_t' structures representing dilution parameters, in bits.
+ * @param CCs       An array of 'bitCenter_t' structures representing class prototypes.
+ * @param argNum    The number of classes to classify the data point into.
+ *
+ * @return The index of the class with the highest confidence for the input data point.
+ *
+ * @note Unlike classifyDataPoint, this function does not print per-class results, since it is
+ *       meant for high-throughput fingerprint inputs.
+ *
+ * @code
+ *   // Example usage:
+ *   bitPoint_t myDataPoint; // Assuming 'myDataPoint' holds a fingerprint.
+ *   dilPar_t dilutionParams[3]; // Array of dilution parameters for each class.
+ *   bitCenter_t classCenters[3]; // Array of class prototypes for each class.
+ *   int classIndex = classifyBitPoint(&myDataPoint, dilutionParams, classCenters, 3);
+ *   // Classify the data point and get the index of the class with the highest confidence...
+ * @endcode
+ */
+int classifyBitPoint(const bitPoint_t *dataPoint, dilPar_t DPs[], bitCenter_t CCs[], int argNum)
+{
+    int retVal = 0;
+    float maxConf = 0;
+
+    for(int index=0; index<argNum; index++)
+    {
+        float indexResult;
+        float distance = calcHammingDistance(dataPoint, &CCs[index]);
+
+        if(checkOverConfidenceCircle(distance, DPs[index]) == 1)
+        {
+            indexResult = 1;
+            COUNT_CLASS(overconfidenceHits, index);
+        }
+        else
+        {
+            indexResult = baseFunction(distance, DPs[index]);
+            COUNT(baseFunctionCalls);
+        }
+
+        if((index == 0) || (maxConf < indexResult))
+        {
+            maxConf = indexResult;
+            retVal = index;
+        }
+        if((maxConf >= (float)1.0) && ((index + 1) < argNum)) //no later class can beat full confidence
+        {
+            COUNT(earlyExits);
+            break;
+        }
+    }
+    COUNT(pointsClassified);
+    COUNT_CLASS(wins, retVal);
+    DKNN_PROBE2(classify__point, retVal, (int)(maxConf * (float)1000000.0));
+
+    return retVal;
+}
+
+/**
+ * @brief Initialize a vector model on caller-provided storage.
+ *
+ * This function binds the 'vecModel_t' structure 'model' to the caller-provided center, norm and
+ * dilution parameter arrays, sets every center to the origin and initializes the dilution
+ * parameters of each class with initDilutionParameters. The model never allocates memory.
+ * Distances are unweighted until setZScoreWeights or foldNormalization sets 'model->weights'.
+ *
+ * @param model   A pointer to the 'vecModel_t' structure to initialize.
+ * @param classes The number of classes.
+ * @param dim     The number of features of a data point.
+ * @param centers An array of at least 'classes' x 'dim' floats for the class centers.
+ * @param sqNorms An array of at least 'classes' floats for the squared center norms.
+ * @param DPs     An array of at least 'classes' 'dilPar_t' structures.
+ *
+ * @code
+ *   // Example usage:
+ *   float centers[3 * 1024], sqNorms[3];
+ *   dilPar_t DPs[3];
+ *   vecModel_t model;
+ *   initVectorModel(&model, 3, 1024, centers, sqNorms, DPs);
+ *   // 'model' now holds three 1024-dimensional centers at the origin.
+ * @endcode
+ */
+void initVectorModel(vecModel_t *model, int classes, int dim, float centers[], float sqNorms[], dilPar_t DPs[])
+{
+    model->classes = classes;
+    model->dim = dim;
+    model->centers = centers;
+    model->sqNorms = sqNorms;
+    model->DPs = DPs;
+    model->weights = NULL;
+
+    for(int index=0; index<(classes * dim); index++)
+    {
+        centers[index] = (float)0.0;
+    }
+
+    for(int class=0; class<classes; class++)
+    {
+        sqNorms[class] = (float)0.0;
+        initDilutionParameters(&DPs[class]);
+    }
+}
+
+/**
+ * @brief Recompute the squared norm of every class center.
+ *
+ * This function refreshes 'model->sqNorms' from 'model->centers' and 'model->weights'. The norms let sparse distances
+ * be computed from the nonzero features of a data point only, so they must be updated whenever
+ * the centers are changed by hand. finalizeVectorCenters calls this function itself.
+ *
+ * @param model A pointer to the 'vecModel_t' structure whose norms are updated.
+ *
+ * @code
+ *   // Example usage:
+ *   model.centers[0] = 2.0; // Modify a center by hand...
+ *   updateCenterNorms(&model);
+ *   // Sparse distances are consistent with the new centers again.
+ * @endcode
+ */
+void updateCenterNorms(vecModel_t *model)
+{
+    for(int class=0; class<model->classes; class++)
+    {
+        const float *center = &model->centers[class * model->dim];
+        float sqNorm = 0;
+
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            sqNorm += (model->weights != NULL) ? (model->weights[feature] * square(center[feature])) : square(center[feature]);
+        }
+        model->sqNorms[class] = sqNorm;
+    }
+}
+
+/**
+ * @brief Accumulate a batch of dense data points into per-class running sums.
+ *
+ * This function adds every row of 'dataPack' to the running sum of its class and increments the
+ * point count of that class. Exact class centers are obtained afterwards with finalizeVectorCenters,
+ * so the order in which batches are seen does not change the result.
+ *
+ * @param dataPack An array of 'rows' x 'model->dim' floats, row-major.
+ * @param class    An array of 'rows' class identifiers.
+ * @param rows     The number of data points in the batch.
+ * @param model    A pointer to the 'vecModel_t' structure giving the class count and dimension.
+ * @param sums     An array of 'model->classes' x 'model->dim' floats, zeroed before the first batch.
+ * @param counts   An array of 'model->classes' floats, zeroed before the first batch.
+ *
+ * @note Data points with a class outside [0, model->classes) are ignored.
+ *
+ * @code
+ *   // Example usage:
+ *   float sums[3 * 16] = {0}, counts[3] = {0};
+ *   accumulateVectorCenters(batch, batchClasses, BATCH_SIZE, &model, sums, counts);
+ *   finalizeVectorCenters(&model, sums, counts);
+ *   // The centers of 'model' are the means of the accumulated data points.
+ * @endcode
+ */
+void accumulateVectorCenters(const float dataPack[], const int class[], int rows, const vecModel_t *model, float sums[], float counts[])
+{
+    for(int row=0; row<rows; row++)
+    {
+        const float *point = &dataPack[row * model->dim];
+        float *sum;
+
+        if((class[row] < 0) || (class[row] >= model->classes))
+        {
+            continue;
+        }
+
+        sum = &sums[class[row] * model->dim];
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            sum[feature] += point[feature];
+        }
+        counts[class[row]] += 1;
+    }
+}
+
+/**
+ * @brief Accumulate a batch of sparse data points into per-class running sums.
+ *
+ * This function is the CSR counterpart of accumulateVectorCenters. Only the nonzero features of
+ * each row are visited, so the cost scales with the number of nonzeros instead of the dimension.
+ *
+ * @param dataPack A pointer to the 'csrMatrix_t' structure holding the batch and its classes.
+ * @param model    A pointer to the 'vecModel_t' structure giving the class count and dimension.
+ * @param sums     An array of 'model->classes' x 'model->dim' floats, zeroed before the first batch.
+ * @param counts   An array of 'model->classes' floats, zeroed before the first batch.
+ *
+ * @note 'dataPack->cols' must equal 'model->dim', and 'dataPack->class' must not be NULL.
+ *
+ * @code
+ *   // Example usage:
+ *   csrMatrix_t batch = {rows, 100000, rowPtr, colIdx, values, classes};
+ *   accumulateSparseCenters(&batch, &model, sums, counts);
+ *   finalizeVectorCenters(&model, sums, counts);
+ *   // The centers of 'model' are the means of the accumulated sparse data points.
+ * @endcode
+ */
+void accumulateSparseCenters(const csrMatrix_t *dataPack, const vecModel_t *model, float sums[], float counts[])
+{
+    for(int row=0; row<dataPack->rows; row++)
+    {
+        int class = dataPack->class[row];
+        float *sum;
+
+        if((class < 0) || (class >= model->classes))
+        {
+            continue;
+        }
+
+        sum = &sums[class * model->dim];
+        for(int nz=dataPack->rowPtr[row]; nz<dataPack->rowPtr[row + 1]; nz++)
+        {
+            sum[dataPack->colIdx[nz]] += dataPack->values[nz];
+        }
+        counts[class] += 1;
+    }
+}
+
+/**
+ * @brief Turn per-class running sums into class centers.
+ *
+ * This function divides the running sum of every class by its point count, stores the result as
+ * the class center and refreshes the squared center norms. Classes without points keep their
+ * previous center.
+ *
+ * @param model  A pointer to the 'vecModel_t' structure whose centers are set.
+ * @param sums   An array of 'model->classes' x 'model->dim' running sums.
+ * @param counts An array of 'model->classes' point counts.
+ *
+ * @code
+ *   // Example usage:
+ *   finalizeVectorCenters(&model, sums, counts);
+ *   // Every class with at least one point now has its mean as center.
+ * @endcode
+ */
+void finalizeVectorCenters(vecModel_t *model, const float sums[], const float counts[])
+{
+    for(int class=0; class<model->classes; class++)
+    {
+        float *center = &model->centers[class * model->dim];
+        const float *sum = &sums[class * model->dim];
+        float invCount;
+
+        if(counts[class] == 0)
+        {
+            continue;
+        }
+
+        invCount = (float)1.0 / counts[class];
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            center[feature] = sum[feature] * invCount;
+        }
+    }
+
+    updateCenterNorms(model);
+    DKNN_PROBE2(model__update, model->classes, model->dim);
+}
+
+/**
+ * @brief Calculate the Euclidean distance between a dense data point and a class center.
+ *
+ * This function is the 'model->dim' dimensional counterpart of calcDistance. When the model has
+ * per-dimension weights, every squared difference is scaled by the weight of its dimension.
+ *
+ * @param one   An array of 'model->dim' floats representing a data point.
+ * @param model A pointer to the 'vecModel_t' structure holding the class centers.
+ * @param class The index of the class center.
+ *
+ * @return The Euclidean distance between the data point and the class center.
+ *
+ * @code
+ *   // Example usage:
+ *   float distance = calcVectorDistance(point, &model, 1);
+ *   // Calculate the Euclidean distance between 'point' and the center of class 1...
+ * @endcode
+ */
+float calcVectorDistance(const float *one, const vecModel_t *model, int class)
+{
+    const float *center = &model->centers[class * model->dim];
+    float sqDistance = 0;
+
+    if(model->weights != NULL)
+    {
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            sqDistance += model->weights[feature] * square(one[feature] - center[feature]);
+        }
+    }
+    else
+    {
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            sqDistance += square(one[feature] - center[feature]);
+        }
+    }
+
+    return sqrtf(sqDistance);
+}
+
+/**
+ * @brief Calculate the Euclidean distance between a sparse data point and a class center.
+ *
+ * This function expands the squared distance as |c|^2 + sum over the nonzeros of x (x - 2c),
+ * using the precomputed squared norm of the center, so only the nonzero features of the row are
+ * visited. Per-dimension weights, when set, scale each term of the expansion. The result is the same as calcVectorDistance on the densified row.
+ *
+ * @param data  A pointer to the 'csrMatrix_t' structure holding the data point.
+ * @param row   The row of 'data' representing the data point.
+ * @param model A pointer to the 'vecModel_t' structure holding the class centers and norms.
+ * @param class The index of the class center.
+ *
+ * @return The Euclidean distance between the data point and the class center.
+ *
+ * @note Rounding can push the expanded squared distance slightly below zero, it is clamped to 0.
+ *
+ * @code
+ *   // Example usage:
+ *   float distance = calcSparseDistance(&queries, 0, &model, 1);
+ *   // Calculate the distance between the first query and the center of class 1...
+ * @endcode
+ */
+float calcSparseDistance(const csrMatrix_t *data, int row, const vecModel_t *model, int class)
+{
+    const float *center = &model->centers[class * model->dim];
+    float sqDistance = model->sqNorms[class];
+
+    for(int nz=data->rowPtr[row]; nz<data->rowPtr[row + 1]; nz++)
+    {
+        float value = data->values[nz];
+        float term = value * (value - ((float)2.0 * center[data->colIdx[nz]]));
+
+        sqDistance += (model->weights != NULL) ? (model->weights[data->colIdx[nz]] * term) : term;
+    }
+
+    return sqrtf((sqDistance > 0) ? sqDistance : 0);
+}
+
+/**
+ * @brief Modify the dilution parameters of a vector model based on a batch of dense data points.
+ *
+ * This function applies the modifyDilutionPars rule to every data point of the batch, using the
+ * distance of the point to the center of its own class, for any number of classes.
+ *
+ * @param dataPack An array of 'rows' x 'model->dim' floats, row-major.
+ * @param class    An array of 'rows' class identifiers.
+ * @param rows     The number of data points in the batch.
+ * @param model    A pointer to the 'vecModel_t' structure whose dilution parameters are modified.
+ *
+ * @code
+ *   // Example usage:
+ *   modifyVectorDilutionPars(batch, batchClasses, BATCH_SIZE, &model);
+ *   // The spread or overconfidence of each seen class has grown...
+ * @endcode
+ */
+void modifyVectorDilutionPars(const float dataPack[], const int class[], int rows, vecModel_t *model)
+{
+    for(int row=0; row<rows; row++)
+    {
+        if((class[row] < 0) || (class[row] >= model->classes))
+        {
+            continue;
+        }
+
+        stepDilutionPars(model->DPs, class[row], calcVectorDistance(&dataPack[row * model->dim], model, class[row]));
+    }
+}
+
+/**
+ * @brief Modify the dilution parameters of a vector model based on a batch of sparse data points.
+ *
+ * This function is the CSR counterpart of modifyVectorDilutionPars.
+ *
+ * @param dataPack A pointer to the 'csrMatrix_t' structure holding the batch and its classes.
+ * @param model    A pointer to the 'vecModel_t' structure whose dilution parameters are modified.
+ *
+ * @code
+ *   // Example usage:
+ *   modifySparseDilutionPars(&batch, &model);
+ *   // The spread or overconfidence of each seen class has grown...
+ * @endcode
+ */
+void modifySparseDilutionPars(const csrMatrix_t *dataPack, vecModel_t *model)
+{
+    for(int row=0; row<dataPack->rows; row++)
+    {
+        int class = dataPack->class[row];
+
+        if((class < 0) || (class >= model->classes))
+        {
+            continue;
+        }
+
+        stepDilutionPars(model->DPs, class, calcSparseDistance(dataPack, row, model, class));
+    }
+}
+
+static float classConfidence(float distance, const dilPar_t DPs[], int class)
+{
+    if(checkOverConfidenceCircle(distance, DPs[class]) == 1)
+    {
+        COUNT_CLASS(overconfidenceHits, class);
+        return (float)1.0;
+    }
+    COUNT(baseFunctionCalls);
+
+    return baseFunction(distance, DPs[class]);
+}
+
+/**
+ * @brief Classify a dense data point of any dimension using DkNN.
+ *
+ * This function is the 'model->dim' dimensional counterpart of classifyDataPoint.
+ *
+ * @param dataPoint An array of 'model->dim' floats representing the data point to classify.
+ * @param model     A pointer to the 'vecModel_t' structure holding centers and dilution parameters.
+ *
+ * @return The index of the class with the highest confidence for the input data point.
+ *
+ * @code
+ *   // Example usage:
+ *   int classIndex = classifyVectorPoint(point, &model);
+ *   // Classify the data point and get the index of the class with the highest confidence...
+ * @endcode
+ */
+int classifyVectorPoint(const float *dataPoint, const vecModel_t *model)
+{
+    int retVal = 0;
+    float maxConf = 0;
+
+    for(int index=0; index<model->classes; index++)
+    {
+        float indexResult = classConfidence(calcVectorDistance(dataPoint, model, index), model->DPs, index);
+
+        if((index == 0) || (maxConf < indexResult))
+        {
+            maxConf = indexResult;
+            retVal = index;
+        }
+        if((maxConf >= (float)1.0) && ((index + 1) < model->classes)) //no later class can beat full confidence
+        {
+            COUNT(earlyExits);
+            break;
+        }
+    }
+    COUNT(pointsClassified);
+    COUNT_CLASS(wins, retVal);
+    DKNN_PROBE2(classify__point, retVal, (int)(maxConf * (float)1000000.0));
+
+    return retVal;
+}
+
+/**
+ * @brief Classify a sparse data point using DkNN.
+ *
+ * This function is the CSR counterpart of classifyVectorPoint. Its cost scales with the number
+ * of nonzero features of the row times the number of classes.
+ *
+ * @param data  A pointer to the 'csrMatrix_t' structure holding the data point.
+ * @param row   The row of 'data' representing the data point to classify.
+ * @param model A pointer to the 'vecModel_t' structure holding centers, norms and dilution parameters.
+ *
+ * @return The index of the class with the highest confidence for the input data point.
+ *
+ * @code
+ *   // Example usage:
+ *   for(int row=0; row<queries.rows; row++)
+ *   {
+ *       predicted[row] = classifySparsePoint(&queries, row, &model);
+ *   }
+ * @endcode
+ */
+int classifySparsePoint(const csrMatrix_t *data, int row, const vecModel_t *model)
+{
+    int retVal = 0;
+    float maxConf = 0;
+
+    for(int index=0; index<model->classes; index++)
+    {
+        float indexResult = classConfidence(calcSparseDistance(data, row, model, index), model->DPs, index);
+
+        if((index == 0) || (maxConf < indexResult))
+        {
+            maxConf = indexResult;
+            retVal = index;
+        }
+        if((maxConf >= (float)1.0) && ((index + 1) < model->classes)) //no later class can beat full confidence
+        {
+            COUNT(earlyExits);
+            break;
+        }
+    }
+    COUNT(pointsClassified);
+    COUNT_CLASS(wins, retVal);
+    DKNN_PROBE2(classify__point, retVal, (int)(maxConf * (float)1000000.0));
+
+    return retVal;
+}
+
+static int projectionEntry(uint32_t seed, int input, int output) //0, +1 or -1 with probabilities 2/3, 1/6, 1/6
+{
+    uint32_t hash = seed ^ ((uint32_t)input * 0x9E3779B1u) ^ ((uint32_t)output * 0x85EBCA77u);
+
+    hash ^= hash >> 16;
+    hash *= 0x7FEB352Du;
+    hash ^= hash >> 15;
+    hash *= 0x846CA68Bu;
+    hash ^= hash >> 16;
+
+    hash %= 6u;
+
+    return (hash == 0u) ? 1 : ((hash == 1u) ? -1 : 0);
+}
+
+/**
+ * @brief Initialize a sparse random projection from a seed.
+ *
+ * This function builds the Achlioptas random projection that maps 'inDim' input features to
+ * 'outDim' projected features. Every entry of the projection matrix is +sqrt(3/outDim) or
+ * -sqrt(3/outDim) with probability 1/6 each and 0 otherwise, so distances are preserved up to a
+ * bounded distortion (Johnson-Lindenstrauss) and two thirds of the matrix is never touched.
+ * The matrix is stored column by column, so dense and sparse inputs both skip zero features.
+ *
+ * @param proj    A pointer to the 'projection_t' structure to initialize.
+ * @param seed    The seed the matrix is derived from.
+ * @param inDim   The number of input features.
+ * @param outDim  The number of projected features, at most PROJECTION_MAX_DIM.
+ * @param colPtr  An array of 'inDim' + 1 ints, or NULL to only count the entries.
+ * @param entries An array large enough for the returned entry count, or NULL to only count them.
+ *
+ * @return The number of nonzero entries of the matrix, or -1 if 'outDim' is out of range.
+ *
+ * @note The matrix is a pure function of 'seed', 'inDim' and 'outDim', so these three values are
+ *       all that has to be stored with a model to reproduce its projection.
+ *
+ * @code
+ *   // Example usage:
+ *   projection_t proj;
+ *   int count = initRandomProjection(&proj, 1234u, 4096, 32, NULL, NULL); // Count entries first.
+ *   int16_t *entries = malloc(count * sizeof(int16_t));
+ *   int *colPtr = malloc((4096 + 1) * sizeof(int));
+ *   (void)initRandomProjection(&proj, 1234u, 4096, 32, colPtr, entries);
+ *   // 'proj' now maps 4096 features to 32 features.
+ * @endcode
+ */
+int initRandomProjection(projection_t *proj, uint32_t seed, int inDim, int outDim, int colPtr[], int16_t entries[])
+{
+    int count = 0;
+
+    if((outDim <= 0) || (outDim > PROJECTION_MAX_DIM) || (inDim <= 0))
+    {
+        return -1;
+    }
+
+    proj->seed = seed;
+    proj->inDim = inDim;
+    proj->outDim = outDim;
+    proj->scale = sqrtf((float)3.0 / (float)outDim);
+    proj->colPtr = colPtr;
+    proj->entries = entries;
+
+    for(int input=0; input<inDim; input++)
+    {
+        if(colPtr != NULL)
+        {
+            colPtr[input] = count;
+        }
+
+        for(int output=0; output<outDim; output++)
+        {
+            int sign = projectionEntry(seed, input, output);
+
+            if(sign == 0)
+            {
+                continue;
+            }
+
+            if(entries != NULL)
+            {
+                entries[count] = (int16_t)((sign > 0) ? output : ~output);
+            }
+            count++;
+        }
+    }
+
+    if(colPtr != NULL)
+    {
+        colPtr[inDim] = count;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Project a batch of dense data points.
+ *
+ * This function multiplies every row of 'dataPack' with the projection matrix. Rows are processed
+ * in tiles of PROJECTION_TILE, so every matrix entry is read once per tile instead of once per
+ * row, and features that are zero in every row of a tile are skipped. The result can be handed to
+ * accumulateVectorCenters and modifyVectorDilutionPars to train a model of dimension 'proj->outDim'.
+ *
+ * @param dataPack  An array of 'rows' x 'proj->inDim' floats, row-major.
+ * @param rows      The number of data points in the batch.
+ * @param proj      A pointer to the 'projection_t' structure to apply.
+ * @param projected An array of 'rows' x 'proj->outDim' floats receiving the projected rows.
+ *
+ * @code
+ *   // Example usage:
+ *   float projected[BATCH_SIZE * 32];
+ *   projectVectorBatch(batch, BATCH_SIZE, &proj, projected);
+ *   accumulateVectorCenters(projected, batchClasses, BATCH_SIZE, &model, sums, counts);
+ * @endcode
+ */
+void projectVectorBatch(const float dataPack[], int rows, const projection_t *proj, float projected[])
+{
+    for(int first=0; first<rows; first+=PROJECTION_TILE)
+    {
+        int tile = ((rows - first) < PROJECTION_TILE) ? (rows - first) : PROJECTION_TILE;
+        const float *tileRows = &dataPack[first * proj->inDim];
+        float *tileOut = &projected[first * proj->outDim];
+
+        for(int index=0; index<(tile * proj->outDim); index++)
+        {
+            tileOut[index] = 0;
+        }
+
+        for(int input=0; input<proj->inDim; input++)
+        {
+            int nonzero = 0;
+
+            for(int row=0; (row<tile) && !nonzero; row++) //a feature that is zero in the whole tile adds nothing
+            {
+                nonzero = (tileRows[(row * proj->inDim) + input] != 0);
+            }
+            if(!nonzero)
+            {
+                continue;
+            }
+
+            for(int entry=proj->colPtr[input]; entry<proj->colPtr[input + 1]; entry++)
+            {
+                int output = proj->entries[entry];
+
+                if(output >= 0)
+                {
+                    for(int row=0; row<tile; row++)
+                    {
+                        tileOut[(row * proj->outDim) + output] += tileRows[(row * proj->inDim) + input];
+                    }
+                }
+                else
+                {
+                    for(int row=0; row<tile; row++)
+                    {
+                        tileOut[(row * proj->outDim) + ~output] -= tileRows[(row * proj->inDim) + input];
+                    }
+                }
+            }
+        }
+
+        for(int index=0; index<(tile * proj->outDim); index++)
+        {
+            tileOut[index] *= proj->scale;
+        }
+    }
+}
+
+/**
+ * @brief Project a sparse data point.
+ *
+ * This function is the CSR counterpart of projectVectorBatch for a single row. Only the matrix
+ * columns of the nonzero features of the row are visited.
+ *
+ * @param data      A pointer to the 'csrMatrix_t' structure holding the data point.
+ * @param row       The row of 'data' representing the data point.
+ * @param proj      A pointer to the 'projection_t' structure to apply.
+ * @param projected An array of 'proj->outDim' floats receiving the projected data point.
+ *
+ * @code
+ *   // Example usage:
+ *   float projected[32];
+ *   projectSparsePoint(&queries, 0, &proj, projected);
+ *   int classIndex = classifyVectorPoint(projected, &model);
+ * @endcode
+ */
+void projectSparsePoint(const csrMatrix_t *data, int row, const projection_t *proj, float projected[])
+{
+    for(int output=0; output<proj->outDim; output++)
+    {
+        projected[output] = 0;
+    }
+
+    for(int nz=data->rowPtr[row]; nz<data->rowPtr[row + 1]; nz++)
+    {
+        int input = data->colIdx[nz];
+        float value = data->values[nz] * proj->scale;
+
+        for(int entry=proj->colPtr[input]; entry<proj->colPtr[input + 1]; entry++)
+        {
+            int output = proj->entries[entry];
+
+            if(output >= 0)
+            {
+                projected[output] += value;
+            }
+            else
+            {
+                projected[~output] -= value;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Project and classify a batch of dense data points.
+ *
+ * This function fuses projectVectorBatch and classifyVectorPoint. Each tile of PROJECTION_TILE
+ * rows is projected into a small buffer on the stack and classified right away, so the
+ * projected batch is never written to memory and the caller needs no scratch buffer.
+ *
+ * @param dataPack  An array of 'rows' x 'proj->inDim' floats, row-major.
+ * @param rows      The number of data points in the batch.
+ * @param proj      A pointer to the 'projection_t' structure to apply.
+ * @param model     A pointer to the 'vecModel_t' structure trained on projected data points.
+ * @param predicted An array of 'rows' ints receiving the class of each data point.
+ *
+ * @note 'model->dim' must equal 'proj->outDim'.
+ *
+ * @code
+ *   // Example usage:
+ *   int predicted[BATCH_SIZE];
+ *   classifyProjectedBatch(queries, BATCH_SIZE, &proj, &model, predicted);
+ * @endcode
+ */
+void classifyProjectedBatch(const float dataPack[], int rows, const projection_t *proj, const vecModel_t *model, int predicted[])
+{
+    float projected[PROJECTION_TILE * PROJECTION_MAX_DIM];
+
+    DKNN_PROBE1(classify__projected__start, rows);
+
+    for(int first=0; first<rows; first+=PROJECTION_TILE)
+    {
+        int tile = ((rows - first) < PROJECTION_TILE) ? (rows - first) : PROJECTION_TILE;
+
+        projectVectorBatch(&dataPack[first * proj->inDim], tile, proj, projected);
+
+        for(int row=0; row<tile; row++)
+        {
+            predicted[first + row] = classifyVectorPoint(&projected[row * proj->outDim], model);
+        }
+    }
+
+    DKNN_PROBE1(classify__projected__done, rows);
+}
+
+/**
+ * @brief Accumulate per-feature means and squared deviations of a batch of dense data points.
+ *
+ * This function collects the moments needed by setZScoreWeights. It can run in the same pass
+ * over the raw training data as accumulateVectorCenters, so no separate normalization pass
+ * is needed. The moments are updated point by point in double precision (Welford), so features
+ * with a large mean and a small spread keep their variance instead of cancelling it out.
+ *
+ * @param dataPack An array of 'rows' x 'dim' floats, row-major.
+ * @param rows     The number of data points in the batch.
+ * @param dim      The number of features of a data point.
+ * @param means    An array of 'dim' doubles, zeroed before the first batch.
+ * @param sqDevs   An array of 'dim' doubles, zeroed before the first batch.
+ * @param count    A pointer to the number of data points accumulated, zeroed before the first batch.
+ *
+ * @code
+ *   // Example usage:
+ *   accumulateFeatureMoments(batch, BATCH_SIZE, 16, featureMeans, featureSqDevs, &featureCount);
+ *   accumulateVectorCenters(batch, batchClasses, BATCH_SIZE, &model, sums, counts);
+ *   // Both moments and centers are collected from the raw batch.
+ * @endcode
+ */
+void accumulateFeatureMoments(const float dataPack[], int rows, int dim, double means[], double sqDevs[], double *count)
+{
+    for(int row=0; row<rows; row++)
+    {
+        const float *point = &dataPack[row * dim];
+        double invCount;
+
+        *count += 1;
+        invCount = 1.0 / *count;
+        for(int feature=0; feature<dim; feature++)
+        {
+            double delta = (double)point[feature] - means[feature];
+
+            means[feature] += delta * invCount;
+            sqDevs[feature] += delta * ((double)point[feature] - means[feature]);
+        }
+    }
+}
+
+/**
+ * @brief Set z-score distance weights of a model from accumulated feature moments.
+ *
+ * This function sets the weight of every dimension to 1/variance, so distances between raw
+ * data points and raw-space centers equal the distances between their z-scored counterparts.
+ * The offsets of the z-score cancel out in the difference, so raw data points can be
+ * classified directly, without normalizing them first.
+ *
+ * @param model   A pointer to the 'vecModel_t' structure whose weights are set.
+ * @param weights An array of 'model->dim' floats that becomes 'model->weights'.
+ * @param sqDevs  An array of 'model->dim' squared deviation sums from accumulateFeatureMoments.
+ * @param count   The number of data points accumulated.
+ *
+ * @note Only features that never changed (zero squared deviations) get a weight of 0. Any other
+ *       variance is clamped to ZSCORE_MIN_VARIANCE, so its weight stays finite. The squared
+ *       center norms are refreshed, since they depend on the weights.
+ *
+ * @code
+ *   // Example usage:
+ *   float weights[16];
+ *   finalizeVectorCenters(&model, sums, counts);
+ *   setZScoreWeights(&model, weights, featureSqDevs, featureCount);
+ *   int classIndex = classifyVectorPoint(rawPoint, &model);
+ * @endcode
+ */
+void setZScoreWeights(vecModel_t *model, float weights[], const double sqDevs[], double count)
+{
+    for(int feature=0; feature<model->dim; feature++)
+    {
+        double variance = sqDevs[feature] / count;
+
+        if(sqDevs[feature] <= 0)
+        {
+            weights[feature] = (float)0.0;
+        }
+        else
+        {
+            weights[feature] = (float)(1.0 / ((variance > ZSCORE_MIN_VARIANCE) ? variance : ZSCORE_MIN_VARIANCE));
+        }
+    }
+
+    model->weights = weights;
+    updateCenterNorms(model);
+}
+
+/**
+ * @brief Fold a per-dimension normalization into the centers and distance weights of a model.
+ *
+ * This function converts a model trained on normalized data points, (raw - offset) * scale, into
+ * a model that classifies raw data points with identical results. Every center is mapped back to
+ * raw space as offset + center / scale, and the weight of every dimension becomes scale^2.
+ *
+ * @param model   A pointer to the 'vecModel_t' structure trained on normalized data points.
+ * @param offset  An array of 'model->dim' offsets, e.g. the feature means.
+ * @param scale   An array of 'model->dim' scales, e.g. the inverse feature standard deviations.
+ * @param weights An array of 'model->dim' floats that becomes 'model->weights'.
+ *
+ * @note Dimensions with a scale of 0 get the offset as center and a weight of 0.
+ *
+ * @code
+ *   // Example usage:
+ *   float weights[16];
+ *   foldNormalization(&model, means, invStdDevs, weights);
+ *   int classIndex = classifyVectorPoint(rawPoint, &model); // No z-scoring pass needed.
+ * @endcode
+ */
+void foldNormalization(vecModel_t *model, const float offset[], const float scale[], float weights[])
+{
+    for(int class=0; class<model->classes; class++)
+    {
+        float *center = &model->centers[class * model->dim];
+
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            center[feature] = (scale[feature] != 0) ? (offset[feature] + (center[feature] / scale[feature])) : offset[feature];
+        }
+    }
+
+    for(int feature=0; feature<model->dim; feature++)
+    {
+        weights[feature] = square(scale[feature]);
+    }
+
+    model->weights = weights;
+    updateCenterNorms(model);
+}
+
+/**
+ * @brief Accumulate a range of columnar data points into per-class running sums.
+ *
+ * This function is the columnar (SoA) counterpart of accumulateVectorCenters. Each feature column
+ * is streamed once from 'first' to 'first' + 'rows', so the batch is read sequentially.
+ *
+ * @param dataPack A pointer to the 'colData_t' structure holding the data points and their classes.
+ * @param first    The first row of the range.
+ * @param rows     The number of rows in the range.
+ * @param model    A pointer to the 'vecModel_t' structure giving the class count and dimension.
+ * @param sums     An array of 'model->classes' x 'model->dim' floats, zeroed before the first batch.
+ * @param counts   An array of 'model->classes' floats, zeroed before the first batch.
+ *
+ * @note 'dataPack->cols' must equal 'model->dim', and 'dataPack->class' must not be NULL.
+ *
+ * @code
+ *   // Example usage:
+ *   for(int first=0; first<data.rows; first+=BATCH_SIZE)
+ *   {
+ *       int rows = (data.rows - first < BATCH_SIZE) ? (data.rows - first) : BATCH_SIZE;
+ *       accumulateColumnCenters(&data, first, rows, &model, sums, counts);
+ *   }
+ *   finalizeVectorCenters(&model, sums, counts);
+ * @endcode
+ */
+void accumulateColumnCenters(const colData_t *dataPack, int first, int rows, const vecModel_t *model, float sums[], float counts[])
+{
+    const int *class = &dataPack->class[first];
+
+    DKNN_PROBE1(train__batch__start, rows);
+
+    for(int feature=0; feature<model->dim; feature++)
+    {
+        const float *column = &dataPack->columns[(feature * dataPack->stride) + first];
+
+        for(int row=0; row<rows; row++)
+        {
+            if((class[row] >= 0) && (class[row] < model->classes))
+            {
+                sums[(class[row] * model->dim) + feature] += column[row];
+            }
+        }
+    }
+
+    for(int row=0; row<rows; row++)
+    {
+        if((class[row] >= 0) && (class[row] < model->classes))
+        {
+            counts[class[row]] += 1;
+        }
+    }
+
+    DKNN_PROBE1(train__batch__done, rows);
+}
+
+static void ownClassSqDistances(const colData_t *dataPack, int first, int tile, const vecModel_t *model, float sqDistance[])
+{
+    const int *class = &dataPack->class[first];
+
+    for(int row=0; row<tile; row++)
+    {
+        sqDistance[row] = 0;
+    }
+
+    for(int feature=0; feature<model->dim; feature++)
+    {
+        const float *column = &dataPack->columns[(feature * dataPack->stride) + first];
+        float weight = (model->weights != NULL) ? model->weights[feature] : (float)1.0;
+
+        for(int row=0; row<tile; row++)
+        {
+            if((class[row] >= 0) && (class[row] < model->classes))
+            {
+                sqDistance[row] += weight * square(column[row] - model->centers[(class[row] * model->dim) + feature]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Modify the dilution parameters of a vector model based on a range of columnar data points.
+ *
+ * This function is the columnar (SoA) counterpart of modifyVectorDilutionPars. Distances of a tile
+ * of COLUMN_TILE rows to their own class centers are accumulated column by column first, and the
+ * modifyDilutionPars rule is then applied in row order, which gives the same result as the
+ * row-by-row version since distances do not depend on the dilution parameters.
+ *
+ * @param dataPack A pointer to the 'colData_t' structure holding the data points and their classes.
+ * @param first    The first row of the range.
+ * @param rows     The number of rows in the range.
+ * @param model    A pointer to the 'vecModel_t' structure whose dilution parameters are modified.
+ *
+ * @code
+ *   // Example usage:
+ *   modifyColumnDilutionPars(&data, 0, data.rows, &model);
+ *   // The spread or overconfidence of each seen class has grown...
+ * @endcode
+ */
+void modifyColumnDilutionPars(const colData_t *dataPack, int first, int rows, vecModel_t *model)
+{
+    float sqDistance[COLUMN_TILE];
+
+    DKNN_PROBE1(train__batch__start, rows);
+
+    for(int start=0; start<rows; start+=COLUMN_TILE)
+    {
+        int tile = ((rows - start) < COLUMN_TILE) ? (rows - start) : COLUMN_TILE;
+        const int *class = &dataPack->class[first + start];
+
+        ownClassSqDistances(dataPack, first + start, tile, model, sqDistance);
+
+        for(int row=0; row<tile; row++)
+        {
+            if((class[row] >= 0) && (class[row] < model->classes))
+            {
+                stepDilutionPars(model->DPs, class[row], sqrtf(sqDistance[row]));
+            }
+        }
+    }
+
+    DKNN_PROBE1(train__batch__done, rows);
+}
+
+static void addColumnSqDistances(const float column[], float center, float weight, int tile, float sqDistance[]) //sqDistance[row] += weight * (column[row] - center)^2
+{
+    int row = 0;
+
+#if defined(__AVX512F__)
+    __m512 centers = _mm512_set1_ps(center);
+    __m512 weights = _mm512_set1_ps(weight);
+
+    for(; (row + 16) <= tile; row += 16)
+    {
+        __m512 difference = _mm512_sub_ps(_mm512_loadu_ps(&column[row]), centers);
+        __m512 sum = _mm512_add_ps(_mm512_loadu_ps(&sqDistance[row]), _mm512_mul_ps(weights, _mm512_mul_ps(difference, difference)));
+
+        _mm512_storeu_ps(&sqDistance[row], sum);
+    }
+
+    if(row < tile) //masked tail, rows past the batch are neither read nor written
+    {
+        __mmask16 tail = (__mmask16)((1u << (tile - row)) - 1u);
+        __m512 difference = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, &column[row]), centers);
+        __m512 sum = _mm512_add_ps(_mm512_maskz_loadu_ps(tail, &sqDistance[row]), _mm512_mul_ps(weights, _mm512_mul_ps(difference, difference)));
+
+        _mm512_mask_storeu_ps(&sqDistance[row], tail, sum);
+        row = tile;
+    }
+#endif
+
+    for(; row<tile; row++)
+    {
+        sqDistance[row] += weight * square(column[row] - center);
+    }
+}
+
+/**
+ * @brief Classify a range of columnar data points using DkNN.
+ *
+ * This function is the columnar (SoA) counterpart of classifyVectorPoint. Rows are processed in
+ * tiles of COLUMN_TILE: for every class, distances of the whole tile are accumulated feature by
+ * feature over contiguous column slices, with AVX-512 when available. 'rows' can be any number,
+ * the last partial vector of a tile is handled with masked loads and stores.
+ *
+ * @param data      A pointer to the 'colData_t' structure holding the data points.
+ * @param first     The first row of the range.
+ * @param rows      The number of rows in the range.
+ * @param model     A pointer to the 'vecModel_t' structure holding centers and dilution parameters.
+ * @param predicted An array of 'rows' ints receiving the class of each data point.
+ *
+ * @code
+ *   // Example usage:
+ *   classifyColumnBatch(&queries, 0, queries.rows, &model, predicted);
+ * @endcode
+ */
+void classifyColumnBatch(const colData_t *data, int first, int rows, const vecModel_t *model, int predicted[])
+{
+    float sqDistance[COLUMN_TILE];
+    float maxConf[COLUMN_TILE];
+
+    DKNN_PROBE2(classify__batch__start, first, rows);
+
+    for(int start=0; start<rows; start+=COLUMN_TILE)
+    {
+        int tile = ((rows - start) < COLUMN_TILE) ? (rows - start) : COLUMN_TILE;
+
+        for(int index=0; index<model->classes; index++)
+        {
+            const float *center = &model->centers[index * model->dim];
+
+            for(int row=0; row<tile; row++)
+            {
+                sqDistance[row] = 0;
+            }
+
+            for(int feature=0; feature<model->dim; feature++)
+            {
+                const float *column = &data->columns[(feature * data->stride) + first + start];
+                float weight = (model->weights != NULL) ? model->weights[feature] : (float)1.0;
+
+                addColumnSqDistances(column, center[feature], weight, tile, sqDistance);
+            }
+
+            for(int row=0; row<tile; row++)
+            {
+                float indexResult = classConfidence(sqrtf(sqDistance[row]), model->DPs, index);
+
+                if((index == 0) || (maxConf[row] < indexResult))
+                {
+                    maxConf[row] = indexResult;
+                    predicted[start + row] = index;
+                }
+            }
+        }
+
+        COUNT_BY(pointsClassified, tile);
+        for(int row=0; row<tile; row++)
+        {
+            COUNT_CLASS(wins, predicted[start + row]);
+        }
+    }
+
+    DKNN_PROBE1(classify__batch__done, rows);
+}
+
+/**
+ * @brief Initialize a streaming trainer on caller-provided storage.
+ *
+ * This function prepares two-pass training of 'model' for data that does not fit in memory. The
+ * first pass computes exact class centers from running sums, the second pass summarizes the
+ * distance of every point to its own center in a MAP_RESOLUTION bin histogram per class, from
+ * which the dilution parameters of EPOCH epochs are estimated without reading the data again.
+ * Running sums and counts are kept in double precision, so they stay exact far beyond 2^24 points.
+ *
+ * @param trainer   A pointer to the 'streamTrainer_t' structure to initialize.
+ * @param model     A pointer to an initialized 'vecModel_t' structure to train.
+ * @param workspace An array of STREAM_TRAINER_DOUBLES(model->classes, model->dim) doubles.
+ *
+ * @code
+ *   // Example usage:
+ *   static double workspace[STREAM_TRAINER_DOUBLES(3, 16)];
+ *   streamTrainer_t trainer;
+ *   initStreamTrainer(&trainer, &model, workspace);
+ *   // Feed every batch to streamCenterPass, then finishCenterPass, then the same for the dilution pass.
+ * @endcode
+ */
+void initStreamTrainer(streamTrainer_t *trainer, vecModel_t *model, double workspace[])
+{
+    int classes = model->classes;
+    int dim = model->dim;
+
+    trainer->model = model;
+    trainer->sums = workspace;
+    trainer->counts = trainer->sums + (classes * dim);
+    trainer->lower = trainer->counts + classes;
+    trainer->upper = trainer->lower + (classes * dim);
+    trainer->maxDistance = trainer->upper + (classes * dim);
+    trainer->histogram = trainer->maxDistance + classes;
+
+    for(int index=0; index<STREAM_TRAINER_DOUBLES(classes, dim); index++)
+    {
+        workspace[index] = 0;
+    }
+    for(int index=0; index<(classes * dim); index++)
+    {
+        trainer->lower[index] = HUGE_VAL;
+        trainer->upper[index] = -HUGE_VAL;
+    }
+}
+
+static int rowIsComplete(const colData_t *batch, int row, int dim) //a row with a missing (NaN) feature is left out of training
+{
+    for(int feature=0; feature<dim; feature++)
+    {
+        if(isnan(batch->columns[(feature * batch->stride) + row]))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Feed a batch to the center pass of a streaming trainer.
+ *
+ * This function adds the batch to the running sums, counts and bounding boxes of the classes.
+ * Batches can arrive in any order and size, each point is read exactly once. Rows with a missing
+ * (NaN) feature or an unknown class are skipped as a whole.
+ *
+ * @param trainer A pointer to the 'streamTrainer_t' structure.
+ * @param batch   A pointer to the 'colData_t' structure holding the batch and its classes.
+ *
+ * @code
+ *   // Example usage:
+ *   while(nextDatasetBatch(&reader, &batch) > 0)
+ *   {
+ *       streamCenterPass(&trainer, &batch);
+ *   }
+ *   finishCenterPass(&trainer);
+ * @endcode
+ */
+void streamCenterPass(streamTrainer_t *trainer, const colData_t *batch)
+{
+    const vecModel_t *model = trainer->model;
+
+    DKNN_PROBE1(train__batch__start, batch->rows);
+
+    for(int row=0; row<batch->rows; row++)
+    {
+        int class = batch->class[row];
+
+        if((class < 0) || (class >= model->classes) || !rowIsComplete(batch, row, model->dim))
+        {
+            continue;
+        }
+
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            int index = (class * model->dim) + feature;
+            float value = batch->columns[(feature * batch->stride) + row];
+
+            trainer->sums[index] += value;
+            trainer->lower[index] = (value < trainer->lower[index]) ? value : trainer->lower[index];
+            trainer->upper[index] = (value > trainer->upper[index]) ? value : trainer->upper[index];
+        }
+        trainer->counts[class] += 1;
+    }
+
+    DKNN_PROBE1(train__batch__done, batch->rows);
+}
+
+/**
+ * @brief Finish the center pass of a streaming trainer.
+ *
+ * This function sets the class centers of the model to the exact means of the points seen in the
+ * center pass and bounds the distance of any point to its own center by the farthest corner of the
+ * class bounding box, which fixes the range of the distance histograms of the dilution pass.
+ *
+ * @param trainer A pointer to the 'streamTrainer_t' structure.
+ *
+ * @code
+ *   // Example usage:
+ *   finishCenterPass(&trainer);
+ *   // The centers of the model are final, the dilution pass can start.
+ * @endcode
+ */
+void finishCenterPass(streamTrainer_t *trainer)
+{
+    vecModel_t *model = trainer->model;
+
+    for(int class=0; class<model->classes; class++)
+    {
+        double sqDistance = 0;
+
+        if(trainer->counts[class] == 0)
+        {
+            continue;
+        }
+
+        for(int feature=0; feature<model->dim; feature++)
+        {
+            int index = (class * model->dim) + feature;
+            double center = trainer->sums[index] / trainer->counts[class];
+            double below = center - trainer->lower[index];
+            double above = trainer->upper[index] - center;
+            double weight = (model->weights != NULL) ? model->weights[feature] : 1.0;
+
+            model->centers[index] = (float)center;
+            sqDistance += weight * ((below > above) ? (below * below) : (above * above));
+        }
+        trainer->maxDistance[class] = sqrt(sqDistance);
+    }
+
+    updateCenterNorms(model);
+}
+
+/**
+ * @brief Feed a batch to the dilution pass of a streaming trainer.
+ *
+ * This function adds the distance of every point of the batch to its own class center to the
+ * distance histogram of the class. Each point is read exactly once.
+ *
+ * @param trainer A pointer to the 'streamTrainer_t' structure, after finishCenterPass.
+ * @param batch   A pointer to the 'colData_t' structure holding the batch and its classes.
+ *
+ * @code
+ *   // Example usage:
+ *   while(nextDatasetBatch(&reader, &batch) > 0)
+ *   {
+ *       streamDilutionPass(&trainer, &batch);
+ *   }
+ *   finishDilutionPass(&trainer, EPOCH);
+ * @endcode
+ */
+void streamDilutionPass(streamTrainer_t *trainer, const colData_t *batch)
+{
+    const vecModel_t *model = trainer->model;
+    float sqDistance[COLUMN_TILE];
+
+    DKNN_PROBE1(train__batch__start, batch->rows);
+
+    for(int start=0; start<batch->rows; start+=COLUMN_TILE)
+    {
+        int tile = ((batch->rows - start) < COLUMN_TILE) ? (batch->rows - start) : COLUMN_TILE;
+
+        ownClassSqDistances(batch, start, tile, model, sqDistance);
+
+        for(int row=0; row<tile; row++)
+        {
+            int class = batch->class[start + row];
+            double range;
+            int bin = 0;
+
+            if((class < 0) || (class >= model->classes) || isnan(sqDistance[row])) //the center pass skipped this row too
+            {
+                continue;
+            }
+
+            range = trainer->maxDistance[class];
+            if(range > 0)
+            {
+                bin = (int)((sqrt(sqDistance[row]) / range) * MAP_RESOLUTION);
+                bin = (bin < MAP_RESOLUTION) ? ((bin < 0) ? 0 : bin) : (MAP_RESOLUTION - 1);
+            }
+            trainer->histogram[(class * MAP_RESOLUTION) + bin] += 1;
+        }
+    }
+
+    DKNN_PROBE1(train__batch__done, batch->rows);
+}
+
+static double histogramBelow(const streamTrainer_t *trainer, int class, double distance) //points closer than 'distance', interpolated within a bin
+{
+    const double *histogram = &trainer->histogram[class * MAP_RESOLUTION];
+    double range = trainer->maxDistance[class];
+    double position;
+    double below = 0;
+    int bin;
+
+    if(range <= 0)
+    {
+        return (distance > 0) ? trainer->counts[class] : 0;
+    }
+
+    position = (distance / range) * MAP_RESOLUTION;
+    if(position >= MAP_RESOLUTION)
+    {
+        return trainer->counts[class];
+    }
+    if(position <= 0)
+    {
+        return 0;
+    }
+
+    bin = (int)position;
+    for(int index=0; index<bin; index++)
+    {
+        below += histogram[index];
+    }
+
+    return below + (histogram[bin] * (position - bin));
+}
+
+/**
+ * @brief Finish the dilution pass of a streaming trainer.
+ *
+ * This function estimates the dilution parameters that 'epochs' epochs of modifyDilutionPars would
+ * reach, from the distance histograms alone. Each epoch is replayed in MAP_RESOLUTION slices of
+ * equal size: in a slice, the points inside the overconfidence circle grow it and the points
+ * outside of it grow the spread, as modifyDilutionPars does point by point, with the split read
+ * from the histogram at the current overconfidence.
+ *
+ * @param trainer A pointer to the 'streamTrainer_t' structure.
+ * @param epochs  The number of epochs to estimate, e.g. EPOCH.
+ *
+ * @note The slices model points arriving in random order, so the estimate does not depend on the
+ *       order in which the data was stored.
+ *
+ * @code
+ *   // Example usage:
+ *   finishDilutionPass(&trainer, EPOCH);
+ *   // The model is trained, after reading the data twice.
+ * @endcode
+ */
+void finishDilutionPass(streamTrainer_t *trainer, int epochs)
+{
+    vecModel_t *model = trainer->model;
+
+    for(int class=0; class<model->classes; class++)
+    {
+        if(trainer->counts[class] == 0)
+        {
+            continue;
+        }
+
+        double slice = trainer->counts[class] / MAP_RESOLUTION;
+
+        for(long step=0; step<((long)epochs * MAP_RESOLUTION); step++)
+        {
+            double inside = histogramBelow(trainer, class, model->DPs[class].overconfidence) / MAP_RESOLUTION;
+
+            if(inside >= slice) //every point is inside from now on
+            {
+                stepDilutionParsBy(model->DPs, class, (float)(slice * (double)(((long)epochs * MAP_RESOLUTION) - step)), 0);
+                break;
+            }
+            stepDilutionParsBy(model->DPs, class, (float)inside, (float)(slice - inside));
+        }
+    }
+
+    DKNN_PROBE2(model__update, model->classes, model->dim);
+}
+
+/**
+ * @brief Initialize a per-class stratified coreset on caller-provided storage.
+ *
+ * This function prepares a coreset that keeps a uniform reservoir sample of at most 'capacity'
+ * points for every class, built in one streaming pass. Every kept point stands for
+ * coresetWeight points of its class, so rare classes keep as many points as frequent ones
+ * and training on the coreset costs the same whatever the size of the data.
+ *
+ * @param coreset  A pointer to the 'coreset_t' structure to initialize.
+ * @param classes  The number of classes.
+ * @param dim      The number of features of a data point.
+ * @param capacity The number of points kept per class, e.g. CORESET_SIZE.
+ * @param seed     The seed of the reservoir sampling, any nonzero value.
+ * @param points   An array of CORESET_FLOATS(classes, dim, capacity) floats.
+ * @param stats    An array of CORESET_DOUBLES(classes, dim) doubles.
+ *
+ * @code
+ *   // Example usage:
+ *   static float points[CORESET_FLOATS(3, 16, CORESET_SIZE)];
+ *   static double stats[CORESET_DOUBLES(3, 16)];
+ *   coreset_t coreset;
+ *   initCoreset(&coreset, 3, 16, CORESET_SIZE, 42u, points, stats);
+ * @endcode
+ */
+void initCoreset(coreset_t *coreset, int classes, int dim, int capacity, uint64_t seed, float points[], double stats[])
+{
+    coreset->classes = classes;
+    coreset->dim = dim;
+    coreset->capacity = capacity;
+    coreset->points = points;
+    coreset->sums = stats;
+    coreset->sqNorms = coreset->sums + (classes * dim);
+    coreset->seen = coreset->sqNorms + classes;
+    coreset->random = (seed != 0) ? seed : 0x9E3779B97F4A7C15ULL;
+
+    for(int index=0; index<CORESET_DOUBLES(classes, dim); index++)
+    {
+        stats[index] = 0;
+    }
+}
+
+static uint64_t nextRandom(uint64_t *state) //xorshift64*
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Offer a batch of columnar data points to a coreset.
+ *
+ * This function runs reservoir sampling (algorithm R) separately for every class: the first
+ * 'capacity' points of a class are kept, and the n-th point after that replaces a random kept
+ * point with probability capacity / n, which keeps every point seen so far with the same
+ * probability. The exact per-class sums behind coresetCenterBound are updated as well.
+ *
+ * @param coreset A pointer to the 'coreset_t' structure.
+ * @param batch   A pointer to the 'colData_t' structure holding the batch and its classes.
+ *
+ * @code
+ *   // Example usage:
+ *   while(nextDatasetBatch(&reader, &batch) > 0)
+ *   {
+ *       offerCoresetBatch(&coreset, &batch); // One pass over the data...
+ *   }
+ * @endcode
+ */
+void offerCoresetBatch(coreset_t *coreset, const colData_t *batch)
+{
+    for(int row=0; row<batch->rows; row++)
+    {
+        int class = batch->class[row];
+        double *sum;
+        uint64_t slot;
+        double sqNorm = 0;
+
+        if((class < 0) || (class >= coreset->classes))
+        {
+            continue;
+        }
+
+        coreset->seen[class] += 1;
+        slot = (coreset->seen[class] <= coreset->capacity) ? (uint64_t)(coreset->seen[class] - 1) :
+               (nextRandom(&coreset->random) % (uint64_t)coreset->seen[class]);
+
+        sum = &coreset->sums[class * coreset->dim];
+        for(int feature=0; feature<coreset->dim; feature++)
+        {
+            float value = batch->columns[(feature * batch->stride) + row];
+
+            sum[feature] += value;
+            sqNorm += (double)value * value;
+        }
+        coreset->sqNorms[class] += sqNorm;
+
+        if(slot < (uint64_t)coreset->capacity)
+        {
+            float *point = &coreset->points[((class * coreset->capacity) + (int)slot) * coreset->dim];
+
+            for(int feature=0; feature<coreset->dim; feature++)
+            {
+                point[feature] = batch->columns[(feature * batch->stride) + row];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Get the number of points a coreset keeps for a class.
+ *
+ * @param coreset A pointer to the 'coreset_t' structure.
+ * @param class   The class index.
+ *
+ * @return The number of kept points of the class, at most 'coreset->capacity'.
+ *
+ * @code
+ *   // Example usage:
+ *   int kept = coresetKept(&coreset, 0);
+ * @endcode
+ */
+int coresetKept(const coreset_t *coreset, int class)
+{
+    return (coreset->seen[class] < coreset->capacity) ? (int)coreset->seen[class] : coreset->capacity;
+}
+
+/**
+ * @brief Get the importance weight of the kept points of a class.
+ *
+ * This function returns the number of offered points every kept point of 'class' stands for.
+ *
+ * @param coreset A pointer to the 'coreset_t' structure.
+ * @param class   The class index.
+ *
+ * @return The number of offered points divided by the number of kept points, 0 for an empty class.
+ *
+ * @code
+ *   // Example usage:
+ *   float weight = coresetWeight(&coreset, 2);
+ *   // Every kept point of class 2 stands for 'weight' points of the data.
+ * @endcode
+ */
+float coresetWeight(const coreset_t *coreset, int class)
+{
+    int kept = coresetKept(coreset, class);
+
+    return (kept > 0) ? (float)(coreset->seen[class] / kept) : (float)0.0;
+}
+
+/**
+ * @brief Bound how far the kept points of a class are off its exact center.
+ *
+ * This function returns a radius r such that the mean of the kept points of 'class' lies within
+ * r of the exact mean of all offered points with probability at least 1 - 'delta'. The centers
+ * set by trainOnCoreset are exact, so r measures how representative the kept points behind the
+ * distance histograms are. The radius follows from Chebyshev's inequality with the exact total
+ * variance s^2 of the class, tracked during the pass, and the variance of a mean of m points
+ * sampled without replacement out of n: r = sqrt((s^2 / m) * ((n - m) / (n - 1)) / delta).
+ * It is 0 when every point was kept.
+ *
+ * @param coreset A pointer to the 'coreset_t' structure.
+ * @param class   The class index.
+ * @param delta   The allowed failure probability, in (0, 1].
+ *
+ * @return The error bound on the center of the class, in distance units of the unweighted features.
+ *
+ * @code
+ *   // Example usage:
+ *   float bound = coresetCenterBound(&coreset, 0, 0.05);
+ *   // With probability 95%, the kept points of class 0 average within 'bound' of the exact center.
+ * @endcode
+ */
+float coresetCenterBound(const coreset_t *coreset, int class, float delta)
+{
+    double seen = coreset->seen[class];
+    double kept = coresetKept(coreset, class);
+    const double *sum = &coreset->sums[class * coreset->dim];
+    double meanSqNorm = 0;
+    double variance;
+
+    if((kept == 0) || (kept >= seen))
+    {
+        return (float)0.0;
+    }
+
+    for(int feature=0; feature<coreset->dim; feature++)
+    {
+        meanSqNorm += (sum[feature] / seen) * (sum[feature] / seen);
+    }
+    variance = (coreset->sqNorms[class] / seen) - meanSqNorm;
+    variance = (variance > 0) ? variance : 0;
+
+    return (float)sqrt(((variance / kept) * ((seen - kept) / (seen - 1))) / delta);
+}
+
+/**
+ * @brief Train a vector model on a coreset.
+ *
+ * This function sets the centers of the trainer model to the exact means of every offered point,
+ * from the per-class sums the coreset tracks, and estimates the dilution parameters of 'epochs'
+ * epochs like finishDilutionPass does, from distance histograms in which every kept point counts
+ * with its importance weight. Only the histograms are sampled, so their cost depends on the
+ * coreset capacity, not on the number of offered points.
+ *
+ * @param coreset A pointer to the 'coreset_t' structure.
+ * @param trainer A pointer to a 'streamTrainer_t' structure initialized on the model to train.
+ * @param epochs  The number of epochs the dilution parameters are estimated for, e.g. EPOCH.
+ *
+ * @note The distance range of each class is taken from its kept points, farther points that
+ *       were not kept would have fallen into the last histogram bin.
+ *
+ * @code
+ *   // Example usage:
+ *   initStreamTrainer(&trainer, &model, workspace);
+ *   trainOnCoreset(&coreset, &trainer, EPOCH);
+ *   // 'model' is trained from at most CORESET_SIZE points per class.
+ * @endcode
+ */
+void trainOnCoreset(const coreset_t *coreset, streamTrainer_t *trainer, int epochs)
+{
+    vecModel_t *model = trainer->model;
+
+    for(int class=0; class<model->classes; class++)
+    {
+        const float *points = &coreset->points[class * coreset->capacity * coreset->dim];
+        float *center = &model->centers[class * model->dim];
+        double *histogram = &trainer->histogram[class * MAP_RESOLUTION];
+        int kept = coresetKept(coreset, class);
+        float weight = coresetWeight(coreset, class);
+        double range = 0;
+
+        trainer->counts[class] = coreset->seen[class];
+        if(kept == 0)
+        {
+            continue;
+        }
+
+        for(int feature=0; feature<model->dim; feature++) //exact, from every offered point
+        {
+            center[feature] = (float)(coreset->sums[(class * coreset->dim) + feature] / coreset->seen[class]);
+        }
+
+        for(int point=0; point<kept; point++)
+        {
+            double distance = calcVectorDistance(&points[point * model->dim], model, class);
+
+            range = (distance > range) ? distance : range;
+        }
+        trainer->maxDistance[class] = range;
+
+        for(int bin=0; bin<MAP_RESOLUTION; bin++)
+        {
+            histogram[bin] = 0;
+        }
+        for(int point=0; point<kept; point++)
+        {
+            int bin = 0;
+
+            if(range > 0)
+            {
+                bin = (int)((calcVectorDistance(&points[point * model->dim], model, class) / range) * MAP_RESOLUTION);
+                bin = (bin < MAP_RESOLUTION) ? bin : (MAP_RESOLUTION - 1);
+            }
+            histogram[bin] += weight;
+        }
+    }
+
+    updateCenterNorms(model);
+    finishDilutionPass(trainer, epochs);
+}
+
+static void shuffleClass(sampler_t *sampler, int class) //permute the rows of every block, then the blocks
+{
+    int first = sampler->classStart[class];
+    int count = sampler->classStart[class + 1] - first;
+    int *blocks = &sampler->blocks[sampler->blockStart[class]];
+    int blockCount = sampler->blockStart[class + 1] - sampler->blockStart[class];
+
+    for(int block=0; block<blockCount; block++)
+    {
+        int *rows = &sampler->order[first + (block * SAMPLER_BLOCK)];
+        int size = ((count - (block * SAMPLER_BLOCK)) < SAMPLER_BLOCK) ? (count - (block * SAMPLER_BLOCK)) : SAMPLER_BLOCK;
+
+        for(int index=size - 1; index>0; index--)
+        {
+            int other = (int)(nextRandom(&sampler->random) % (uint64_t)(index + 1));
+            int row = rows[index];
+
+            rows[index] = rows[other];
+            rows[other] = row;
+        }
+        blocks[block] = block;
+    }
+
+    for(int index=blockCount - 1; index>0; index--)
+    {
+        int other = (int)(nextRandom(&sampler->random) % (uint64_t)(index + 1));
+        int block = blocks[index];
+
+        blocks[index] = blocks[other];
+        blocks[other] = block;
+    }
+
+    sampler->cursorBlock[class] = 0;
+    sampler->cursorRow[class] = 0;
+}
+
+/**
+ * @brief Initialize a class-aware batch sampler on caller-provided storage.
+ *
+ * This function groups the row indices of every class together, in ascending order, and shuffles
+ * them blockwise: rows are permuted within blocks of SAMPLER_BLOCK rows, and then the blocks are
+ * permuted. Batches drawn from the sampler are thus well mixed, while consecutive draws of a class
+ * stay within one block of nearby rows, which keeps the gathers cache and prefetch friendly
+ * compared to a full random shuffle.
+ *
+ * @param sampler   A pointer to the 'sampler_t' structure to initialize.
+ * @param class     An array of 'rows' class identifiers, rows outside [0, classes) are never drawn.
+ * @param rows      The number of rows of the data.
+ * @param classes   The number of classes.
+ * @param mode      SAMPLER_BALANCED or SAMPLER_STRATIFIED.
+ * @param seed      The seed of the shuffles, any nonzero value.
+ * @param workspace An array of SAMPLER_INTS(classes, rows) ints.
+ *
+ * @code
+ *   // Example usage:
+ *   int *workspace = malloc(SAMPLER_INTS(3, data.rows) * sizeof(int));
+ *   sampler_t sampler;
+ *   initBatchSampler(&sampler, data.class, data.rows, 3, SAMPLER_BALANCED, 7u, workspace);
+ * @endcode
+ */
+void initBatchSampler(sampler_t *sampler, const int class[], int rows, int classes, int mode, uint64_t seed, int workspace[])
+{
+    sampler->classes = classes;
+    sampler->rows = 0;
+    sampler->mode = mode;
+    sampler->rotation = 0;
+    sampler->random = (seed != 0) ? seed : 0x9E3779B97F4A7C15ULL;
+    sampler->classStart = workspace;
+    sampler->blockStart = sampler->classStart + (classes + 1);
+    sampler->cursorBlock = sampler->blockStart + (classes + 1);
+    sampler->cursorRow = sampler->cursorBlock + classes;
+    sampler->credit = (int64_t *)(void *)(((uintptr_t)(sampler->cursorRow + classes) + 7u) & ~(uintptr_t)7u); //8-byte aligned
+    sampler->order = (int *)(void *)(sampler->credit + classes);
+
+    for(int index=0; index<=classes; index++)
+    {
+        sampler->classStart[index] = 0;
+    }
+    for(int row=0; row<rows; row++) //counting sort of the rows by class
+    {
+        if((class[row] >= 0) && (class[row] < classes))
+        {
+            sampler->classStart[class[row] + 1]++;
+            sampler->rows++;
+        }
+    }
+    for(int index=0; index<classes; index++)
+    {
+        sampler->classStart[index + 1] += sampler->classStart[index];
+        sampler->cursorRow[index] = sampler->classStart[index];
+        sampler->credit[index] = 0;
+    }
+    for(int row=0; row<rows; row++)
+    {
+        if((class[row] >= 0) && (class[row] < classes))
+        {
+            sampler->order[sampler->cursorRow[class[row]]++] = row;
+        }
+    }
+
+    sampler->blocks = sampler->order + sampler->rows;
+    sampler->blockStart[0] = 0;
+    for(int index=0; index<classes; index++)
+    {
+        int count = sampler->classStart[index + 1] - sampler->classStart[index];
+
+        sampler->blockStart[index + 1] = sampler->blockStart[index] + ((count + SAMPLER_BLOCK - 1) / SAMPLER_BLOCK);
+        shuffleClass(sampler, index);
+    }
+}
+
+static int drawClassRows(sampler_t *sampler, int class, int count, int indices[])
+{
+    int first = sampler->classStart[class];
+    int size = sampler->classStart[class + 1] - first;
+    int blockCount = sampler->blockStart[class + 1] - sampler->blockStart[class];
+
+    for(int index=0; index<count; index++)
+    {
+        int block;
+        int blockSize;
+
+        if(sampler->cursorBlock[class] == blockCount) //class exhausted, start a new pass over it
+        {
+            shuffleClass(sampler, class);
+        }
+
+        block = sampler->blocks[sampler->blockStart[class] + sampler->cursorBlock[class]];
+        blockSize = ((size - (block * SAMPLER_BLOCK)) < SAMPLER_BLOCK) ? (size - (block * SAMPLER_BLOCK)) : SAMPLER_BLOCK;
+        indices[index] = sampler->order[first + (block * SAMPLER_BLOCK) + sampler->cursorRow[class]];
+
+        if(++sampler->cursorRow[class] == blockSize)
+        {
+            sampler->cursorRow[class] = 0;
+            sampler->cursorBlock[class]++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Draw the row indices of the next batch from a batch sampler.
+ *
+ * In SAMPLER_BALANCED mode, every non-empty class gets the same share of the batch, so rare
+ * classes are seen as often as frequent ones and start over once they are exhausted. In
+ * SAMPLER_STRATIFIED mode, every class gets its share of the data, with rounding errors carried
+ * over to later batches, so every batch has the class frequencies of the whole data.
+ *
+ * @param sampler    A pointer to the 'sampler_t' structure.
+ * @param indices    An array of 'batchRows' ints receiving the drawn row indices, grouped by class.
+ * @param batchRows  The number of rows to draw, e.g. BATCH_SIZE.
+ *
+ * @return The number of row indices written, 0 if the sampler holds no rows.
+ *
+ * @code
+ *   // Example usage:
+ *   int indices[BATCH_SIZE];
+ *   dataPoint_t dataPack[BATCH_SIZE];
+ *   for(int batch=0; batch<(numPoints / BATCH_SIZE); batch++)
+ *   {
+ *       gatherDataPoints(points, indices, nextSampleBatch(&sampler, indices, BATCH_SIZE), dataPack);
+ *       setCircleCenters(dataPack, classCenters, pointCounts);
+ *   }
+ * @endcode
+ */
+int nextSampleBatch(sampler_t *sampler, int indices[], int batchRows)
+{
+    int filled = 0;
+    int nonEmpty = 0;
+    int visited = 0;
+
+    if(sampler->rows == 0)
+    {
+        return 0;
+    }
+
+    for(int class=0; class<sampler->classes; class++)
+    {
+        nonEmpty += (sampler->classStart[class + 1] > sampler->classStart[class]) ? 1 : 0;
+    }
+
+    for(int step=0; step<sampler->classes; step++)
+    {
+        int class = (sampler->rotation + step) % sampler->classes;
+        int size = sampler->classStart[class + 1] - sampler->classStart[class];
+        int64_t share;
+        int drawn;
+
+        if(size == 0)
+        {
+            continue;
+        }
+
+        if(sampler->mode == SAMPLER_STRATIFIED)
+        {
+            sampler->credit[class] += (int64_t)size * batchRows; //fixed-point share, in units of 1 / rows
+            share = (sampler->credit[class] > 0) ? (sampler->credit[class] / sampler->rows) : 0;
+        }
+        else
+        {
+            share = (batchRows / nonEmpty) + ((visited < (batchRows % nonEmpty)) ? 1 : 0);
+        }
+        visited++;
+
+        drawn = ((filled + share) > batchRows) ? (batchRows - filled) : (int)share;
+        filled += drawClassRows(sampler, class, drawn, &indices[filled]);
+        if(sampler->mode == SAMPLER_STRATIFIED)
+        {
+            sampler->credit[class] -= (int64_t)drawn * sampler->rows; //rows cut by a full batch stay owed
+        }
+    }
+
+    while((sampler->mode == SAMPLER_STRATIFIED) && (filled < batchRows)) //rounding leftovers, to the class owed most
+    {
+        int owed = -1;
+
+        for(int step=0; step<sampler->classes; step++)
+        {
+            int class = (sampler->rotation + step) % sampler->classes;
+
+            if((sampler->classStart[class + 1] > sampler->classStart[class]) &&
+               ((owed < 0) || (sampler->credit[class] > sampler->credit[owed])))
+            {
+                owed = class;
+            }
+        }
+        filled += drawClassRows(sampler, owed, 1, &indices[filled]);
+        sampler->credit[owed] -= sampler->rows;
+    }
+
+    sampler->rotation = (sampler->rotation + 1) % sampler->classes;
+
+    return filled;
+}
+
+/**
+ * @brief Gather data points by index into a batch.
+ *
+ * This function copies 'source[indices[i]]' to 'dataPack[i]', so batches drawn with
+ * nextSampleBatch can be fed to setCircleCenters and the other 'dataPoint_t' functions.
+ *
+ * @param source   An array of 'dataPoint_t' structures holding every data point.
+ * @param indices  An array of 'count' row indices into 'source'.
+ * @param count    The number of data points to gather.
+ * @param dataPack An array of at least 'count' 'dataPoint_t' structures receiving the batch.
+ *
+ * @code
+ *   // Example usage:
+ *   gatherDataPoints(points, indices, BATCH_SIZE, dataPack);
+ * @endcode
+ */
+void gatherDataPoints(const dataPoint_t source[], const int indices[], int count, dataPoint_t dataPack[])
+{
+    for(int index=0; index<count; index++)
+    {
+        dataPack[index] = source[indices[index]];
+    }
+}
+
+/**
+ * @brief Gather columnar data points by index into a columnar batch.
+ *
+ * This function copies the rows 'indices' of 'source', feature column by feature column, into the
+ * first 'count' rows of 'batch', and sets 'batch->rows' to 'count'.
+ *
+ * @param source  A pointer to the 'colData_t' structure holding every data point.
+ * @param indices An array of 'count' row indices into 'source'.
+ * @param count   The number of data points to gather.
+ * @param batch   A pointer to a 'colData_t' structure with 'source->cols' columns of at least
+ *                'count' rows, and a class column if 'source' has one.
+ *
+ * @code
+ *   // Example usage:
+ *   float columns[16 * BATCH_SIZE];
+ *   int classes[BATCH_SIZE];
+ *   colData_t batch = {0, 16, BATCH_SIZE, columns, classes};
+ *   gatherColumnBatch(&data, indices, nextSampleBatch(&sampler, indices, BATCH_SIZE), &batch);
+ * @endcode
+ */
+void gatherColumnBatch(const colData_t *source, const int indices[], int count, colData_t *batch)
+{
+    for(int feature=0; feature<source->cols; feature++)
+    {
+        const float *column = &source->columns[feature * source->stride];
+        float *target = &batch->columns[feature * batch->stride];
+
+        for(int index=0; index<count; index++)
+        {
+            target[index] = column[indices[index]];
+        }
+    }
+
+    for(int index=0; (source->class != NULL) && (index < count); index++)
+    {
+        batch->class[index] = source->class[indices[index]];
+    }
+
+    batch->rows = count;
+}
+
+/**
+ * @brief Initialize a batch assembler.
+ *
+ * A batch assembler cuts a stream of data point chunks of any size into batches of BATCH_SIZE.
+ * Whole batches inside a chunk are handed out in place, and only the data points straddling two
+ * chunks are copied into the staging batch of the assembler.
+ *
+ * @param assembler A pointer to the 'assembler_t' structure to initialize.
+ *
+ * @code
+ *   // Example usage:
+ *   assembler_t assembler;
+ *   initBatchAssembler(&assembler);
+ * @endcode
+ */
+void initBatchAssembler(assembler_t *assembler)
+{
+    assembler->staged = 0;
+    assembler->chunk = NULL;
+    assembler->remaining = 0;
+}
+
+/**
+ * @brief Hand the next chunk of a stream to a batch assembler.
+ *
+ * @param assembler A pointer to the 'assembler_t' structure.
+ * @param chunk     An array of 'count' 'dataPoint_t' structures, kept alive until
+ *                  nextAssembledBatch returns 0.
+ * @param count     The number of data points in the chunk, any size.
+ *
+ * @note The previous chunk must have been drained with nextAssembledBatch.
+ *
+ * @code
+ *   // Example usage:
+ *   feedBatchAssembler(&assembler, received, receivedCount);
+ * @endcode
+ */
+void feedBatchAssembler(assembler_t *assembler, const dataPoint_t chunk[], int count)
+{
+    assembler->chunk = chunk;
+    assembler->remaining = count;
+}
+
+/**
+ * @brief Get the next full batch from a batch assembler.
+ *
+ * @param assembler A pointer to the 'assembler_t' structure.
+ * @param batch     Receives a pointer to BATCH_SIZE data points, either inside the current chunk
+ *                  or the staging batch, valid until the next call.
+ *
+ * @return BATCH_SIZE if a batch is ready, 0 once the chunk is drained and the rest is staged.
+ *
+ * @code
+ *   // Example usage:
+ *   const dataPoint_t *batch;
+ *   feedBatchAssembler(&assembler, received, receivedCount);
+ *   while(nextAssembledBatch(&assembler, &batch) > 0)
+ *   {
+ *       setBatchCircleCenters(batch, BATCH_SIZE, classCenters, pointCounts);
+ *   }
+ * @endcode
+ */
+int nextAssembledBatch(assembler_t *assembler, const dataPoint_t **batch)
+{
+    int take;
+
+    if(assembler->staged == BATCH_SIZE) //the staging batch was handed out by the last call
+    {
+        assembler->staged = 0;
+    }
+
+    if((assembler->staged == 0) && (assembler->remaining >= BATCH_SIZE)) //whole batch inside the chunk
+    {
+        *batch = assembler->chunk;
+        assembler->chunk += BATCH_SIZE;
+        assembler->remaining -= BATCH_SIZE;
+
+        return BATCH_SIZE;
+    }
+
+    take = ((BATCH_SIZE - assembler->staged) < assembler->remaining) ? (BATCH_SIZE - assembler->staged) : assembler->remaining;
+    for(int index=0; index<take; index++)
+    {
+        assembler->staging[assembler->staged + index] = assembler->chunk[index];
+    }
+    assembler->staged += take;
+    assembler->chunk += take;
+    assembler->remaining -= take;
+
+    if(assembler->staged == BATCH_SIZE)
+    {
+        *batch = assembler->staging;
+
+        return BATCH_SIZE;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the partial batch left in a batch assembler at the end of a stream.
+ *
+ * @param assembler A pointer to the 'assembler_t' structure, emptied by the call.
+ * @param batch     Receives a pointer to the staged data points.
+ *
+ * @return The number of staged data points, from 0 to BATCH_SIZE - 1.
+ *
+ * @code
+ *   // Example usage:
+ *   int tail = flushBatchAssembler(&assembler, &batch);
+ *   setBatchCircleCenters(batch, tail, classCenters, pointCounts);
+ * @endcode
+ */
+int flushBatchAssembler(assembler_t *assembler, const dataPoint_t **batch)
+{
+    int count = (assembler->staged == BATCH_SIZE) ? 0 : assembler->staged;
+
+    *batch = assembler->staging;
+    assembler->staged = 0;
+
+    return count;
+}
+
+#define ARENA_ROUND(bytes)      ((((size_t)(bytes)) + (ARENA_ALIGN - 1)) & ~((size_t)ARENA_ALIGN - 1))
+#define DATASET_STRIDE(rows)    (((rows) + (int)(ARENA_ALIGN / sizeof(float)) - 1) & ~((int)(ARENA_ALIGN / sizeof(float)) - 1))
+
+/**
+ * @brief Initialize an arena allocator on caller-provided memory.
+ *
+ * An arena hands out aligned blocks from one region and never frees them one by one, so datasets,
+ * batch buffers and model storage can be set up once, from a static array or a single host
+ * allocation, and training and inference run without touching the heap afterwards.
+ *
+ * @param arena  A pointer to the 'arena_t' structure to initialize.
+ * @param memory The memory region the arena hands out.
+ * @param size   The size of the region in bytes.
+ *
+ * @code
+ *   // Example usage:
+ *   static uint8_t memory[16384];
+ *   arena_t arena;
+ *   initArena(&arena, memory, sizeof(memory));
+ * @endcode
+ */
+void initArena(arena_t *arena, void *memory, size_t size)
+{
+    size_t skip = (ARENA_ALIGN - ((uintptr_t)memory % ARENA_ALIGN)) % ARENA_ALIGN;
+
+    arena->base = (uint8_t *)memory + skip;
+    arena->size = (size > skip) ? (size - skip) : 0;
+    arena->used = 0;
+}
+
+/**
+ * @brief Allocate an aligned block from an arena.
+ *
+ * @param arena A pointer to the 'arena_t' structure.
+ * @param bytes The size of the block in bytes, rounded up to ARENA_ALIGN.
+ *
+ * @return A pointer to a block aligned to ARENA_ALIGN, or NULL if the arena is exhausted.
+ *
+ * @code
+ *   // Example usage:
+ *   float *sums = arenaAlloc(&arena, classes * dim * sizeof(float));
+ * @endcode
+ */
+void *arenaAlloc(arena_t *arena, size_t bytes)
+{
+    void *block;
+
+    bytes = ARENA_ROUND(bytes);
+    if(bytes > (arena->size - arena->used))
+    {
+        return NULL;
+    }
+
+    block = arena->base + arena->used;
+    arena->used += bytes;
+
+    return block;
+}
+
+/**
+ * @brief Get the arena size needed by a dataset.
+ *
+ * @param rows    The number of rows.
+ * @param cols    The number of feature columns.
+ * @param classes The number of classes.
+ *
+ * @return The number of arena bytes initDataset takes, not counting the alignment of the arena.
+ *
+ * @code
+ *   // Example usage:
+ *   uint8_t *memory = malloc(datasetBytes(rows, 16, 3) + ARENA_ALIGN);
+ * @endcode
+ */
+size_t datasetBytes(int rows, int cols, int classes)
+{
+    size_t classBytes = (classes < 255) ? sizeof(uint8_t) : sizeof(uint16_t);
+
+    return ARENA_ROUND((size_t)cols * (size_t)DATASET_STRIDE(rows) * sizeof(float))
+         + ARENA_ROUND((size_t)rows * classBytes)
+         + ARENA_ROUND((size_t)(classes + 1) * sizeof(int))
+         + ARENA_ROUND((size_t)rows * sizeof(int));
+}
+
+/**
+ * @brief Initialize a structure-of-arrays dataset in an arena.
+ *
+ * This function allocates the feature columns, the compact class column and the class partition
+ * index of a dataset. Columns are aligned to ARENA_ALIGN and padded with zeros to a whole cache
+ * line, so vector loops may read full tiles. Classes are kept in uint8_t when there are fewer than
+ * 255 of them, and in uint16_t otherwise, instead of the int of 'dataPoint_t'. Every row starts
+ * unlabeled with zero features.
+ *
+ * @param dataset A pointer to the 'dataset_t' structure to initialize.
+ * @param arena   A pointer to the 'arena_t' structure the storage comes from.
+ * @param rows    The number of rows.
+ * @param cols    The number of feature columns.
+ * @param classes The number of classes, at most 65535.
+ *
+ * @return 0 on success, -1 if the arena is too small or 'classes' is out of range.
+ *
+ * @code
+ *   // Example usage:
+ *   dataset_t dataset;
+ *   initDataset(&dataset, &arena, numPoints, 2, 3);
+ *   loadDatasetPoints(&dataset, points, numPoints);
+ *   indexDatasetClasses(&dataset);
+ * @endcode
+ */
+int initDataset(dataset_t *dataset, arena_t *arena, int rows, int cols, int classes)
+{
+    if((classes < 1) || (classes > 65535) || (rows < 0) || (cols < 1))
+    {
+        return -1;
+    }
+
+    dataset->rows = rows;
+    dataset->cols = cols;
+    dataset->stride = DATASET_STRIDE(rows);
+    dataset->classes = classes;
+    dataset->classBytes = (classes < 255) ? (int)sizeof(uint8_t) : (int)sizeof(uint16_t);
+    dataset->columns = arenaAlloc(arena, (size_t)cols * (size_t)dataset->stride * sizeof(float));
+    dataset->class = arenaAlloc(arena, (size_t)rows * (size_t)dataset->classBytes);
+    dataset->partition = arenaAlloc(arena, (size_t)(classes + 1) * sizeof(int));
+    dataset->byClass = arenaAlloc(arena, (size_t)rows * sizeof(int));
+
+    if((dataset->columns == NULL) || (dataset->class == NULL) || (dataset->partition == NULL) || (dataset->byClass == NULL))
+    {
+        return -1;
+    }
+
+    for(int index=0; index<(cols * dataset->stride); index++)
+    {
+        dataset->columns[index] = 0;
+    }
+    for(int row=0; row<rows; row++)
+    {
+        setDatasetRow(dataset, row, NULL, DATASET_UNLABELED);
+    }
+    for(int class=0; class<=classes; class++)
+    {
+        dataset->partition[class] = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Set the features and class of a dataset row.
+ *
+ * @param dataset  A pointer to the 'dataset_t' structure.
+ * @param row      The row to set.
+ * @param features An array of 'cols' features, or NULL to keep the current ones.
+ * @param class    The class of the row, DATASET_UNLABELED or any value outside [0, classes) for none.
+ *
+ * @note The class partition index is rebuilt by indexDatasetClasses.
+ *
+ * @code
+ *   // Example usage:
+ *   setDatasetRow(&dataset, row, features, class);
+ * @endcode
+ */
+void setDatasetRow(dataset_t *dataset, int row, const float features[], int class)
+{
+    int labeled = (class >= 0) && (class < dataset->classes);
+
+    for(int feature=0; (features != NULL) && (feature < dataset->cols); feature++)
+    {
+        dataset->columns[(feature * dataset->stride) + row] = features[feature];
+    }
+
+    if(dataset->classBytes == (int)sizeof(uint8_t))
+    {
+        ((uint8_t *)dataset->class)[row] = labeled ? (uint8_t)class : (uint8_t)0xFF;
+    }
+    else
+    {
+        ((uint16_t *)dataset->class)[row] = labeled ? (uint16_t)class : (uint16_t)0xFFFF;
+    }
+}
+
+/**
+ * @brief Copy 'dataPoint_t' structures into a two-column dataset.
+ *
+ * @param dataset A pointer to the 'dataset_t' structure, with 2 columns and at least 'count' rows.
+ * @param points  An array of 'count' 'dataPoint_t' structures.
+ * @param count   The number of data points to copy to rows 0 to count - 1.
+ *
+ * @code
+ *   // Example usage:
+ *   loadDatasetPoints(&dataset, points, numPoints);
+ * @endcode
+ */
+void loadDatasetPoints(dataset_t *dataset, const dataPoint_t points[], int count)
+{
+    for(int row=0; row<count; row++)
+    {
+        dataset->columns[row] = points[row].xCoord;
+        dataset->columns[dataset->stride + row] = points[row].yCoord;
+        setDatasetRow(dataset, row, NULL, points[row].class);
+    }
+}
+
+/**
+ * @brief Get the class of a dataset row.
+ *
+ * @param dataset A pointer to the 'dataset_t' structure.
+ * @param row     The row.
+ *
+ * @return The class of the row, or DATASET_UNLABELED.
+ *
+ * @code
+ *   // Example usage:
+ *   int class = datasetClass(&dataset, row);
+ * @endcode
+ */
+int datasetClass(const dataset_t *dataset, int row)
+{
+    int class = (dataset->classBytes == (int)sizeof(uint8_t)) ? (int)((const uint8_t *)dataset->class)[row] : (int)((const uint16_t *)dataset->class)[row];
+
+    return (class < dataset->classes) ? class : DATASET_UNLABELED;
+}
+
+/**
+ * @brief Build the class partition index of a dataset.
+ *
+ * This function groups the row indices of every class, in ascending order, so the rows of one
+ * class can be visited without scanning the whole class column.
+ *
+ * @param dataset A pointer to the 'dataset_t' structure.
+ *
+ * @code
+ *   // Example usage:
+ *   indexDatasetClasses(&dataset);
+ *   int count = datasetClassRows(&dataset, 2, &rows);
+ * @endcode
+ */
+void indexDatasetClasses(dataset_t *dataset)
+{
+    int *partition = dataset->partition;
+
+    for(int class=0; class<=dataset->classes; class++)
+    {
+        partition[class] = 0;
+    }
+    for(int row=0; row<dataset->rows; row++)
+    {
+        int class = datasetClass(dataset, row);
+
+        if(class != DATASET_UNLABELED)
+        {
+            partition[class + 1]++;
+        }
+    }
+    for(int class=0; class<dataset->classes; class++)
+    {
+        partition[class + 1] += partition[class];
+    }
+    for(int row=0; row<dataset->rows; row++) //partition[class] walks to the start of class + 1
+    {
+        int class = datasetClass(dataset, row);
+
+        if(class != DATASET_UNLABELED)
+        {
+            dataset->byClass[partition[class]++] = row;
+        }
+    }
+    for(int class=dataset->classes; class>0; class--)
+    {
+        partition[class] = partition[class - 1];
+    }
+    partition[0] = 0;
+}
+
+/**
+ * @brief Get the rows of a class from the class partition index of a dataset.
+ *
+ * @param dataset A pointer to the 'dataset_t' structure, indexed with indexDatasetClasses.
+ * @param class   The class.
+ * @param rows    Receives a pointer to the ascending row indices of the class.
+ *
+ * @return The number of rows of the class.
+ *
+ * @code
+ *   // Example usage:
+ *   const int *rows;
+ *   int count = datasetClassRows(&dataset, 1, &rows);
+ * @endcode
+ */
+int datasetClassRows(const dataset_t *dataset, int class, const int **rows)
+{
+    *rows = &dataset->byClass[dataset->partition[class]];
+
+    return dataset->partition[class + 1] - dataset->partition[class];
+}
+
+/**
+ * @brief Get a columnar view of the features of a dataset.
+ *
+ * @param dataset A pointer to the 'dataset_t' structure.
+ * @param view    A pointer to the 'colData_t' structure receiving the view, without classes, for
+ *                classifyColumnBatch and the other columnar functions that ignore classes.
+ *
+ * @code
+ *   // Example usage:
+ *   colData_t view;
+ *   datasetColumns(&dataset, &view);
+ *   classifyColumnBatch(&view, 0, view.rows, &model, predicted);
+ * @endcode
+ */
+void datasetColumns(const dataset_t *dataset, colData_t *view)
+{
+    view->rows = dataset->rows;
+    view->cols = dataset->cols;
+    view->stride = dataset->stride;
+    view->columns = dataset->columns;
+    view->class = NULL;
+}
+
+/**
+ * @brief Gather dataset rows by index into a columnar batch.
+ *
+ * This function is gatherColumnBatch for datasets: features are copied column by column, and the
+ * compact classes are widened to the int classes of 'colData_t'.
+ *
+ * @param dataset A pointer to the 'dataset_t' structure.
+ * @param indices An array of 'count' row indices, e.g. drawn with nextSampleBatch.
+ * @param count   The number of rows to gather.
+ * @param batch   A pointer to a 'colData_t' batch with 'dataset->cols' columns of at least 'count'
+ *                rows and a class column, e.g. from acquireBatch.
+ *
+ * @code
+ *   // Example usage:
+ *   colData_t *batch = acquireBatch(&pool);
+ *   gatherDatasetBatch(&dataset, indices, nextSampleBatch(&sampler, indices, BATCH_SIZE), batch);
+ *   accumulateColumnCenters(batch, 0, batch->rows, &model, sums, counts);
+ *   releaseBatch(&pool, batch);
+ * @endcode
+ */
+void gatherDatasetBatch(const dataset_t *dataset, const int indices[], int count, colData_t *batch)
+{
+    for(int feature=0; feature<dataset->cols; feature++)
+    {
+        const float *column = &dataset->columns[feature * dataset->stride];
+        float *target = &batch->columns[feature * batch->stride];
+
+        for(int index=0; index<count; index++)
+        {
+            target[index] = column[indices[index]];
+        }
+    }
+
+    for(int index=0; index<count; index++)
+    {
+        batch->class[index] = datasetClass(dataset, indices[index]);
+    }
+
+    batch->rows = count;
+}
+
+/**
+ * @brief Get the arena size needed by a batch pool.
+ *
+ * @param buffers   The number of batches.
+ * @param batchRows The number of rows of every batch.
+ * @param cols      The number of feature columns.
+ *
+ * @return The number of arena bytes initBatchPool takes.
+ *
+ * @code
+ *   // Example usage:
+ *   size_t bytes = datasetBytes(rows, 16, 3) + batchPoolBytes(4, BATCH_SIZE, 16);
+ * @endcode
+ */
+size_t batchPoolBytes(int buffers, int batchRows, int cols)
+{
+    return ARENA_ROUND((size_t)buffers * sizeof(colData_t))
+         + ARENA_ROUND((size_t)buffers * sizeof(colData_t *))
+         + ((size_t)buffers * (ARENA_ROUND((size_t)cols * (size_t)DATASET_STRIDE(batchRows) * sizeof(float))
+                             + ARENA_ROUND((size_t)batchRows * sizeof(int))));
+}
+
+/**
+ * @brief Initialize a pool of reusable columnar batches in an arena.
+ *
+ * @param pool      A pointer to the 'batchPool_t' structure to initialize.
+ * @param arena     A pointer to the 'arena_t' structure the storage comes from.
+ * @param buffers   The number of batches.
+ * @param batchRows The number of rows of every batch.
+ * @param cols      The number of feature columns.
+ *
+ * @return 0 on success, -1 if the arena is too small.
+ *
+ * @code
+ *   // Example usage:
+ *   batchPool_t pool;
+ *   initBatchPool(&pool, &arena, 2, BATCH_SIZE, dataset.cols);
+ * @endcode
+ */
+int initBatchPool(batchPool_t *pool, arena_t *arena, int buffers, int batchRows, int cols)
+{
+    pool->buffers = buffers;
+    pool->available = 0;
+    pool->slots = arenaAlloc(arena, (size_t)buffers * sizeof(colData_t));
+    pool->free = arenaAlloc(arena, (size_t)buffers * sizeof(colData_t *));
+
+    if((pool->slots == NULL) || (pool->free == NULL))
+    {
+        return -1;
+    }
+
+    for(int index=0; index<buffers; index++)
+    {
+        colData_t *slot = &pool->slots[index];
+
+        slot->rows = 0;
+        slot->cols = cols;
+        slot->stride = DATASET_STRIDE(batchRows);
+        slot->columns = arenaAlloc(arena, (size_t)cols * (size_t)slot->stride * sizeof(float));
+        slot->class = arenaAlloc(arena, (size_t)batchRows * sizeof(int));
+
+        if((slot->columns == NULL) || (slot->class == NULL))
+        {
+            return -1;
+        }
+
+        pool->free[pool->available++] = slot;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Take a batch from a batch pool.
+ *
+ * @param pool A pointer to the 'batchPool_t' structure.
+ *
+ * @return A pointer to a free batch, or NULL if every batch is in use.
+ *
+ * @code
+ *   // Example usage:
+ *   colData_t *batch = acquireBatch(&pool);
+ * @endcode
+ */
+colData_t *acquireBatch(batchPool_t *pool)
+{
+    return (pool->available > 0) ? pool->free[--pool->available] : NULL;
+}
+
+/**
+ * @brief Give a batch back to its batch pool.
+ *
+ * @param pool  A pointer to the 'batchPool_t' structure.
+ * @param batch A pointer to a batch taken with acquireBatch.
+ *
+ * @code
+ *   // Example usage:
+ *   releaseBatch(&pool, batch);
+ * @endcode
+ */
+void releaseBatch(batchPool_t *pool, colData_t *batch)
+{
+    pool->free[pool->available++] = batch;
+}
+#undef ARENA_ROUND
+#undef DATASET_STRIDE
+
+/**
+ * @brief Initialize a statically sized model with its training storage.
+ *
+ * A 'staticModel_t' holds a vector model of STATIC_CLASSES classes and STATIC_DIM features
+ * together with the center sums, one columnar batch of BATCH_SIZE rows and its predictions, so a
+ * whole train and classify loop runs on one static object without any heap. Its size is checked
+ * against MEMORY_BUDGET when "dknn.h" is compiled, and tools/memory_report.sh lists the RAM, flash
+ * and stack each configuration takes.
+ *
+ * @param staticModel A pointer to the 'staticModel_t' structure to initialize.
+ *
+ * @code
+ *   // Example usage:
+ *   static staticModel_t staticModel;
+ *   initStaticModel(&staticModel);
+ *   // fill staticModel.columns and staticModel.class, then set staticModel.batch.rows
+ *   accumulateColumnCenters(&staticModel.batch, 0, staticModel.batch.rows, &staticModel.model, staticModel.sums, staticModel.counts);
+ *   finalizeVectorCenters(&staticModel.model, staticModel.sums, staticModel.counts);
+ *   classifyColumnBatch(&staticModel.batch, 0, staticModel.batch.rows, &staticModel.model, staticModel.predicted);
+ * @endcode
+ */
+void initStaticModel(staticModel_t *staticModel)
+{
+    initVectorModel(&staticModel->model, STATIC_CLASSES, STATIC_DIM, staticModel->centers, staticModel->sqNorms, staticModel->DPs);
+
+    for(int index=0; index<(STATIC_CLASSES * STATIC_DIM); index++)
+    {
+        staticModel->sums[index] = 0;
+    }
+    for(int index=0; index<STATIC_CLASSES; index++)
+    {
+        staticModel->counts[index] = 0;
+    }
+    for(int index=0; index<(STATIC_DIM * STATIC_STRIDE); index++)
+    {
+        staticModel->columns[index] = 0;
+    }
+
+    staticModel->batch.rows = 0;
+    staticModel->batch.cols = STATIC_DIM;
+    staticModel->batch.stride = STATIC_STRIDE;
+    staticModel->batch.columns = staticModel->columns;
+    staticModel->batch.class = staticModel->class;
+}
+
+/**
+ * @brief Take a snapshot of the hot-path counters.
+ *
+ * This function adds up the counters of every thread into 'snapshot': points classified,
+ * overconfidence circle hits, baseFunction evaluations, early exits and wins per class, and the
+ * spread and overconfidence increments of training per class. Counting is enabled by building
+ * with COUNTERS_ENABLED set to 1; otherwise it is compiled out and the snapshot is all zeros.
+ *
+ * @param snapshot A pointer to the 'hotCounters_t' structure receiving the totals.
+ *
+ * @note Every thread increments counters of its own, on cache lines of their own, so counting
+ *       adds no contention. A snapshot taken while other threads classify may miss their latest
+ *       increments. While COUNTERS_THREADS - 1 threads hold counters, further threads share the
+ *       last ones and increment them atomically; releaseHotCounters hands a slot back.
+ * @note Only classifyVectorPoint, classifySparsePoint and classifyBitPoint stop at a class of full
+ *       confidence. classifyDataPoint reports the confidence of every class and classifyColumnBatch
+ *       scores whole tiles class by class, so their points never count as early exits.
+ *
+ * @code
+ *   // Example usage:
+ *   hotCounters_t counters;
+ *   snapshotHotCounters(&counters);
+ *   // counters.earlyExits points stopped at a class of full confidence...
+ * @endcode
+ */
+void snapshotHotCounters(hotCounters_t *snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+
+#if COUNTERS_ENABLED
+    for(int slot=0; slot<COUNTERS_THREADS; slot++)
+    {
+        const hotCounters_t *counters = &counterSlots[slot].counters;
+
+        snapshot->pointsClassified += counters->pointsClassified;
+        snapshot->baseFunctionCalls += counters->baseFunctionCalls;
+        snapshot->earlyExits += counters->earlyExits;
+        for(int class=0; class<COUNTERS_CLASSES; class++)
+        {
+            snapshot->overconfidenceHits[class] += counters->overconfidenceHits[class];
+            snapshot->wins[class] += counters->wins[class];
+            snapshot->spreadUpdates[class] += counters->spreadUpdates[class];
+            snapshot->overconfidenceUpdates[class] += counters->overconfidenceUpdates[class];
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Reset the hot-path counters.
+ *
+ * This function sets the counters of every thread to zero, e.g. at the start of a measurement
+ * window. Threads keep the counters they have claimed.
+ *
+ * @note Increments made by other threads during the reset may survive it.
+ *
+ * @code
+ *   // Example usage:
+ *   resetHotCounters();
+ *   // Classify the window...
+ *   snapshotHotCounters(&counters);
+ * @endcode
+ */
+void resetHotCounters(void)
+{
+#if COUNTERS_ENABLED
+    memset(counterSlots, 0, sizeof(counterSlots));
+#endif
+}
+
+/**
+ * @brief Release the hot-path counters of the calling thread.
+ *
+ * This function hands the counter slot of the calling thread back, so a later thread can claim
+ * it. Its counts stay in the totals of snapshotHotCounters. Call it before a thread that has
+ * classified or trained exits; the thread claims a slot again if it counts afterwards.
+ *
+ * @code
+ *   // Example usage:
+ *   static void *worker(void *argument)
+ *   {
+ *       // Classify...
+ *       releaseHotCounters();
+ *       return NULL;
+ *   }
+ * @endcode
+ */
+void releaseHotCounters(void)
+{
+#if COUNTERS_ENABLED && defined(COUNTERS_LOCAL)
+    if((threadCounters != NULL) && (threadCounters != &counterSlots[COUNTERS_THREADS - 1].counters))
+    {
+        __atomic_store_n(&counterOwned[(counterSlot_t *)(void *)threadCounters - counterSlots], 0, __ATOMIC_RELEASE);
+    }
+    threadCounters = NULL;
+#endif
+}
+
+/**
+ * @brief Buffer a log message in the lock-free ring of the library.
+ *
+ * This function is a 'logSink_t' that copies 'message' into a ring buffer of LOG_SLOTS messages,
+ * which is emptied with drainLog. It never blocks: a message that finds the ring full is dropped
+ * and counted by droppedLogMessages instead of waiting for the drain. It is the default sink of
+ * builds with LOG_TO_RING set to 1, the default on microcontrollers.
+ *
+ * @param severity The severity of the message.
+ * @param message  The message, cut to LOG_MESSAGE bytes.
+ * @param context  Unused.
+ *
+ * @note With LOG_SLOTS set to 0 the ring is left out and every message is dropped.
+ *
+ * @code
+ *   // Example usage:
+ *   setLogSink(ringLogSink, NULL);
+ *   // ... classify, then from the idle loop ...
+ *   (void)drainLog(toUart, NULL, 4);
+ * @endcode
+ */
+void ringLogSink(int severity, const char *message, void *context)
+{
+#if LOG_SLOTS > 0
+    uint32_t position = LOAD_ACQUIRE(logHead);
+    logSlot_t *slot;
+
+    (void)context;
+
+    for(;;) //bounded multi-producer queue, a slot is free when its sequence number equals the position
+    {
+        uint32_t index = position & (LOG_SLOTS - 1);
+        int32_t lag;
+
+        slot = &logRing[index];
+        lag = (int32_t)((LOAD_ACQUIRE(slot->turn) + index) - position);
+        if((lag == 0) && CLAIM(logHead, position, position + 1u))
+        {
+            break;
+        }
+        if(lag < 0) //not drained yet, the ring is full
+        {
+            (void)FETCH_ADD(logDropped, 1u);
+            return;
+        }
+        if(lag != 0)
+        {
+            position = LOAD_ACQUIRE(logHead);
+        }
+    }
+
+    slot->severity = severity;
+    (void)snprintf(slot->text, sizeof(slot->text), "%s", message);
+    STORE_RELEASE(slot->turn, (position + 1u) - (position & (LOG_SLOTS - 1)));
+#else
+    (void)severity;
+    (void)message;
+    (void)context;
+    (void)FETCH_ADD(logDropped, 1u);
+#endif
+}
+
+/**
+ * @brief Route diagnostics to a sink.
+ *
+ * This function sets the callback that receives every diagnostic message of the library, e.g.
+ * the decisions of classifyDataPoint and the warnings of dropIncompleteBatch, with its severity.
+ * The sink is called on the thread that logs, so it must not block if classification must not.
+ * By default, and after setLogSink(NULL, NULL), messages are printed to stdout on hosted builds
+ * and buffered by ringLogSink on microcontrollers, as selected by LOG_TO_RING.
+ *
+ * @param sink    The callback receiving messages, or NULL for the default sink.
+ * @param context A pointer handed to every call of 'sink'.
+ *
+ * @note Set the sink before classification starts, it is not synchronized with logging threads.
+ *
+ * @code
+ *   // Example usage:
+ *   static void toUart(int severity, const char *message, void *context)
+ *   {
+ *       uartWriteLine(message);
+ *   }
+ *   setLogSink(toUart, NULL);
+ * @endcode
+ */
+void setLogSink(logSink_t sink, void *context)
+{
+    logSink = (sink != NULL) ? sink : LOG_DEFAULT_SINK;
+    logContext = context;
+}
+
+/**
+ * @brief Set the most verbose severity that is logged.
+ *
+ * This function drops every message less severe than 'severity' before it is formatted, so
+ * disabled diagnostics cost one comparison.
+ *
+ * @param severity LOG_ERROR, LOG_WARNING, LOG_INFO (default) or LOG_DEBUG.
+ *
+ * @code
+ *   // Example usage:
+ *   setLogLevel(LOG_WARNING); // Decisions of classifyDataPoint are not logged anymore.
+ * @endcode
+ */
+void setLogLevel(int severity)
+{
+    logLevel = severity;
+}
+
+/**
+ * @brief Log the data points classified by classifyDataPoint one in 'every'.
+ *
+ * This function sets the sampling period of per data point diagnostics, so verbose per-class
+ * output can stay on in production at a fraction of its cost. Warnings and errors are not
+ * sampled.
+ *
+ * @param every The sampling period, 1 (default) or 0 to log every data point.
+ *
+ * @code
+ *   // Example usage:
+ *   setLogLevel(LOG_DEBUG);
+ *   setLogSampling(1000); // Confidence of every class for one data point in 1000.
+ * @endcode
+ */
+void setLogSampling(uint32_t every)
+{
+    logEvery = every;
+}
+
+/**
+ * @brief Hand the messages buffered in the log ring to a sink.
+ *
+ * This function pops up to 'maxMessages' messages from the ring buffer of ringLogSink in the order
+ * they were logged and calls 'sink' for each of them. Producers are never blocked by it. On hosts,
+ * startLogDrain of "dknn_io.h" calls it from a background thread; on microcontrollers, call it
+ * from the idle loop.
+ *
+ * @param sink        The callback receiving the messages.
+ * @param context     A pointer handed to every call of 'sink'.
+ * @param maxMessages The maximum number of messages to pop, 0 for all buffered ones.
+ *
+ * @return The number of messages handed to 'sink'.
+ *
+ * @note Only one thread may drain the ring at a time.
+ *
+ * @code
+ *   // Example usage:
+ *   while(1)
+ *   {
+ *       // ... classify ...
+ *       (void)drainLog(toUart, NULL, 4); // At most four lines per loop.
+ *   }
+ * @endcode
+ */
+int drainLog(logSink_t sink, void *context, int maxMessages)
+{
+    int drained = 0;
+
+#if LOG_SLOTS > 0
+    while((maxMessages <= 0) || (drained < maxMessages))
+    {
+        uint32_t position = logTail;
+        uint32_t index = position & (LOG_SLOTS - 1);
+        logSlot_t *slot = &logRing[index];
+
+        if((LOAD_ACQUIRE(slot->turn) + index) != (position + 1u)) //not written yet, the ring is empty
+        {
+            break;
+        }
+
+        sink(slot->severity, slot->text, context);
+        logTail = position + 1u;
+        STORE_RELEASE(slot->turn, (position + LOG_SLOTS) - index);
+        drained++;
+    }
+#else
+    (void)sink;
+    (void)context;
+    (void)maxMessages;
+#endif
+
+    return drained;
+}
+
+/**
+ * @brief Get the number of log messages dropped because the ring buffer was full.
+ *
+ * @return The number of dropped messages since the start of the program.
+ *
+ * @code
+ *   // Example usage:
+ *   if(droppedLogMessages() > 0)
+ *   {
+ *       // Drain more often or raise LOG_SLOTS...
+ *   }
+ * @endcode
+ */
+uint32_t droppedLogMessages(void)
+{
+    return LOAD_ACQUIRE(logDropped);
+}
@@ -24,6 +24,9 @@
 #ifndef DML_DKNN_H
 #define DML_DKNN_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 // Dilution Parameters -----------------------------------------------------------
 #define SPREAD 					(1.442)  	//default value (1/0.69) which is (1/ln(2))
 #define OVERCONFIDENCE 			(10.000) 	//default value 1 (bit)
@@ -33,7 +36,9 @@
 
 // Hyper Parameters --------------------------------------------------------------
 #define EPOCH 					(1000)	    //default value 1000
+#ifndef BATCH_SIZE
 #define BATCH_SIZE				(50)	    //default value 50
+#endif
 
 typedef struct dataPointType
 {
@@ -59,6 +64,7 @@ void initClassCenter(classCenter_t *class);
 int dropIncompleteBatch(dataPoint_t *dataPoint);
 void modifyDilutionPars(dilPar_t DP[], int class, float distance);
 void setCircleCenters(dataPoint_t dataPack[], classCenter_t classCenter[], int *points[]);
+void setBatchCircleCenters(const dataPoint_t dataPack[], int count, classCenter_t classCenter[], int *points[]);
 void setWeightedCircleCenters(dataPoint_t dataPack[], classCenter_t classCenter[], int *points[]);
 float square(float baseNumber);
 float calcDistance(dataPoint_t one, classCenter_t classCenter);
@@ -66,4 +72,334 @@ float baseFunction(float distance, dilPar_t dilutionPars);
 int checkOverConfidenceCircle(float distance, dilPar_t dilutionPars);
 int classifyDataPoint(dataPoint_t *dataPoint, dilPar_t DPs[], classCenter_t CCs[], int argNum);
 
+
+// Binary Feature Mode -----------------------------------------------------------
+#define BIT_FEATURES            (256)       //default value 256 bits per fingerprint
+#define BIT_WORDS               ((BIT_FEATURES + 63) / 64)
+
+typedef struct bitPointType
+{
+    uint64_t bits[BIT_WORDS];
+    int class;
+} bitPoint_t;
+
+typedef struct bitCenterType
+{
+    uint64_t bits[BIT_WORDS];
+} bitCenter_t;
+
+typedef struct bitVoteType
+{
+    uint32_t ones[BIT_FEATURES];
+    uint32_t total;
+} bitVote_t;
+
+void initBitCenter(bitCenter_t *class, bitVote_t *votes);
+void setBitCircleCenters(bitPoint_t dataPack[], bitCenter_t classCenter[], bitVote_t votes[], int argNum);
+void setBitBatchCenters(const bitPoint_t dataPack[], int count, bitCenter_t classCenter[], bitVote_t votes[], int argNum);
+int popCount64(uint64_t word);
+float calcHammingDistance(const bitPoint_t *one, const bitCenter_t *classCenter);
+int classifyBitPoint(const bitPoint_t *dataPoint, dilPar_t DPs[], bitCenter_t CCs[], int argNum);
+
+
+// Vector Feature Mode -----------------------------------------------------------
+#define ZSCORE_MIN_VARIANCE     (1e-30)     //default value 1e-30, smallest variance a z-score weight is derived from
+
+typedef struct vectorModelType
+{
+    int classes;
+    int dim;
+    float *centers;     //classes x dim, row-major
+    float *sqNorms;     //squared norm of each center
+    dilPar_t *DPs;
+    float *weights;     //per-dimension distance weights, NULL for unweighted
+} vecModel_t;
+
+typedef struct csrMatrixType
+{
+    int rows;
+    int cols;
+    const int *rowPtr;  //rows + 1 offsets into colIdx and values
+    const int *colIdx;
+    const float *values;
+    const int *class;   //class of each row, NULL for queries
+} csrMatrix_t;
+
+void initVectorModel(vecModel_t *model, int classes, int dim, float centers[], float sqNorms[], dilPar_t DPs[]);
+void updateCenterNorms(vecModel_t *model);
+void accumulateVectorCenters(const float dataPack[], const int class[], int rows, const vecModel_t *model, float sums[], float counts[]);
+void accumulateSparseCenters(const csrMatrix_t *dataPack, const vecModel_t *model, float sums[], float counts[]);
+void finalizeVectorCenters(vecModel_t *model, const float sums[], const float counts[]);
+float calcVectorDistance(const float *one, const vecModel_t *model, int class);
+float calcSparseDistance(const csrMatrix_t *data, int row, const vecModel_t *model, int class);
+void modifyVectorDilutionPars(const float dataPack[], const int class[], int rows, vecModel_t *model);
+void modifySparseDilutionPars(const csrMatrix_t *dataPack, vecModel_t *model);
+int classifyVectorPoint(const float *dataPoint, const vecModel_t *model);
+int classifySparsePoint(const csrMatrix_t *data, int row, const vecModel_t *model);
+void accumulateFeatureMoments(const float dataPack[], int rows, int dim, double means[], double sqDevs[], double *count);
+void setZScoreWeights(vecModel_t *model, float weights[], const double sqDevs[], double count);
+void foldNormalization(vecModel_t *model, const float offset[], const float scale[], float weights[]);
+
+
+// Columnar Feature Mode ---------------------------------------------------------
+#define COLUMN_TILE             (64)        //default value 64 data points classified together
+
+typedef struct columnDataType
+{
+    int rows;
+    int cols;
+    int stride;         //floats between the starts of two columns, at least rows
+    float *columns;     //cols x stride floats, one column per feature
+    int *class;         //class of each row, NULL for queries
+} colData_t;
+
+void accumulateColumnCenters(const colData_t *dataPack, int first, int rows, const vecModel_t *model, float sums[], float counts[]);
+void modifyColumnDilutionPars(const colData_t *dataPack, int first, int rows, vecModel_t *model);
+void classifyColumnBatch(const colData_t *data, int first, int rows, const vecModel_t *model, int predicted[]);
+
+
+// Streaming Training ------------------------------------------------------------
+#define STREAM_TRAINER_DOUBLES(classes, dim)    ((classes) * ((3 * (dim)) + 2 + MAP_RESOLUTION))
+
+typedef struct streamTrainerType
+{
+    vecModel_t *model;
+    double *sums;           //classes x dim running sums, pass one
+    double *counts;         //classes
+    double *lower;          //classes x dim bounding box, pass one
+    double *upper;
+    double *maxDistance;    //classes, bound on the distance of a point to its own center
+    double *histogram;      //classes x MAP_RESOLUTION distance counts, pass two
+} streamTrainer_t;
+
+void initStreamTrainer(streamTrainer_t *trainer, vecModel_t *model, double workspace[]);
+void streamCenterPass(streamTrainer_t *trainer, const colData_t *batch);
+void finishCenterPass(streamTrainer_t *trainer);
+void streamDilutionPass(streamTrainer_t *trainer, const colData_t *batch);
+void finishDilutionPass(streamTrainer_t *trainer, int epochs);
+
+
+// Coreset Sampling --------------------------------------------------------------
+#define CORESET_SIZE            (256)       //default value 256 points kept per class
+#define CORESET_FLOATS(classes, dim, capacity)  ((classes) * (capacity) * (dim))
+#define CORESET_DOUBLES(classes, dim)           ((classes) * ((dim) + 2))
+
+typedef struct coresetType
+{
+    int classes;
+    int dim;
+    int capacity;       //points kept per class
+    float *points;      //classes x capacity x dim, row-major
+    double *sums;       //classes x dim, exact sums of every offered point
+    double *sqNorms;    //classes, exact sums of squared norms of every offered point
+    double *seen;       //classes, points offered
+    uint64_t random;
+} coreset_t;
+
+void initCoreset(coreset_t *coreset, int classes, int dim, int capacity, uint64_t seed, float points[], double stats[]);
+void offerCoresetBatch(coreset_t *coreset, const colData_t *batch);
+int coresetKept(const coreset_t *coreset, int class);
+float coresetWeight(const coreset_t *coreset, int class);
+float coresetCenterBound(const coreset_t *coreset, int class, float delta);
+void trainOnCoreset(const coreset_t *coreset, streamTrainer_t *trainer, int epochs);
+
+
+// Batch Sampling ----------------------------------------------------------------
+#define SAMPLER_BLOCK           (1024)      //default value 1024 rows shuffled together, about a cache way
+#define SAMPLER_BALANCED        (0)         //every class gets the same share of a batch
+#define SAMPLER_STRATIFIED      (1)         //every class gets its share of the data
+#define SAMPLER_INTS(classes, rows)     ((rows) + ((rows) / SAMPLER_BLOCK) + (7 * (classes)) + 3)
+
+typedef struct batchSamplerType
+{
+    int classes;
+    int rows;
+    int mode;
+    int rotation;       //class that gets the first extra row of the next balanced batch
+    int *order;         //rows, row indices grouped by class, shuffled blockwise
+    int *blocks;        //shuffled block order of every class
+    int *classStart;    //classes + 1 offsets into order
+    int *blockStart;    //classes + 1 offsets into blocks
+    int *cursorBlock;   //classes, position in blocks
+    int *cursorRow;     //classes, position in the current block
+    int64_t *credit;    //classes, stratified share carried to the next batch, in units of 1 / rows
+    uint64_t random;
+} sampler_t;
+
+void initBatchSampler(sampler_t *sampler, const int class[], int rows, int classes, int mode, uint64_t seed, int workspace[]);
+int nextSampleBatch(sampler_t *sampler, int indices[], int batchRows);
+void gatherDataPoints(const dataPoint_t source[], const int indices[], int count, dataPoint_t dataPack[]);
+void gatherColumnBatch(const colData_t *source, const int indices[], int count, colData_t *batch);
+
+
+// Batch Assembly ----------------------------------------------------------------
+typedef struct batchAssemblerType
+{
+    dataPoint_t staging[BATCH_SIZE];    //data points straddling two chunks
+    int staged;
+    const dataPoint_t *chunk;
+    int remaining;
+} assembler_t;
+
+void initBatchAssembler(assembler_t *assembler);
+void feedBatchAssembler(assembler_t *assembler, const dataPoint_t chunk[], int count);
+int nextAssembledBatch(assembler_t *assembler, const dataPoint_t **batch);
+int flushBatchAssembler(assembler_t *assembler, const dataPoint_t **batch);
+
+
+// Arena and Datasets ------------------------------------------------------------
+#define ARENA_ALIGN             (64)        //default value 64 bytes, one cache line
+#define DATASET_UNLABELED       (-1)        //class of rows without a label
+
+typedef struct arenaType
+{
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} arena_t;
+
+typedef struct datasetType
+{
+    int rows;
+    int cols;
+    int stride;             //rows rounded up to a whole cache line of floats, padding is zero
+    int classes;
+    int classBytes;         //1 if classes fit in uint8_t, 2 for uint16_t
+    float *columns;         //cols columns of stride floats
+    void *class;            //rows compact class identifiers, all ones for unlabeled rows
+    int *partition;         //classes + 1 offsets into byClass
+    int *byClass;           //labeled row indices grouped by class, ascending within a class
+} dataset_t;
+
+typedef struct batchPoolType
+{
+    int buffers;
+    int available;
+    colData_t *slots;       //buffers batches of batchRows rows
+    colData_t **free;       //stack of the available batches
+} batchPool_t;
+
+void initArena(arena_t *arena, void *memory, size_t size);
+void *arenaAlloc(arena_t *arena, size_t bytes);
+size_t datasetBytes(int rows, int cols, int classes);
+int initDataset(dataset_t *dataset, arena_t *arena, int rows, int cols, int classes);
+void setDatasetRow(dataset_t *dataset, int row, const float features[], int class);
+void loadDatasetPoints(dataset_t *dataset, const dataPoint_t points[], int count);
+int datasetClass(const dataset_t *dataset, int row);
+void indexDatasetClasses(dataset_t *dataset);
+int datasetClassRows(const dataset_t *dataset, int class, const int **rows);
+void datasetColumns(const dataset_t *dataset, colData_t *view);
+void gatherDatasetBatch(const dataset_t *dataset, const int indices[], int count, colData_t *batch);
+size_t batchPoolBytes(int buffers, int batchRows, int cols);
+int initBatchPool(batchPool_t *pool, arena_t *arena, int buffers, int batchRows, int cols);
+colData_t *acquireBatch(batchPool_t *pool);
+void releaseBatch(batchPool_t *pool, colData_t *batch);
+
+
+// Static Configuration ----------------------------------------------------------
+#ifndef STATIC_CLASSES
+#define STATIC_CLASSES          (3)         //default value 3 classes
+#endif
+#ifndef STATIC_DIM
+#define STATIC_DIM              (2)         //default value 2 features, like 'dataPoint_t'
+#endif
+#ifndef MEMORY_BUDGET
+#define MEMORY_BUDGET           (32768)     //default value 32 KiB of RAM on the smallest parts
+#endif
+#define STATIC_STRIDE           (((BATCH_SIZE) + 15) & ~15)
+
+typedef struct staticModelType
+{
+    vecModel_t model;
+    colData_t batch;    //one batch of BATCH_SIZE rows, filled by the caller
+    float centers[STATIC_CLASSES * STATIC_DIM];
+    float sqNorms[STATIC_CLASSES];
+    dilPar_t DPs[STATIC_CLASSES];
+    float sums[STATIC_CLASSES * STATIC_DIM];
+    float counts[STATIC_CLASSES];
+    float columns[STATIC_DIM * STATIC_STRIDE];
+    int class[STATIC_STRIDE];
+    int predicted[STATIC_STRIDE];
+} staticModel_t;
+
+typedef char staticBudgetCheck_t[(sizeof(staticModel_t) <= MEMORY_BUDGET) ? 1 : -1]; //does not compile if the static model is over budget
+
+void initStaticModel(staticModel_t *staticModel);
+
+
+// Random Projection -------------------------------------------------------------
+#define PROJECTION_MAX_DIM      (64)        //default value 64 projected features
+#define PROJECTION_TILE         (8)         //default value 8 data points projected together
+
+typedef struct randomProjectionType
+{
+    uint32_t seed;
+    int inDim;
+    int outDim;
+    float scale;
+    int *colPtr;        //inDim + 1 offsets into entries
+    int16_t *entries;   //output feature, or its bitwise complement for a negative sign
+} projection_t;
+
+int initRandomProjection(projection_t *proj, uint32_t seed, int inDim, int outDim, int colPtr[], int16_t entries[]);
+void projectVectorBatch(const float dataPack[], int rows, const projection_t *proj, float projected[]);
+void projectSparsePoint(const csrMatrix_t *data, int row, const projection_t *proj, float projected[]);
+void classifyProjectedBatch(const float dataPack[], int rows, const projection_t *proj, const vecModel_t *model, int predicted[]);
+
+
+// Hot-Path Counters -------------------------------------------------------------
+#ifndef COUNTERS_ENABLED
+#define COUNTERS_ENABLED        (0)         //default value 0, counting compiles out of every function
+#endif
+#ifndef COUNTERS_THREADS
+#define COUNTERS_THREADS        (64)        //default value 64 counter slots, the last shared by threads beyond the rest, 1 for single-threaded targets
+#endif
+#ifndef COUNTERS_CLASSES
+#define COUNTERS_CLASSES        (16)        //default value 16 classes counted one by one, higher ones only in the totals
+#endif
+
+typedef struct hotCountersType
+{
+    uint64_t pointsClassified;
+    uint64_t baseFunctionCalls;
+    uint64_t earlyExits;                                //vector, sparse and bit points stopped at a class of full confidence
+    uint64_t overconfidenceHits[COUNTERS_CLASSES];      //distances inside the overconfidence circle of the class
+    uint64_t wins[COUNTERS_CLASSES];
+    uint64_t spreadUpdates[COUNTERS_CLASSES];           //training steps that grew the spread of the class
+    uint64_t overconfidenceUpdates[COUNTERS_CLASSES];   //training steps that grew the overconfidence of the class
+} hotCounters_t;
+
+void snapshotHotCounters(hotCounters_t *snapshot);
+void resetHotCounters(void);
+void releaseHotCounters(void);
+
+
+// Diagnostics -------------------------------------------------------------------
+#ifndef LOG_SLOTS
+#define LOG_SLOTS               (32)        //default value 32 buffered messages, a power of two, 0 leaves the ring out
+#endif
+#ifndef LOG_TO_RING
+#if defined(__linux__) || defined(__APPLE__) || defined(_WIN32)
+#define LOG_TO_RING             (0)         //hosted builds print messages to stdout by default
+#else
+#define LOG_TO_RING             (1)         //microcontrollers buffer messages in the ring until drainLog
+#endif
+#endif
+#ifndef LOG_MESSAGE
+#define LOG_MESSAGE             (96)        //default value 96 bytes per message, longer ones are cut
+#endif
+#define LOG_ERROR               (0)
+#define LOG_WARNING             (1)
+#define LOG_INFO                (2)         //default level, one line per classified data point
+#define LOG_DEBUG               (3)         //confidence of every class
+
+typedef void (*logSink_t)(int severity, const char *message, void *context);
+
+void ringLogSink(int severity, const char *message, void *context);
+void setLogSink(logSink_t sink, void *context);
+void setLogLevel(int severity);
+void setLogSampling(uint32_t every);
+int drainLog(logSink_t sink, void *context, int maxMessages);
+uint32_t droppedLogMessages(void);
+
 #endif //DML_DKNN_H
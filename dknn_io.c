@@ -0,0 +1,2231 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           dknn_io.c
+ * Date:                30th November 2023
+ *
+ * Description: Source file for the data loading part of the library "dknn.h". Loads training and
+                query data from files into aligned columnar buffers ('colData_t') that the columnar
+                functions of "dknn.c" consume directly. Requires a POSIX environment.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
+#include "dknn_io.h"
+#include "dknn_probes.h"
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CSV_MAX_THREADS     (64)
+#define CSV_TOKEN_LENGTH    (128)
+
+typedef struct csvJobType
+{
+    const char *begin;
+    const char *end;
+    int firstRow;
+    int rowsWritten;
+    int badClasses;     //class fields that are not an int
+    int totalCols;
+    colData_t *data;
+    const csvOptions_t *opts;
+} csvJob_t;
+
+static const double powersOfTen[23] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int lowestBit(uint64_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#else
+    int bit = 0;
+
+    while((mask & 1u) == 0)
+    {
+        mask >>= 1;
+        bit++;
+    }
+
+    return bit;
+#endif
+}
+
+static uint64_t byteMask(const char *block, const char *end, char first, char second) //bit i set if block[i] is 'first' or 'second'
+{
+    uint64_t mask = 0;
+
+#if defined(__AVX2__)
+    if((end - block) >= 64)
+    {
+        __m256i firstBytes = _mm256_set1_epi8(first);
+        __m256i secondBytes = _mm256_set1_epi8(second);
+
+        for(int half=0; half<2; half++)
+        {
+            __m256i bytes = _mm256_loadu_si256((const __m256i *)(const void *)(block + (32 * half)));
+            __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, firstBytes), _mm256_cmpeq_epi8(bytes, secondBytes));
+
+            mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hits) << (32 * half);
+        }
+
+        return mask;
+    }
+#elif defined(__SSE2__)
+    if((end - block) >= 64)
+    {
+        __m128i firstBytes = _mm_set1_epi8(first);
+        __m128i secondBytes = _mm_set1_epi8(second);
+
+        for(int quarter=0; quarter<4; quarter++)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(const void *)(block + (16 * quarter)));
+            __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(bytes, firstBytes), _mm_cmpeq_epi8(bytes, secondBytes));
+
+            mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(hits) << (16 * quarter);
+        }
+
+        return mask;
+    }
+#endif
+
+    for(int index=0; (index < 64) && ((block + index) < end); index++)
+    {
+        if((block[index] == first) || (block[index] == second))
+        {
+            mask |= ((uint64_t)1 << index);
+        }
+    }
+
+    return mask;
+}
+
+static int isBlank(char character)
+{
+    return ((character == ' ') || (character == '\t') || (character == '\r') || (character == '"')) ? 1 : 0;
+}
+
+static float parseFallback(const char *begin, const char *end)
+{
+    char token[CSV_TOKEN_LENGTH];
+    size_t length = (size_t)(end - begin);
+    char *text = (length < sizeof(token)) ? token : malloc(length + 1);
+    char *stop;
+    float value;
+
+    if(text == NULL)
+    {
+        return NAN;
+    }
+
+    memcpy(text, begin, length);
+    text[length] = '\0';
+    value = strtof(text, &stop);
+    while((*stop != '\0') && isBlank(*stop))
+    {
+        stop++;
+    }
+    if((stop == text) || (*stop != '\0')) //no number, or text after it
+    {
+        value = NAN;
+    }
+
+    if(text != token)
+    {
+        free(text);
+    }
+
+    return value;
+}
+
+/**
+ * Parses a decimal field into the nearest float. Fields of at most 19 significant digits with a
+ * decimal exponent within +-22 are converted exactly in double precision (Clinger's fast path)
+ * and then rounded to float. That second rounding can only go wrong when the double lands
+ * exactly halfway between two floats or in the subnormal range, so those cases, as well as
+ * anything unusual (inf, nan, hex, long mantissas), are handed to strtof.
+ */
+static float parseFloatField(const char *begin, const char *end)
+{
+    const char *cursor;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int negative = 0;
+    int truncated = 0;
+    int seenDigit = 0;
+
+    while((begin < end) && isBlank(*begin))
+    {
+        begin++;
+    }
+    while((end > begin) && isBlank(end[-1]))
+    {
+        end--;
+    }
+    if(begin == end)
+    {
+        return NAN;
+    }
+
+    cursor = begin;
+    if((*cursor == '-') || (*cursor == '+'))
+    {
+        negative = (*cursor == '-') ? 1 : 0;
+        cursor++;
+    }
+
+    for(; (cursor < end) && (*cursor >= '0') && (*cursor <= '9'); cursor++) //integer part
+    {
+        seenDigit = 1;
+        if(digits < 19)
+        {
+            mantissa = (mantissa * 10u) + (uint64_t)(*cursor - '0');
+            digits += (mantissa != 0) ? 1 : 0;
+        }
+        else
+        {
+            exponent++;
+            truncated |= (*cursor != '0') ? 1 : 0;
+        }
+    }
+
+    if((cursor < end) && (*cursor == '.')) //fraction part
+    {
+        for(cursor++; (cursor < end) && (*cursor >= '0') && (*cursor <= '9'); cursor++)
+        {
+            seenDigit = 1;
+            if(digits < 19)
+            {
+                mantissa = (mantissa * 10u) + (uint64_t)(*cursor - '0');
+                digits += (mantissa != 0) ? 1 : 0;
+                exponent--;
+            }
+            else
+            {
+                truncated |= (*cursor != '0') ? 1 : 0;
+            }
+        }
+    }
+
+    if(seenDigit && (cursor < end) && ((*cursor == 'e') || (*cursor == 'E'))) //exponent part
+    {
+        int expNegative = 0;
+        int expValue = 0;
+
+        cursor++;
+        if((cursor < end) && ((*cursor == '-') || (*cursor == '+')))
+        {
+            expNegative = (*cursor == '-') ? 1 : 0;
+            cursor++;
+        }
+        if((cursor == end) || (*cursor < '0') || (*cursor > '9'))
+        {
+            return parseFallback(begin, end);
+        }
+        for(; (cursor < end) && (*cursor >= '0') && (*cursor <= '9'); cursor++)
+        {
+            expValue = (expValue < 10000) ? ((expValue * 10) + (*cursor - '0')) : expValue;
+        }
+        exponent += expNegative ? -expValue : expValue;
+    }
+
+    if(!seenDigit || (cursor != end) || truncated)
+    {
+        return parseFallback(begin, end);
+    }
+
+    if(mantissa == 0)
+    {
+        return negative ? (float)-0.0 : (float)0.0;
+    }
+
+    if((mantissa <= ((uint64_t)1 << 53)) && (exponent >= -22) && (exponent <= 22))
+    {
+        double value = (double)mantissa;
+        uint64_t bits;
+
+        value = (exponent < 0) ? (value / powersOfTen[-exponent]) : (value * powersOfTen[exponent]);
+        memcpy(&bits, &value, sizeof(bits));
+
+        if(((bits & 0x1FFFFFFFu) != 0x10000000u) && (value >= 1.1754943508222875e-38))
+        {
+            return negative ? -(float)value : (float)value;
+        }
+    }
+
+    return parseFallback(begin, end);
+}
+
+static int isBlankLine(const char *begin, const char *end)
+{
+    for(; begin < end; begin++)
+    {
+        if(!isBlank(*begin))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void storeField(csvJob_t *job, const char *begin, const char *end, int row, int col)
+{
+    colData_t *data = job->data;
+    int classCol = job->opts->classCol;
+
+    if(col >= job->totalCols)
+    {
+        return;
+    }
+
+    if(col == classCol)
+    {
+        float value = parseFloatField(begin, end);
+
+        if(isBlankLine(begin, end)) //missing class
+        {
+            data->class[row] = -1;
+        }
+        else if(!isnan(value) && (value == floorf(value)) && (value >= (float)INT_MIN) && (value < -(float)INT_MIN))
+        {
+            data->class[row] = (int)value;
+        }
+        else
+        {
+            data->class[row] = -1;
+            job->badClasses++;
+        }
+    }
+    else
+    {
+        int feature = ((classCol >= 0) && (col > classCol)) ? (col - 1) : col;
+
+        data->columns[((size_t)feature * (size_t)data->stride) + (size_t)row] = parseFloatField(begin, end);
+    }
+}
+
+static void finishRow(csvJob_t *job, const char *lineBegin, const char *lineEnd, int *row, int col)
+{
+    if((col == 0) && isBlankLine(lineBegin, lineEnd)) //blank lines do not produce rows
+    {
+        return;
+    }
+
+    for(col++; col < job->totalCols; col++) //missing fields
+    {
+        storeField(job, lineEnd, lineEnd, *row, col);
+    }
+    (*row)++;
+}
+
+static void *parseChunk(void *arg)
+{
+    csvJob_t *job = (csvJob_t *)arg;
+    const char *field = job->begin;
+    const char *line = job->begin;
+    int row = job->firstRow;
+    int col = 0;
+
+    for(const char *block = job->begin; block < job->end; block += 64)
+    {
+        uint64_t mask = byteMask(block, job->end, job->opts->delimiter, '\n');
+
+        while(mask != 0)
+        {
+            const char *separator = block + lowestBit(mask);
+
+            mask &= mask - 1u;
+            storeField(job, field, separator, row, col);
+
+            if(*separator == '\n')
+            {
+                finishRow(job, line, separator, &row, col);
+                col = 0;
+                line = separator + 1;
+            }
+            else
+            {
+                col++;
+            }
+            field = separator + 1;
+        }
+    }
+
+    if(field < job->end) //last line without a newline
+    {
+        storeField(job, field, job->end, row, col);
+        finishRow(job, line, job->end, &row, col);
+    }
+
+    job->rowsWritten = row - job->firstRow;
+
+    return NULL;
+}
+
+static int countLines(const char *begin, const char *end)
+{
+    int lines = 0;
+
+    for(const char *block = begin; block < end; block += 64)
+    {
+        uint64_t mask = byteMask(block, end, '\n', '\n');
+
+#if defined(__GNUC__) || defined(__clang__)
+        lines += __builtin_popcountll(mask);
+#else
+        lines += popCount64(mask);
+#endif
+    }
+
+    return lines + (((end > begin) && (end[-1] != '\n')) ? 1 : 0);
+}
+
+static const char *nextLine(const char *cursor, const char *end)
+{
+    const char *newline = memchr(cursor, '\n', (size_t)(end - cursor));
+
+    return (newline != NULL) ? (newline + 1) : end;
+}
+
+/**
+ * @brief Initialize CSV loader options.
+ *
+ * This function sets the options of the CSV loader to their defaults: comma delimiter, no header
+ * line, class in the last column (-2 is resolved to the last column when the file is opened),
+ * and one loader thread per online CPU.
+ *
+ * @param opts A pointer to the 'csvOptions_t' structure to initialize.
+ *
+ * @code
+ *   // Example usage:
+ *   csvOptions_t opts;
+ *   initCsvOptions(&opts);
+ *   opts.skipHeader = 1;
+ *   // 'opts' now describes a comma separated file with a header line.
+ * @endcode
+ */
+void initCsvOptions(csvOptions_t *opts)
+{
+    opts->delimiter = ',';
+    opts->skipHeader = 0;
+    opts->classCol = -2;
+    opts->threads = 0;
+}
+
+/**
+ * @brief Load a CSV file into aligned feature columns and a class column.
+ *
+ * This function memory-maps the file at 'path' and parses it straight into the columnar buffers
+ * of 'data', one IO_ALIGN aligned column per feature plus an int column for the classes. Field
+ * and line separators are located 64 bytes at a time with SIMD compares, and floats are parsed
+ * with a correctly rounding fast parser. Files larger than CSV_MIN_CHUNK are split at line
+ * boundaries across threads: a first pass counts the lines of each chunk, so every thread
+ * knows the rows it owns, and a second pass parses the chunks in parallel.
+ *
+ * @param path The path of the CSV file.
+ * @param opts A pointer to the 'csvOptions_t' structure describing the file.
+ * @param data A pointer to the 'colData_t' structure receiving the columns.
+ *
+ * @return Returns 0 on success, or -1 if the file cannot be read, is empty, holds a class that is
+ *         not an int or memory runs out.
+ *
+ * @note The number of columns is taken from the first data line. Missing or unparseable fields
+ *       become NaN, and missing classes become -1. Blank lines are skipped. Column padding up
+ *       to 'data->stride' is zeroed. Release the buffers with freeColumnData.
+ *
+ * @code
+ *   // Example usage:
+ *   csvOptions_t opts;
+ *   colData_t train;
+ *   initCsvOptions(&opts);
+ *   if(loadCsvColumns("train.csv", &opts, &train) == 0)
+ *   {
+ *       accumulateColumnCenters(&train, 0, train.rows, &model, sums, counts);
+ *       freeColumnData(&train);
+ *   }
+ * @endcode
+ */
+int loadCsvColumns(const char *path, const csvOptions_t *opts, colData_t *data)
+{
+    csvJob_t jobs[CSV_MAX_THREADS];
+    pthread_t threads[CSV_MAX_THREADS];
+    csvOptions_t resolved = *opts;
+    struct stat info;
+    const char *text;
+    const char *begin;
+    const char *end;
+    int fd;
+    int jobCount;
+    int totalCols = 1;
+    int capacity = 0;
+    int rows = 0;
+    int retVal = 0;
+
+    data->rows = 0;
+    data->columns = NULL;
+    data->class = NULL;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    if((fstat(fd, &info) != 0) || (info.st_size == 0))
+    {
+        (void)close(fd);
+        return -1;
+    }
+
+    text = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)close(fd);
+    if(text == MAP_FAILED)
+    {
+        return -1;
+    }
+    (void)posix_madvise((void *)text, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+
+    begin = text;
+    end = text + info.st_size;
+    if(resolved.skipHeader)
+    {
+        begin = nextLine(begin, end);
+    }
+
+    for(const char *cursor = begin; (cursor < end) && (*cursor != '\n'); cursor++) //column count of the first line
+    {
+        totalCols += (*cursor == resolved.delimiter) ? 1 : 0;
+    }
+    if(resolved.classCol == -2)
+    {
+        resolved.classCol = totalCols - 1;
+    }
+
+    jobCount = (resolved.threads > 0) ? resolved.threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if((long)jobCount > ((long)(end - begin) / CSV_MIN_CHUNK))
+    {
+        jobCount = (int)((end - begin) / CSV_MIN_CHUNK);
+    }
+    jobCount = (jobCount < 1) ? 1 : ((jobCount > CSV_MAX_THREADS) ? CSV_MAX_THREADS : jobCount);
+
+    for(int job=0; job<jobCount; job++) //split at line boundaries
+    {
+        jobs[job].begin = (job == 0) ? begin : jobs[job - 1].end;
+        jobs[job].end = (job == (jobCount - 1)) ? end : nextLine(begin + (((end - begin) / jobCount) * (job + 1)), end);
+        if(jobs[job].end < jobs[job].begin)
+        {
+            jobs[job].end = jobs[job].begin;
+        }
+        jobs[job].totalCols = totalCols;
+        jobs[job].badClasses = 0;
+        jobs[job].data = data;
+        jobs[job].opts = &resolved;
+        jobs[job].firstRow = capacity;
+        capacity += countLines(jobs[job].begin, jobs[job].end);
+    }
+
+    data->cols = totalCols - (((resolved.classCol >= 0) && (resolved.classCol < totalCols)) ? 1 : 0);
+    data->stride = (capacity + ((IO_ALIGN / (int)sizeof(float)) - 1)) & ~((IO_ALIGN / (int)sizeof(float)) - 1);
+    data->stride = (data->stride == 0) ? (IO_ALIGN / (int)sizeof(float)) : data->stride;
+
+    if(posix_memalign((void **)&data->columns, IO_ALIGN, (size_t)data->cols * (size_t)data->stride * sizeof(float)) != 0)
+    {
+        data->columns = NULL;
+        retVal = -1;
+    }
+    if((retVal == 0) && (resolved.classCol >= 0) && (resolved.classCol < totalCols))
+    {
+        if(posix_memalign((void **)&data->class, IO_ALIGN, (size_t)data->stride * sizeof(int)) != 0)
+        {
+            data->class = NULL;
+            retVal = -1;
+        }
+    }
+
+    if(retVal == 0)
+    {
+        for(int job=1; job<jobCount; job++)
+        {
+            if(pthread_create(&threads[job], NULL, parseChunk, &jobs[job]) != 0)
+            {
+                (void)parseChunk(&jobs[job]);
+                jobs[job].end = NULL; //marks a chunk that was parsed inline
+            }
+        }
+        (void)parseChunk(&jobs[0]);
+        for(int job=1; job<jobCount; job++)
+        {
+            if(jobs[job].end != NULL)
+            {
+                (void)pthread_join(threads[job], NULL);
+            }
+        }
+
+        for(int job=0; job<jobCount; job++) //close the gaps left by blank lines
+        {
+            if(jobs[job].firstRow != rows)
+            {
+                for(int feature=0; feature<data->cols; feature++)
+                {
+                    float *column = &data->columns[(size_t)feature * (size_t)data->stride];
+
+                    memmove(&column[rows], &column[jobs[job].firstRow], (size_t)jobs[job].rowsWritten * sizeof(float));
+                }
+                if(data->class != NULL)
+                {
+                    memmove(&data->class[rows], &data->class[jobs[job].firstRow], (size_t)jobs[job].rowsWritten * sizeof(int));
+                }
+            }
+            rows += jobs[job].rowsWritten;
+            retVal = (jobs[job].badClasses == 0) ? retVal : -1;
+        }
+
+        for(int feature=0; feature<data->cols; feature++) //zero the padding
+        {
+            float *column = &data->columns[(size_t)feature * (size_t)data->stride];
+
+            memset(&column[rows], 0, (size_t)(data->stride - rows) * sizeof(float));
+        }
+        for(int row=rows; (data->class != NULL) && (row < data->stride); row++)
+        {
+            data->class[row] = -1;
+        }
+        data->rows = rows;
+    }
+    if(retVal != 0)
+    {
+        freeColumnData(data);
+    }
+
+    (void)munmap((void *)text, (size_t)info.st_size);
+
+    return retVal;
+}
+
+/**
+ * @brief Release the buffers of columnar data.
+ *
+ * This function frees the feature and class columns allocated by loadCsvColumns and clears 'data'.
+ *
+ * @param data A pointer to the 'colData_t' structure to release.
+ *
+ * @code
+ *   // Example usage:
+ *   freeColumnData(&train);
+ *   // 'train' holds no rows and no buffers anymore.
+ * @endcode
+ */
+void freeColumnData(colData_t *data)
+{
+    free(data->columns);
+    free(data->class);
+    data->columns = NULL;
+    data->class = NULL;
+    data->rows = 0;
+}
+
+#define DATASET_MAGIC           "DKNNDS01"
+#define DATASET_BYTE_ORDER      (0x01020304u)
+#define DATASET_HEADER_BYTES    (2 * IO_ALIGN)
+#define DATASET_PAGE_FLOATS     (DATASET_PAGE / (int)sizeof(float))
+
+typedef struct datasetHeaderType
+{
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t cols;
+    uint64_t rows;
+    uint64_t stride;
+    uint32_t classes;
+    uint32_t chunkRows;
+    uint32_t chunks;
+    uint32_t hasClass;
+    uint64_t columnsOffset;
+    uint64_t classOffset;
+    uint64_t indexOffset;
+} dsHeader_t;
+
+static size_t chunkEntrySize(int classes, int cols) //firstRow, rows, class counts, min and max per feature
+{
+    return ((size_t)16 + ((size_t)4 * (size_t)classes) + ((size_t)8 * (size_t)cols) + 7u) & ~(size_t)7u;
+}
+
+static int checkDatasetHeader(const dsHeader_t *header, size_t fileSize) //every offset and size the mapping relies on
+{
+    uint64_t classBytes = header->hasClass ? (header->stride * sizeof(int)) : 0u;
+    size_t entrySize;
+
+    if((memcmp(header->magic, DATASET_MAGIC, sizeof(header->magic)) != 0) ||
+       (header->byteOrder != DATASET_BYTE_ORDER) ||
+       (header->cols < 1) || (header->cols > INT_MAX) || (header->classes > INT_MAX) ||
+       (header->rows > header->stride) || (header->stride > INT_MAX) ||
+       (header->chunkRows < 1) || (header->chunkRows > INT_MAX) ||
+       (header->chunks != ((header->rows + header->chunkRows - 1) / header->chunkRows)) ||
+       (header->columnsOffset < DATASET_PAGE) || ((header->columnsOffset % DATASET_PAGE) != 0))
+    {
+        return -1;
+    }
+
+    entrySize = chunkEntrySize((int)header->classes, (int)header->cols);
+    if((header->indexOffset > fileSize) || //every region lies in the file, compared by differences so nothing wraps
+       (header->classOffset > header->indexOffset) ||
+       (header->columnsOffset > header->classOffset) ||
+       (((uint64_t)header->cols * header->stride * sizeof(float)) != (header->classOffset - header->columnsOffset)) ||
+       (classBytes > (header->indexOffset - header->classOffset)) ||
+       (((uint64_t)header->chunks * entrySize) > (fileSize - header->indexOffset)))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int checkChunkIndex(const dsHeader_t *header, const uint8_t *index, size_t entrySize) //chunks cover the rows in order
+{
+    for(uint32_t chunk=0; chunk<header->chunks; chunk++)
+    {
+        uint64_t firstRow;
+        uint32_t rows;
+
+        memcpy(&firstRow, index + ((size_t)chunk * entrySize), sizeof(firstRow));
+        memcpy(&rows, index + ((size_t)chunk * entrySize) + 8, sizeof(rows));
+        if((firstRow != ((uint64_t)chunk * header->chunkRows)) ||
+           (rows != (((header->rows - firstRow) < header->chunkRows) ? (uint32_t)(header->rows - firstRow) : header->chunkRows)))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int writeAll(int fd, const void *buffer, size_t size, uint64_t offset)
+{
+    const uint8_t *bytes = buffer;
+
+    while(size > 0)
+    {
+        ssize_t done = pwrite(fd, bytes, size, (off_t)offset);
+
+        if((done < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if(done <= 0)
+        {
+            return -1;
+        }
+        bytes += done;
+        size -= (size_t)done;
+        offset += (uint64_t)done;
+    }
+
+    return 0;
+}
+
+static void resetChunkEntry(dsWriter_t *writer, int chunk)
+{
+    uint64_t firstRow = (uint64_t)chunk * (uint64_t)writer->chunkRows;
+    uint32_t rows = (uint32_t)(((writer->rows - (int)firstRow) < writer->chunkRows) ? (writer->rows - (int)firstRow) : writer->chunkRows);
+    float *min = (float *)(void *)(writer->entry + 16 + (4 * writer->classes));
+
+    memset(writer->entry, 0, writer->entrySize);
+    memcpy(writer->entry, &firstRow, sizeof(firstRow));
+    memcpy(writer->entry + 8, &rows, sizeof(rows));
+
+    for(int feature=0; feature<(2 * writer->cols); feature++) //min, then max
+    {
+        min[feature] = NAN;
+    }
+}
+
+/**
+ * @brief Start writing a dataset file from a stream of batches.
+ *
+ * This function creates a dataset file of 'rows' rows that is filled batch by batch with
+ * appendDatasetRows, so datasets larger than memory can be written in the native format. Batches
+ * go straight to their place in the column regions, and the chunk index is written as chunks
+ * complete. The header is only written by closeDatasetWriter, so an unfinished file is rejected by
+ * openDatasetFile.
+ *
+ * @param path      The path of the dataset file, overwritten if it exists.
+ * @param rows      The number of rows the file will hold.
+ * @param cols      The number of feature columns.
+ * @param classes   The number of classes, or -1 for a file without a class column.
+ * @param chunkRows The number of rows per chunk, 0 for DATASET_CHUNK_ROWS.
+ * @param writer    A pointer to the 'dsWriter_t' structure to initialize.
+ *
+ * @return Returns 0 on success, or -1 if the file cannot be created.
+ *
+ * @code
+ *   // Example usage:
+ *   dsWriter_t writer;
+ *   if(openDatasetWriter("train.dknn", 100000000, 16, 4, 0, &writer) == 0)
+ *   {
+ *       while(generateBatch(&batch) > 0)
+ *       {
+ *           (void)appendDatasetRows(&writer, &batch);
+ *       }
+ *       (void)closeDatasetWriter(&writer);
+ *   }
+ * @endcode
+ */
+int openDatasetWriter(const char *path, int rows, int cols, int classes, int chunkRows, dsWriter_t *writer)
+{
+    int64_t stride = ((int64_t)rows + (DATASET_PAGE_FLOATS - 1)) & ~(int64_t)(DATASET_PAGE_FLOATS - 1);
+
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+
+    if((rows < 0) || (rows > (INT_MAX - DATASET_PAGE_FLOATS)) || (cols < 1)) //the padded stride has to fit an int
+    {
+        return -1;
+    }
+
+    writer->rows = rows;
+    writer->cols = cols;
+    writer->hasClass = (classes >= 0) ? 1 : 0;
+    writer->classes = (classes >= 0) ? classes : 0;
+    writer->stride = (stride == 0) ? DATASET_PAGE_FLOATS : (int)stride;
+    writer->chunkRows = (chunkRows > 0) ? chunkRows : DATASET_CHUNK_ROWS;
+    writer->chunks = (int)(((int64_t)rows + writer->chunkRows - 1) / writer->chunkRows);
+    writer->columnsOffset = DATASET_PAGE;
+    writer->classOffset = writer->columnsOffset + ((uint64_t)cols * (uint64_t)writer->stride * sizeof(float));
+    writer->indexOffset = writer->classOffset + (writer->hasClass ? ((uint64_t)writer->stride * sizeof(int)) : 0u);
+    writer->entrySize = chunkEntrySize(writer->classes, cols);
+    writer->entry = malloc(writer->entrySize);
+
+    if(writer->entry != NULL)
+    {
+        writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if((writer->fd < 0) || (ftruncate(writer->fd, (off_t)(writer->indexOffset + ((uint64_t)writer->chunks * writer->entrySize))) != 0))
+    {
+        if(writer->fd >= 0)
+        {
+            (void)close(writer->fd);
+        }
+        free(writer->entry);
+        writer->entry = NULL;
+        writer->fd = -1;
+        return -1;
+    }
+
+    if(writer->chunks > 0)
+    {
+        resetChunkEntry(writer, 0);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Append a batch of rows to a dataset file.
+ *
+ * @param writer A pointer to the 'dsWriter_t' structure of an open writer.
+ * @param batch  A pointer to the 'colData_t' batch to append, with 'writer->cols' columns and a
+ *               class column if the file has one.
+ *
+ * @return Returns 0 on success, or -1 if the batch does not fit or cannot be written. After a
+ *         failure, closeDatasetWriter fails too.
+ *
+ * @code
+ *   // Example usage:
+ *   (void)appendDatasetRows(&writer, &batch);
+ * @endcode
+ */
+int appendDatasetRows(dsWriter_t *writer, const colData_t *batch)
+{
+    int rows = batch->rows;
+
+    if((writer->failed != 0) || (batch->cols != writer->cols) || (rows > (writer->rows - writer->written)) ||
+       (writer->hasClass && (batch->class == NULL)))
+    {
+        writer->failed = 1;
+        return -1;
+    }
+
+    for(int feature=0; feature<writer->cols; feature++)
+    {
+        uint64_t offset = writer->columnsOffset + ((((uint64_t)feature * (uint64_t)writer->stride) + (uint64_t)writer->written) * sizeof(float));
+
+        writer->failed |= writeAll(writer->fd, &batch->columns[(size_t)feature * (size_t)batch->stride], (size_t)rows * sizeof(float), offset);
+    }
+    if(writer->hasClass)
+    {
+        writer->failed |= writeAll(writer->fd, batch->class, (size_t)rows * sizeof(int), writer->classOffset + ((uint64_t)writer->written * sizeof(int)));
+    }
+
+    for(int start=0; (writer->failed == 0) && (start < rows); ) //chunk statistics, one chunk segment at a time
+    {
+        int row = writer->written + start;
+        int chunk = row / writer->chunkRows;
+        int64_t nextChunk = (int64_t)(chunk + 1) * writer->chunkRows;
+        int chunkEnd = (nextChunk < writer->rows) ? (int)nextChunk : writer->rows;
+        int end = ((chunkEnd - writer->written) < rows) ? (chunkEnd - writer->written) : rows;
+        uint32_t *classCounts = (uint32_t *)(void *)(writer->entry + 16);
+        float *min = (float *)(void *)(writer->entry + 16 + (4 * writer->classes));
+        float *max = min + writer->cols;
+
+        for(int index=start; writer->hasClass && (index < end); index++)
+        {
+            if((batch->class[index] >= 0) && (batch->class[index] < writer->classes))
+            {
+                classCounts[batch->class[index]]++;
+            }
+        }
+
+        for(int feature=0; feature<writer->cols; feature++)
+        {
+            const float *column = &batch->columns[(size_t)feature * (size_t)batch->stride];
+
+            for(int index=start; index<end; index++)
+            {
+                min[feature] = (isnan(min[feature]) || (column[index] < min[feature])) ? column[index] : min[feature];
+                max[feature] = (isnan(max[feature]) || (column[index] > max[feature])) ? column[index] : max[feature];
+            }
+        }
+
+        if((writer->written + end) == chunkEnd) //chunk complete
+        {
+            writer->failed |= writeAll(writer->fd, writer->entry, writer->entrySize, writer->indexOffset + ((uint64_t)chunk * writer->entrySize));
+            if((chunk + 1) < writer->chunks)
+            {
+                resetChunkEntry(writer, chunk + 1);
+            }
+        }
+
+        start = end;
+    }
+
+    writer->written += rows;
+
+    return (writer->failed == 0) ? 0 : -1;
+}
+
+/**
+ * @brief Finish a dataset file written with appendDatasetRows.
+ *
+ * This function pads the class column and writes the header, which makes the file valid.
+ *
+ * @param writer A pointer to the 'dsWriter_t' structure of an open writer, closed by the call.
+ *
+ * @return Returns 0 on success, or -1 if rows are missing or a write failed.
+ *
+ * @code
+ *   // Example usage:
+ *   if(closeDatasetWriter(&writer) != 0)
+ *   {
+ *       // The file is incomplete and openDatasetFile will reject it...
+ *   }
+ * @endcode
+ */
+int closeDatasetWriter(dsWriter_t *writer)
+{
+    int noClass[DATASET_PAGE_FLOATS];
+    uint8_t headerBytes[DATASET_PAGE];
+    dsHeader_t header;
+    int retVal = ((writer->failed == 0) && (writer->written == writer->rows)) ? 0 : -1;
+
+    if(writer->fd < 0)
+    {
+        return -1;
+    }
+
+    for(int index=0; index<DATASET_PAGE_FLOATS; index++)
+    {
+        noClass[index] = -1;
+    }
+    for(int row=writer->rows; (retVal == 0) && writer->hasClass && (row < writer->stride); row+=DATASET_PAGE_FLOATS)
+    {
+        int count = ((writer->stride - row) < DATASET_PAGE_FLOATS) ? (writer->stride - row) : DATASET_PAGE_FLOATS;
+
+        retVal |= writeAll(writer->fd, noClass, (size_t)count * sizeof(int), writer->classOffset + ((uint64_t)row * sizeof(int)));
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+    header.byteOrder = DATASET_BYTE_ORDER;
+    header.cols = (uint32_t)writer->cols;
+    header.rows = (uint64_t)writer->rows;
+    header.stride = (uint64_t)writer->stride;
+    header.classes = (uint32_t)writer->classes;
+    header.chunkRows = (uint32_t)writer->chunkRows;
+    header.chunks = (uint32_t)writer->chunks;
+    header.hasClass = (uint32_t)writer->hasClass;
+    header.columnsOffset = writer->columnsOffset;
+    header.classOffset = writer->classOffset;
+    header.indexOffset = writer->indexOffset;
+
+    memset(headerBytes, 0, sizeof(headerBytes));
+    memcpy(headerBytes, &header, sizeof(header));
+    if(retVal == 0)
+    {
+        retVal |= writeAll(writer->fd, headerBytes, sizeof(headerBytes), 0);
+    }
+
+    retVal |= (close(writer->fd) == 0) ? 0 : -1;
+    free(writer->entry);
+    writer->entry = NULL;
+    writer->fd = -1;
+
+    return retVal;
+}
+
+/**
+ * @brief Write columnar data to a dataset file.
+ *
+ * This function stores 'data' in the native dataset format: a header, one DATASET_PAGE aligned
+ * column per feature, an int class column and a chunk index. Every chunk of 'chunkRows' rows has
+ * an index entry with its class counts and the bounding box of its features, so a trainer can
+ * decide which chunks to read, skip or sample without touching their rows.
+ *
+ * @param path      The path of the dataset file, overwritten if it exists.
+ * @param data      A pointer to the 'colData_t' structure to store.
+ * @param chunkRows The number of rows per chunk, 0 for DATASET_CHUNK_ROWS.
+ *
+ * @return Returns 0 on success, or -1 if the file cannot be written.
+ *
+ * @note The number of classes is taken as the largest class in 'data' plus one. The file is
+ *       written in host byte order, and openDatasetFile rejects files of the other byte order.
+ *
+ * @code
+ *   // Example usage:
+ *   colData_t train;
+ *   if(loadCsvColumns("train.csv", &opts, &train) == 0)
+ *   {
+ *       (void)writeDatasetFile("train.dknn", &train, 0); // Parse the text once...
+ *       freeColumnData(&train);
+ *   }
+ * @endcode
+ */
+int writeDatasetFile(const char *path, const colData_t *data, int chunkRows)
+{
+    dsWriter_t writer;
+    int classes = 0;
+    int retVal;
+
+    for(int row=0; (data->class != NULL) && (row < data->rows); row++)
+    {
+        classes = (data->class[row] >= classes) ? (data->class[row] + 1) : classes;
+    }
+
+    if(openDatasetWriter(path, data->rows, data->cols, (data->class != NULL) ? classes : -1, chunkRows, &writer) != 0)
+    {
+        return -1;
+    }
+
+    retVal = appendDatasetRows(&writer, data);
+    retVal |= closeDatasetWriter(&writer);
+
+    return retVal;
+}
+
+/**
+ * @brief Open a dataset file for zero-copy access.
+ *
+ * This function memory-maps the dataset file at 'path' and points 'file->data' at the columns and
+ * class column inside the mapping, so the columnar functions of "dknn.c" can run on it directly
+ * and batches are assembled straight from the mapped pages. Pages are only read when touched.
+ *
+ * @param path The path of the dataset file.
+ * @param file A pointer to the 'dsFile_t' structure receiving the mapping.
+ *
+ * @return Returns 0 on success, or -1 if the file cannot be mapped or is not a valid dataset file.
+ *
+ * @note The mapping is private: writing to 'file->data' changes the process copy only.
+ *       Release it with closeDatasetFile.
+ *
+ * @code
+ *   // Example usage:
+ *   dsFile_t file;
+ *   if(openDatasetFile("train.dknn", &file) == 0)
+ *   {
+ *       accumulateColumnCenters(&file.data, 0, file.data.rows, &model, sums, counts);
+ *       closeDatasetFile(&file);
+ *   }
+ * @endcode
+ */
+int openDatasetFile(const char *path, dsFile_t *file)
+{
+    dsHeader_t header;
+    struct stat info;
+    uint8_t *bytes;
+    int fd;
+
+    memset(file, 0, sizeof(*file));
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    if((fstat(fd, &info) != 0) || ((size_t)info.st_size < DATASET_HEADER_BYTES))
+    {
+        (void)close(fd);
+        return -1;
+    }
+
+    file->mapSize = (size_t)info.st_size;
+    file->map = mmap(NULL, file->mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    (void)close(fd);
+    if(file->map == MAP_FAILED)
+    {
+        file->map = NULL;
+        return -1;
+    }
+
+    bytes = (uint8_t *)file->map;
+    memcpy(&header, bytes, sizeof(header));
+    file->chunkEntrySize = chunkEntrySize((int)header.classes, (int)header.cols);
+
+    if((checkDatasetHeader(&header, file->mapSize) != 0) ||
+       (checkChunkIndex(&header, bytes + header.indexOffset, file->chunkEntrySize) != 0))
+    {
+        closeDatasetFile(file);
+        return -1;
+    }
+
+    file->data.rows = (int)header.rows;
+    file->data.cols = (int)header.cols;
+    file->data.stride = (int)header.stride;
+    file->data.columns = (float *)(void *)(bytes + header.columnsOffset);
+    file->data.class = header.hasClass ? (int *)(void *)(bytes + header.classOffset) : NULL;
+    file->classes = (int)header.classes;
+    file->chunkRows = (int)header.chunkRows;
+    file->chunks = (int)header.chunks;
+    file->chunkIndex = bytes + header.indexOffset;
+
+    return 0;
+}
+
+/**
+ * @brief Get the statistics of a chunk of a dataset file.
+ *
+ * This function points 'stats' at the index entry of 'chunk'. Only the chunk index is read, the
+ * rows of the chunk are not touched.
+ *
+ * @param file  A pointer to the 'dsFile_t' structure of an open dataset file.
+ * @param chunk The index of the chunk, in [0, file->chunks).
+ * @param stats A pointer to the 'chunkStats_t' structure receiving the statistics.
+ *
+ * @code
+ *   // Example usage:
+ *   chunkStats_t stats;
+ *   for(int chunk=0; chunk<file.chunks; chunk++)
+ *   {
+ *       getChunkStats(&file, chunk, &stats);
+ *       if(stats.classCounts[2] == 0)
+ *       {
+ *           continue; // Skip chunks without samples of class 2...
+ *       }
+ *       accumulateColumnCenters(&file.data, stats.firstRow, stats.rows, &model, sums, counts);
+ *   }
+ * @endcode
+ */
+void getChunkStats(const dsFile_t *file, int chunk, chunkStats_t *stats)
+{
+    const uint8_t *entry = file->chunkIndex + ((size_t)chunk * file->chunkEntrySize);
+    uint64_t firstRow;
+    uint32_t rows;
+
+    memcpy(&firstRow, entry, sizeof(firstRow));
+    memcpy(&rows, entry + 8, sizeof(rows));
+
+    stats->firstRow = (int)firstRow;
+    stats->rows = (int)rows;
+    stats->classCounts = (const uint32_t *)(const void *)(entry + 16);
+    stats->min = (const float *)(const void *)(entry + 16 + (4 * file->classes));
+    stats->max = stats->min + file->data.cols;
+}
+
+/**
+ * @brief Close a dataset file.
+ *
+ * This function unmaps a dataset file opened with openDatasetFile and clears 'file'.
+ *
+ * @param file A pointer to the 'dsFile_t' structure to close.
+ *
+ * @code
+ *   // Example usage:
+ *   closeDatasetFile(&file);
+ *   // 'file.data' must not be used anymore.
+ * @endcode
+ */
+void closeDatasetFile(dsFile_t *file)
+{
+    if(file->map != NULL)
+    {
+        (void)munmap(file->map, file->mapSize);
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+#if defined(__linux__)
+static int ringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static void ringClose(ioRing_t *ring)
+{
+    if(ring->sqes != NULL)
+    {
+        (void)munmap(ring->sqes, ring->sqesSize);
+    }
+    if((ring->cqMap != NULL) && (ring->cqMap != ring->sqMap))
+    {
+        (void)munmap(ring->cqMap, ring->cqMapSize);
+    }
+    if(ring->sqMap != NULL)
+    {
+        (void)munmap(ring->sqMap, ring->sqMapSize);
+    }
+    if(ring->fd >= 0)
+    {
+        (void)close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static int ringSetup(ioRing_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    uint8_t *sq;
+    uint8_t *cq;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries; //one completion slot per possible read in flight, so the queue never overflows
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if(ring->fd < 0)
+    {
+        ring->fd = -1;
+        return -1;
+    }
+
+    ring->sqMapSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+    ring->cqMapSize = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sqMapSize = (ring->cqMapSize > ring->sqMapSize) ? ring->cqMapSize : ring->sqMapSize;
+        ring->cqMapSize = ring->sqMapSize;
+    }
+
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sqMap == MAP_FAILED)
+    {
+        ring->sqMap = NULL;
+        ringClose(ring);
+        return -1;
+    }
+    ring->cqMap = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sqMap :
+                  mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if(ring->cqMap == MAP_FAILED)
+    {
+        ring->cqMap = NULL;
+        ringClose(ring);
+        return -1;
+    }
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        ringClose(ring);
+        return -1;
+    }
+
+    sq = (uint8_t *)ring->sqMap;
+    cq = (uint8_t *)ring->cqMap;
+    ring->sqHead = (unsigned *)(void *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(void *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(void *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(void *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(void *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(void *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(void *)(cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+
+    return 0;
+}
+
+static struct io_uring_sqe *ringNextSqe(ioRing_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sqTail + ring->sqQueued;
+    struct io_uring_sqe *sqe;
+
+    if((tail - head) > *ring->sqMask)
+    {
+        return NULL;
+    }
+
+    sqe = &((struct io_uring_sqe *)ring->sqes)[tail & *ring->sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[tail & *ring->sqMask] = tail & *ring->sqMask;
+    ring->sqQueued++;
+
+    return sqe;
+}
+
+static int ringSubmit(ioRing_t *ring)
+{
+    unsigned queued = ring->sqQueued;
+    int submitted;
+
+    __atomic_store_n(ring->sqTail, *ring->sqTail + queued, __ATOMIC_RELEASE);
+    ring->sqQueued = 0;
+
+    while(queued > 0)
+    {
+        submitted = ringEnter(ring->fd, queued, 0, 0);
+        if(submitted < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        queued -= (unsigned)submitted;
+    }
+
+    return 0;
+}
+#endif
+
+static int readerRegions(const dsReader_t *reader)
+{
+    return reader->cols + reader->hasClass;
+}
+
+static int batchRowCount(const dsReader_t *reader, int batch)
+{
+    int rows = reader->rows - (batch * reader->batchRows);
+
+    return (rows < reader->batchRows) ? rows : reader->batchRows;
+}
+
+static void planRead(const dsReader_t *reader, int batch, int region, uint64_t *offset, size_t *length, size_t *shift)
+{
+    uint64_t firstRow = (uint64_t)batch * (uint64_t)reader->batchRows;
+    size_t bytes = (size_t)batchRowCount(reader, batch) * sizeof(float);
+    uint64_t start = (region < reader->cols) ? (reader->columnsOffset + ((((uint64_t)region * (uint64_t)reader->stride) + firstRow) * sizeof(float)))
+                                             : (reader->classOffset + (firstRow * sizeof(int)));
+
+    if(reader->direct) //O_DIRECT needs page aligned offsets and lengths
+    {
+        *offset = start & ~(uint64_t)(DATASET_PAGE - 1);
+        *shift = (size_t)(start - *offset);
+        *length = (*shift + bytes + (DATASET_PAGE - 1)) & ~(size_t)(DATASET_PAGE - 1);
+    }
+    else
+    {
+        *offset = start;
+        *shift = 0;
+        *length = bytes;
+    }
+}
+
+static void submitBatch(dsReader_t *reader, int slotIndex)
+{
+    readerSlot_t *slot = &reader->slots[slotIndex];
+
+    slot->batch = reader->nextSubmit++;
+    slot->pending = 0;
+    slot->failed = 0;
+
+    for(int region=0; region<readerRegions(reader); region++)
+    {
+        uint8_t *destination = slot->buffer + ((size_t)region * reader->regionBytes);
+        size_t needed = (size_t)batchRowCount(reader, slot->batch) * sizeof(float);
+        uint64_t offset;
+        size_t length;
+        size_t shift;
+
+        planRead(reader, slot->batch, region, &offset, &length, &shift);
+        needed += shift;
+
+#if defined(__linux__)
+        if(reader->async)
+        {
+            struct io_uring_sqe *sqe = ringNextSqe(&reader->ring);
+
+            if(sqe == NULL)
+            {
+                slot->failed = 1;
+                continue;
+            }
+
+            sqe->opcode = reader->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = reader->fd;
+            sqe->off = offset;
+            sqe->addr = (uint64_t)(uintptr_t)destination;
+            sqe->len = (uint32_t)length;
+            sqe->buf_index = reader->fixed ? (uint16_t)slotIndex : 0;
+            sqe->user_data = ((uint64_t)slotIndex << 32) | (uint64_t)needed;
+            slot->pending++;
+            continue;
+        }
+#endif
+
+        {
+            size_t done = 0;
+
+            while(done < length)
+            {
+                ssize_t got = pread(reader->fd, destination + done, length - done, (off_t)(offset + done));
+
+                if((got < 0) && (errno == EINTR))
+                {
+                    continue;
+                }
+                if(got <= 0)
+                {
+                    break;
+                }
+                done += (size_t)got;
+            }
+            slot->failed |= (done < needed) ? 1 : 0;
+        }
+    }
+
+#if defined(__linux__)
+    if(reader->async && (ringSubmit(&reader->ring) != 0))
+    {
+        slot->failed = 1;
+    }
+#endif
+}
+
+static int reapReads(dsReader_t *reader)
+{
+#if defined(__linux__)
+    ioRing_t *ring = &reader->ring;
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+
+    while(head == tail)
+    {
+        if((ringEnter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0) && (errno != EINTR))
+        {
+            return -1;
+        }
+        tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    for(; head != tail; head++)
+    {
+        const struct io_uring_cqe *cqe = &((const struct io_uring_cqe *)ring->cqes)[head & *ring->cqMask];
+        readerSlot_t *slot = &reader->slots[cqe->user_data >> 32];
+
+        slot->failed |= (cqe->res < (int32_t)(uint32_t)cqe->user_data) ? 1 : 0;
+        slot->pending--;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+#else
+    (void)reader;
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Open a dataset file for asynchronous batch reading.
+ *
+ * This function prepares out-of-core reading of a dataset file written by writeDatasetFile. The
+ * file is opened with O_DIRECT, so batches bypass the page cache, and up to READER_DEPTH batches
+ * of 'batchRows' rows are kept in flight through io_uring with buffers registered once. While the
+ * caller trains on one batch, the next ones are being read, so training runs at compute speed.
+ * When io_uring or O_DIRECT are unavailable, the reader falls back to blocking buffered reads
+ * with the same interface.
+ *
+ * @param path      The path of the dataset file.
+ * @param batchRows The number of rows per batch, 0 for DATASET_CHUNK_ROWS.
+ * @param reader    A pointer to the 'dsReader_t' structure to initialize.
+ *
+ * @return Returns 0 on success, or -1 if the file is not a valid dataset file or memory runs out.
+ *
+ * @note Batch reads only touch the columns of the batch rows, the chunk index is never read.
+ *       With a multiple of DATASET_PAGE / 4 rows per batch, every read is exactly page aligned.
+ *
+ * @code
+ *   // Example usage:
+ *   dsReader_t reader;
+ *   colData_t batch;
+ *   if(openDatasetReader("train.dknn", 0, &reader) == 0)
+ *   {
+ *       while(nextDatasetBatch(&reader, &batch) > 0)
+ *       {
+ *           accumulateColumnCenters(&batch, 0, batch.rows, &model, sums, counts);
+ *       }
+ *       closeDatasetReader(&reader);
+ *   }
+ * @endcode
+ */
+int openDatasetReader(const char *path, int batchRows, dsReader_t *reader)
+{
+    dsHeader_t header;
+    struct stat info;
+    void *page = NULL;
+    ssize_t got;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->ring.fd = -1;
+    reader->current = -1;
+    reader->batchRows = (batchRows > 0) ? batchRows : DATASET_CHUNK_ROWS;
+
+#if defined(O_DIRECT)
+    reader->fd = open(path, O_RDONLY | O_DIRECT);
+    reader->direct = (reader->fd >= 0) ? 1 : 0;
+#else
+    reader->fd = -1;
+#endif
+    if(reader->fd < 0)
+    {
+        reader->fd = open(path, O_RDONLY);
+    }
+    if((reader->fd < 0) || (fstat(reader->fd, &info) != 0) || (posix_memalign(&page, DATASET_PAGE, DATASET_PAGE) != 0))
+    {
+        closeDatasetReader(reader);
+        return -1;
+    }
+
+    got = pread(reader->fd, page, DATASET_PAGE, 0);
+    if(got >= (ssize_t)sizeof(header))
+    {
+        memcpy(&header, page, sizeof(header));
+    }
+    free(page);
+    if((got < (ssize_t)sizeof(header)) || (checkDatasetHeader(&header, (size_t)info.st_size) != 0))
+    {
+        closeDatasetReader(reader);
+        return -1;
+    }
+
+    reader->rows = (int)header.rows;
+    reader->cols = (int)header.cols;
+    reader->stride = (int)header.stride;
+    reader->hasClass = header.hasClass ? 1 : 0;
+    reader->columnsOffset = header.columnsOffset;
+    reader->classOffset = header.classOffset;
+    reader->batches = (reader->rows + reader->batchRows - 1) / reader->batchRows;
+    reader->regionBytes = ((((size_t)reader->batchRows * sizeof(float)) + (DATASET_PAGE - 1)) & ~(size_t)(DATASET_PAGE - 1)) + DATASET_PAGE;
+
+    for(int slot=0; slot<READER_DEPTH; slot++)
+    {
+        void *buffer;
+
+        reader->slots[slot].batch = -1;
+        if(posix_memalign(&buffer, DATASET_PAGE, (size_t)readerRegions(reader) * reader->regionBytes) != 0)
+        {
+            closeDatasetReader(reader);
+            return -1;
+        }
+        reader->slots[slot].buffer = (uint8_t *)buffer;
+    }
+
+#if defined(__linux__)
+    if(ringSetup(&reader->ring, (unsigned)(READER_DEPTH * readerRegions(reader))) == 0)
+    {
+        struct iovec buffers[READER_DEPTH];
+
+        for(int slot=0; slot<READER_DEPTH; slot++)
+        {
+            buffers[slot].iov_base = reader->slots[slot].buffer;
+            buffers[slot].iov_len = (size_t)readerRegions(reader) * reader->regionBytes;
+        }
+        reader->async = 1;
+        reader->fixed = (syscall(__NR_io_uring_register, reader->ring.fd, IORING_REGISTER_BUFFERS, buffers, READER_DEPTH) == 0) ? 1 : 0;
+    }
+#endif
+
+    for(int slot=0; (slot < READER_DEPTH) && (reader->nextSubmit < reader->batches); slot++)
+    {
+        submitBatch(reader, slot);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the next batch of a dataset reader.
+ *
+ * This function hands the buffer of the previous batch back to the reader, which immediately
+ * starts reading a later batch into it, and then waits until the oldest batch in flight is
+ * complete. 'batch' is pointed at that batch, whose rows are numbered from 0.
+ *
+ * @param reader A pointer to the 'dsReader_t' structure of an open reader.
+ * @param batch  A pointer to the 'colData_t' structure receiving the batch.
+ *
+ * @return The number of rows in the batch, 0 once every batch has been delivered, or -1 on a read error.
+ *
+ * @note 'batch' stays valid until the next call to nextDatasetBatch or closeDatasetReader.
+ *
+ * @code
+ *   // Example usage:
+ *   while(nextDatasetBatch(&reader, &batch) > 0)
+ *   {
+ *       modifyColumnDilutionPars(&batch, 0, batch.rows, &model); // Train on the batch...
+ *   }
+ * @endcode
+ */
+int nextDatasetBatch(dsReader_t *reader, colData_t *batch)
+{
+    readerSlot_t *slot;
+    uint64_t offset;
+    size_t length;
+    size_t shift;
+    size_t columnShift;
+    int rows;
+
+    if(reader->current >= 0) //recycle the buffer of the previous batch
+    {
+        reader->slots[reader->current].batch = -1;
+        if(reader->nextSubmit < reader->batches)
+        {
+            submitBatch(reader, reader->current);
+        }
+        reader->current = -1;
+    }
+
+    if(reader->nextDeliver >= reader->batches)
+    {
+        return 0;
+    }
+
+    slot = &reader->slots[reader->nextDeliver % READER_DEPTH];
+    while(slot->pending > 0)
+    {
+        if(reapReads(reader) != 0)
+        {
+            return -1;
+        }
+    }
+    if(slot->failed)
+    {
+        return -1;
+    }
+
+    rows = batchRowCount(reader, slot->batch);
+    planRead(reader, slot->batch, 0, &offset, &length, &columnShift);
+    for(int region=1; region<reader->cols; region++) //line columns up when the file stride is not page aligned
+    {
+        planRead(reader, slot->batch, region, &offset, &length, &shift);
+        if(shift != columnShift)
+        {
+            uint8_t *base = slot->buffer + ((size_t)region * reader->regionBytes);
+
+            memmove(base + columnShift, base + shift, (size_t)rows * sizeof(float));
+        }
+    }
+
+    batch->rows = rows;
+    batch->cols = reader->cols;
+    batch->stride = (int)(reader->regionBytes / sizeof(float));
+    batch->columns = (float *)(void *)(slot->buffer + columnShift);
+    batch->class = NULL;
+    if(reader->hasClass)
+    {
+        planRead(reader, slot->batch, reader->cols, &offset, &length, &shift);
+        batch->class = (int *)(void *)(slot->buffer + ((size_t)reader->cols * reader->regionBytes) + shift);
+    }
+
+    reader->current = reader->nextDeliver % READER_DEPTH;
+    reader->nextDeliver++;
+
+    return rows;
+}
+
+/**
+ * @brief Close a dataset reader.
+ *
+ * This function waits for the reads still in flight, then releases the ring, the batch buffers
+ * and the file of 'reader'.
+ *
+ * @param reader A pointer to the 'dsReader_t' structure to close.
+ *
+ * @code
+ *   // Example usage:
+ *   closeDatasetReader(&reader);
+ *   // Batches returned by 'reader' must not be used anymore.
+ * @endcode
+ */
+void closeDatasetReader(dsReader_t *reader)
+{
+#if defined(__linux__)
+    if(reader->async)
+    {
+        for(int slot=0; slot<READER_DEPTH; slot++)
+        {
+            while((reader->slots[slot].pending > 0) && (reapReads(reader) == 0))
+            {
+                //
+            }
+        }
+        ringClose(&reader->ring);
+    }
+#endif
+
+    for(int slot=0; slot<READER_DEPTH; slot++)
+    {
+        free(reader->slots[slot].buffer);
+    }
+    if(reader->fd >= 0)
+    {
+        (void)close(reader->fd);
+    }
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+    reader->ring.fd = -1;
+    reader->current = -1;
+}
+
+/**
+ * @brief Train a vector model on a dataset file that does not fit in memory.
+ *
+ * This function runs both passes of a streaming trainer over the dataset file at 'path', reading
+ * batches through a 'dsReader_t'. The file is read exactly twice, whatever its size: once for the
+ * class centers and once for the distance summaries the dilution parameters are estimated from.
+ *
+ * @param path      The path of the dataset file.
+ * @param batchRows The number of rows per batch, 0 for DATASET_CHUNK_ROWS.
+ * @param trainer   A pointer to an initialized 'streamTrainer_t' structure.
+ * @param epochs    The number of epochs the dilution parameters are estimated for, e.g. EPOCH.
+ *
+ * @return Returns 0 on success, or -1 if the file cannot be read.
+ *
+ * @code
+ *   // Example usage:
+ *   static double workspace[STREAM_TRAINER_DOUBLES(3, 16)];
+ *   streamTrainer_t trainer;
+ *   initStreamTrainer(&trainer, &model, workspace);
+ *   if(trainDatasetFile("train.dknn", 0, &trainer, EPOCH) == 0)
+ *   {
+ *       // 'model' is trained...
+ *   }
+ * @endcode
+ */
+int trainDatasetFile(const char *path, int batchRows, streamTrainer_t *trainer, int epochs)
+{
+    for(int pass=0; pass<2; pass++)
+    {
+        dsReader_t reader;
+        colData_t batch;
+        int rows;
+
+        if(openDatasetReader(path, batchRows, &reader) != 0)
+        {
+            return -1;
+        }
+        if(!reader.hasClass || (reader.cols != trainer->model->dim))
+        {
+            closeDatasetReader(&reader);
+            return -1;
+        }
+        DKNN_PROBE1(train__pass__start, pass);
+
+        while((rows = nextDatasetBatch(&reader, &batch)) > 0)
+        {
+            if(pass == 0)
+            {
+                streamCenterPass(trainer, &batch);
+            }
+            else
+            {
+                streamDilutionPass(trainer, &batch);
+            }
+        }
+        closeDatasetReader(&reader);
+
+        if(rows < 0)
+        {
+            return -1;
+        }
+
+        if(pass == 0)
+        {
+            finishCenterPass(trainer);
+        }
+        DKNN_PROBE1(train__pass__done, pass);
+    }
+
+    finishDilutionPass(trainer, epochs);
+
+    return 0;
+}
+
+#define TRACE_MAGIC             "DKNNTR01"
+#define TRACE_HEADER_BYTES      (IO_ALIGN)
+
+typedef struct traceHeaderType
+{
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t dim;
+    uint32_t sampleEvery;
+    uint32_t recordSize;    //8 bytes of time, 4 of model id, 'dim' floats
+    uint64_t records;
+} traceHeader_t;
+
+static uint64_t monotonicNs(void)
+{
+    struct timespec now;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec * 1000000000u) + (uint64_t)now.tv_nsec;
+}
+
+static void flushTraceBuffer(traceCapture_t *capture) //called with the lock held
+{
+    uint64_t offset = TRACE_HEADER_BYTES + ((capture->records - (uint64_t)capture->buffered) * capture->recordSize);
+
+    if((capture->buffered > 0) && (writeAll(capture->fd, capture->buffer, (size_t)capture->buffered * capture->recordSize, offset) != 0))
+    {
+        capture->failed = 1;
+    }
+    capture->buffered = 0;
+}
+
+/**
+ * @brief Start capturing sampled queries into a trace file.
+ *
+ * This function creates the trace file at 'path' that captureQuery records sampled queries into,
+ * so the query distribution and arrival times seen in production can be replayed later. Records
+ * are buffered and written TRACE_BUFFER_RECORDS at a time; a record is 12 bytes plus the features.
+ *
+ * @param path        The path of the trace file, overwritten if it exists.
+ * @param dim         The number of features of every query.
+ * @param sampleEvery The sampling period, one query in 'sampleEvery' is recorded, 1 for all of them.
+ * @param capture     A pointer to the 'traceCapture_t' structure to initialize.
+ *
+ * @return Returns 0 on success, or -1 if the file cannot be created.
+ *
+ * @code
+ *   // Example usage:
+ *   traceCapture_t capture;
+ *   if(openTraceCapture("queries.trace", 16, 100, &capture) == 0) // One query in 100.
+ *   {
+ *       // captureQuery(&capture, modelId, point) next to every classification...
+ *       (void)closeTraceCapture(&capture);
+ *   }
+ * @endcode
+ */
+int openTraceCapture(const char *path, int dim, uint32_t sampleEvery, traceCapture_t *capture)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->fd = -1;
+
+    if((dim <= 0) || (sampleEvery == 0))
+    {
+        return -1;
+    }
+
+    capture->dim = dim;
+    capture->sampleEvery = sampleEvery;
+    capture->recordSize = 12u + ((size_t)dim * sizeof(float));
+    capture->buffer = malloc(TRACE_BUFFER_RECORDS * capture->recordSize);
+    capture->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if((capture->buffer == NULL) || (capture->fd < 0) || (pthread_mutex_init(&capture->lock, NULL) != 0))
+    {
+        if(capture->fd >= 0)
+        {
+            (void)close(capture->fd);
+        }
+        free(capture->buffer);
+        capture->fd = -1;
+        capture->buffer = NULL;
+        return -1;
+    }
+
+    capture->startNs = monotonicNs();
+
+    return 0;
+}
+
+/**
+ * @brief Offer a query to a trace capture.
+ *
+ * This function records one query in 'capture->sampleEvery' with its model and arrival time.
+ * Queries that are not sampled only cost an atomic increment, so the call can stay on the
+ * classification path; sampled ones take a lock, a timestamp and a copy, and a write every
+ * TRACE_BUFFER_RECORDS records. Safe to call from several threads, the records of a trace are
+ * in arrival order.
+ *
+ * @param capture A pointer to a 'traceCapture_t' structure initialized by openTraceCapture.
+ * @param modelId The identifier of the model the query is classified with.
+ * @param point   The 'dim' features of the query.
+ *
+ * @code
+ *   // Example usage:
+ *   captureQuery(&capture, 0u, point);
+ *   int class = classifyVectorPoint(point, &model);
+ * @endcode
+ */
+void captureQuery(traceCapture_t *capture, uint32_t modelId, const float point[])
+{
+    uint8_t *record;
+    uint64_t timeNs;
+
+    if((__atomic_fetch_add(&capture->seen, 1u, __ATOMIC_RELAXED) % capture->sampleEvery) != 0)
+    {
+        return;
+    }
+
+    (void)pthread_mutex_lock(&capture->lock);
+    timeNs = monotonicNs() - capture->startNs; //taken under the lock, so records are in time order
+    record = capture->buffer + ((size_t)capture->buffered * capture->recordSize);
+    memcpy(record, &timeNs, sizeof(timeNs));
+    memcpy(record + 8, &modelId, sizeof(modelId));
+    memcpy(record + 12, point, (size_t)capture->dim * sizeof(float));
+    capture->buffered++;
+    capture->records++;
+    if(capture->buffered == TRACE_BUFFER_RECORDS)
+    {
+        flushTraceBuffer(capture);
+    }
+    (void)pthread_mutex_unlock(&capture->lock);
+}
+
+/**
+ * @brief Finish a trace capture.
+ *
+ * This function writes the buffered records and the header, which holds the record count, and
+ * closes the trace file. The header is only written here, so an unfinished trace is rejected by
+ * openTraceFile.
+ *
+ * @param capture A pointer to a 'traceCapture_t' structure initialized by openTraceCapture.
+ *
+ * @return Returns 0 on success, or -1 if a write failed.
+ *
+ * @code
+ *   // Example usage:
+ *   if(closeTraceCapture(&capture) != 0)
+ *   {
+ *       // The trace is incomplete...
+ *   }
+ * @endcode
+ */
+int closeTraceCapture(traceCapture_t *capture)
+{
+    uint8_t headerBytes[TRACE_HEADER_BYTES];
+    traceHeader_t header;
+    int retVal;
+
+    if(capture->fd < 0)
+    {
+        return -1;
+    }
+
+    (void)pthread_mutex_lock(&capture->lock);
+    flushTraceBuffer(capture);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.byteOrder = DATASET_BYTE_ORDER;
+    header.dim = (uint32_t)capture->dim;
+    header.sampleEvery = capture->sampleEvery;
+    header.recordSize = (uint32_t)capture->recordSize;
+    header.records = capture->records;
+    memset(headerBytes, 0, sizeof(headerBytes));
+    memcpy(headerBytes, &header, sizeof(header));
+
+    retVal = ((capture->failed == 0) && (writeAll(capture->fd, headerBytes, sizeof(headerBytes), 0) == 0)) ? 0 : -1;
+    retVal |= (close(capture->fd) == 0) ? 0 : -1;
+    (void)pthread_mutex_unlock(&capture->lock);
+    (void)pthread_mutex_destroy(&capture->lock);
+
+    free(capture->buffer);
+    capture->buffer = NULL;
+    capture->fd = -1;
+
+    return retVal;
+}
+
+/**
+ * @brief Open a trace file for replay.
+ *
+ * This function memory-maps the trace file at 'path' written by a 'traceCapture_t'. Its records
+ * are read with getTraceRecord, in capture order.
+ *
+ * @param path  The path of the trace file.
+ * @param trace A pointer to the 'queryTrace_t' structure receiving the mapping.
+ *
+ * @return Returns 0 on success, or -1 if the file cannot be mapped or is not a complete trace file.
+ *
+ * @code
+ *   // Example usage:
+ *   queryTrace_t trace;
+ *   if(openTraceFile("queries.trace", &trace) == 0)
+ *   {
+ *       // trace.records queries of trace.dim features...
+ *       closeTraceFile(&trace);
+ *   }
+ * @endcode
+ */
+int openTraceFile(const char *path, queryTrace_t *trace)
+{
+    traceHeader_t header;
+    struct stat info;
+    int fd;
+
+    memset(trace, 0, sizeof(*trace));
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    if((fstat(fd, &info) != 0) || ((size_t)info.st_size < TRACE_HEADER_BYTES))
+    {
+        (void)close(fd);
+        return -1;
+    }
+
+    trace->mapSize = (size_t)info.st_size;
+    trace->map = mmap(NULL, trace->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)close(fd);
+    if(trace->map == MAP_FAILED)
+    {
+        trace->map = NULL;
+        return -1;
+    }
+
+    memcpy(&header, trace->map, sizeof(header));
+    if((memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) || (header.byteOrder != DATASET_BYTE_ORDER) ||
+       (header.dim == 0) || (header.recordSize != (12u + (header.dim * sizeof(float)))) ||
+       (header.records > ((trace->mapSize - TRACE_HEADER_BYTES) / header.recordSize)))
+    {
+        closeTraceFile(trace);
+        return -1;
+    }
+
+    trace->dim = (int)header.dim;
+    trace->sampleEvery = header.sampleEvery;
+    trace->records = header.records;
+    trace->recordSize = header.recordSize;
+    trace->first = (const uint8_t *)trace->map + TRACE_HEADER_BYTES;
+
+    return 0;
+}
+
+/**
+ * @brief Get a record of a trace file.
+ *
+ * This function reads the time and model of record 'index' and points 'record->point' at its
+ * features inside the mapping.
+ *
+ * @param trace  A pointer to the 'queryTrace_t' structure of an open trace file.
+ * @param index  The index of the record, in [0, trace->records).
+ * @param record A pointer to the 'traceRecord_t' structure receiving the record.
+ *
+ * @code
+ *   // Example usage:
+ *   traceRecord_t record;
+ *   getTraceRecord(&trace, 0, &record);
+ *   int class = classifyVectorPoint(record.point, &model);
+ * @endcode
+ */
+void getTraceRecord(const queryTrace_t *trace, uint64_t index, traceRecord_t *record)
+{
+    const uint8_t *bytes = trace->first + (index * trace->recordSize);
+
+    memcpy(&record->timeNs, bytes, sizeof(record->timeNs));
+    memcpy(&record->modelId, bytes + 8, sizeof(record->modelId));
+    record->point = (const float *)(const void *)(bytes + 12);
+}
+
+/**
+ * @brief Close a trace file.
+ *
+ * This function unmaps a trace file opened with openTraceFile. Pointers into it are invalid
+ * afterwards.
+ *
+ * @param trace A pointer to the 'queryTrace_t' structure of an open trace file.
+ *
+ * @code
+ *   // Example usage:
+ *   closeTraceFile(&trace);
+ * @endcode
+ */
+void closeTraceFile(queryTrace_t *trace)
+{
+    if(trace->map != NULL)
+    {
+        (void)munmap(trace->map, trace->mapSize);
+    }
+    memset(trace, 0, sizeof(*trace));
+}
+
+static pthread_t logDrainThread;
+static pthread_mutex_t logDrainLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logDrainWake = PTHREAD_COND_INITIALIZER;
+static int logDrainRunning;
+static logSink_t logDrainSink;
+static void *logDrainContext;
+
+static void *drainLogPeriodically(void *argument)
+{
+    struct timespec wake;
+
+    (void)argument;
+    (void)pthread_mutex_lock(&logDrainLock);
+    while(logDrainRunning)
+    {
+        (void)pthread_mutex_unlock(&logDrainLock);
+        (void)drainLog(logDrainSink, logDrainContext, 0);
+        (void)pthread_mutex_lock(&logDrainLock);
+
+        (void)clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += LOG_DRAIN_PERIOD * 1000L;
+        wake.tv_sec += wake.tv_nsec / 1000000000L;
+        wake.tv_nsec %= 1000000000L;
+        if(logDrainRunning)
+        {
+            (void)pthread_cond_timedwait(&logDrainWake, &logDrainLock, &wake);
+        }
+    }
+    (void)pthread_mutex_unlock(&logDrainLock);
+
+    (void)drainLog(logDrainSink, logDrainContext, 0); //messages logged before stopLogDrain
+
+    return NULL;
+}
+
+/**
+ * @brief Write a log message as a line of a stdio stream.
+ *
+ * This function is a 'logSink_t' for startLogDrain or setLogSink that writes 'message' and a
+ * newline to the 'FILE *' stream 'context', or to stdout if 'context' is NULL.
+ *
+ * @param severity The severity of the message, unused.
+ * @param message  The message.
+ * @param context  The 'FILE *' stream to write to, or NULL for stdout.
+ *
+ * @code
+ *   // Example usage:
+ *   (void)startLogDrain(fileLogSink, stderr);
+ * @endcode
+ */
+void fileLogSink(int severity, const char *message, void *context)
+{
+    FILE *stream = (context != NULL) ? (FILE *)context : stdout;
+
+    (void)severity;
+    (void)fputs(message, stream);
+    (void)fputc('\n', stream);
+}
+
+/**
+ * @brief Drain the log ring of "dknn.c" from a background thread.
+ *
+ * This function routes diagnostics to ringLogSink and starts a thread that hands the messages
+ * buffered in the ring to 'sink' every LOG_DRAIN_PERIOD microseconds, so slow sinks such as files
+ * or terminals never run on a classification thread. Logging threads only write to the ring, and
+ * drop messages when it is full instead of waiting for the drain.
+ *
+ * @param sink    The callback receiving the messages, e.g. fileLogSink.
+ * @param context A pointer handed to every call of 'sink'.
+ *
+ * @return Returns 0 on success, or -1 if a drain thread is running or cannot be started.
+ *
+ * @code
+ *   // Example usage:
+ *   if(startLogDrain(fileLogSink, stdout) == 0)
+ *   {
+ *       // Classify, decisions of classifyDataPoint are printed by the drain thread...
+ *       stopLogDrain();
+ *   }
+ * @endcode
+ */
+int startLogDrain(logSink_t sink, void *context)
+{
+    int retVal = -1;
+
+    (void)pthread_mutex_lock(&logDrainLock);
+    if(!logDrainRunning && (sink != NULL))
+    {
+        logDrainSink = sink;
+        logDrainContext = context;
+        logDrainRunning = 1;
+        if(pthread_create(&logDrainThread, NULL, drainLogPeriodically, NULL) == 0)
+        {
+            setLogSink(ringLogSink, NULL);
+            retVal = 0;
+        }
+        else
+        {
+            logDrainRunning = 0;
+        }
+    }
+    (void)pthread_mutex_unlock(&logDrainLock);
+
+    return retVal;
+}
+
+/**
+ * @brief Stop the background log drain.
+ *
+ * This function stops the thread started by startLogDrain after it has handed the messages
+ * still in the ring to its sink, and routes diagnostics back to the default sink.
+ *
+ * @code
+ *   // Example usage:
+ *   stopLogDrain();
+ * @endcode
+ */
+void stopLogDrain(void)
+{
+    int running;
+
+    (void)pthread_mutex_lock(&logDrainLock);
+    running = logDrainRunning;
+    logDrainRunning = 0;
+    (void)pthread_cond_signal(&logDrainWake);
+    (void)pthread_mutex_unlock(&logDrainLock);
+
+    if(running)
+    {
+        setLogSink(NULL, NULL);
+        (void)pthread_join(logDrainThread, NULL);
+    }
+}
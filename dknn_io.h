@@ -0,0 +1,208 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           dknn_io.h
+ * Date:                30th November 2023
+ *
+ * Description: Header file for the data loading part of the library "dknn.h". Includes declarations
+                of functions that bring training and query data from files into the columnar buffers
+                consumed by "dknn.c". Unlike "dknn.c", which has no operating system dependency and
+                is meant for microcontrollers, this part targets hosts with a POSIX environment
+                (mmap, pthreads) where models are trained and evaluated on large datasets.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#ifndef DML_DKNN_IO_H
+#define DML_DKNN_IO_H
+
+#include <pthread.h>
+#include "dknn.h"
+
+// Loader Parameters -------------------------------------------------------------
+#define IO_ALIGN                (64)        //default value 64 bytes, one cache line
+#define CSV_MIN_CHUNK           (1 << 20)   //default value 1 MiB of text per loader thread
+
+typedef struct csvOptionsType
+{
+    char delimiter;
+    int skipHeader;     //1 if the first line holds column names
+    int classCol;       //index of the class column, -1 for queries, -2 for the last column
+    int threads;        //number of loader threads, 0 for one per online CPU
+} csvOptions_t;
+
+void initCsvOptions(csvOptions_t *opts);
+int loadCsvColumns(const char *path, const csvOptions_t *opts, colData_t *data);
+void freeColumnData(colData_t *data);
+
+
+// Dataset Files -----------------------------------------------------------------
+#define DATASET_CHUNK_ROWS      (4096)      //default value 4096 rows per chunk
+#define DATASET_PAGE            (4096)      //default value 4 KiB, columns start on page boundaries
+
+typedef struct datasetFileType
+{
+    colData_t data;     //columns and classes inside the mapping
+    int classes;
+    int chunkRows;
+    int chunks;
+    void *map;
+    size_t mapSize;
+    const uint8_t *chunkIndex;
+    size_t chunkEntrySize;
+} dsFile_t;
+
+typedef struct chunkStatsType
+{
+    int firstRow;
+    int rows;
+    const uint32_t *classCounts;    //'classes' entries
+    const float *min;               //'cols' entries, NaN features ignored
+    const float *max;               //'cols' entries, NaN features ignored
+} chunkStats_t;
+
+typedef struct datasetWriterType
+{
+    int fd;
+    int rows;
+    int cols;
+    int classes;
+    int hasClass;
+    int stride;
+    int chunkRows;
+    int chunks;
+    int written;        //rows appended so far
+    int failed;
+    uint64_t columnsOffset;
+    uint64_t classOffset;
+    uint64_t indexOffset;
+    uint8_t *entry;     //index entry of the chunk being appended
+    size_t entrySize;
+} dsWriter_t;
+
+int writeDatasetFile(const char *path, const colData_t *data, int chunkRows);
+int openDatasetWriter(const char *path, int rows, int cols, int classes, int chunkRows, dsWriter_t *writer);
+int appendDatasetRows(dsWriter_t *writer, const colData_t *batch);
+int closeDatasetWriter(dsWriter_t *writer);
+int openDatasetFile(const char *path, dsFile_t *file);
+void getChunkStats(const dsFile_t *file, int chunk, chunkStats_t *stats);
+void closeDatasetFile(dsFile_t *file);
+
+
+// Asynchronous Dataset Reader ---------------------------------------------------
+#define READER_DEPTH            (4)         //default value 4 batches in flight
+
+typedef struct ioRingType
+{
+    int fd;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    void *sqes;
+    void *cqes;
+    void *sqMap;
+    void *cqMap;
+    size_t sqMapSize;
+    size_t cqMapSize;
+    size_t sqesSize;
+    unsigned sqQueued;  //entries filled but not yet published to the kernel
+} ioRing_t;
+
+typedef struct readerSlotType
+{
+    uint8_t *buffer;
+    int batch;          //batch being read into the slot, -1 if idle
+    int pending;        //reads still in flight
+    int failed;
+} readerSlot_t;
+
+typedef struct datasetReaderType
+{
+    int fd;
+    int direct;         //1 if the file is read with O_DIRECT
+    int async;          //1 if reads go through io_uring, 0 for blocking reads
+    int fixed;          //1 if slot buffers are registered with the ring
+    ioRing_t ring;
+    int rows;
+    int cols;
+    int stride;
+    int hasClass;
+    uint64_t columnsOffset;
+    uint64_t classOffset;
+    int batchRows;
+    int batches;
+    int nextSubmit;
+    int nextDeliver;
+    int current;        //slot handed out by the last call to nextDatasetBatch, -1 if none
+    size_t regionBytes;
+    readerSlot_t slots[READER_DEPTH];
+} dsReader_t;
+
+int openDatasetReader(const char *path, int batchRows, dsReader_t *reader);
+int nextDatasetBatch(dsReader_t *reader, colData_t *batch);
+void closeDatasetReader(dsReader_t *reader);
+int trainDatasetFile(const char *path, int batchRows, streamTrainer_t *trainer, int epochs);
+
+
+// Query Traces ------------------------------------------------------------------
+#define TRACE_BUFFER_RECORDS    (1024)      //default value 1024 sampled queries written together
+
+typedef struct traceCaptureType
+{
+    int fd;
+    int dim;
+    uint32_t sampleEvery;   //one query in 'sampleEvery' is recorded
+    uint32_t seen;          //queries offered so far
+    uint64_t startNs;       //CLOCK_MONOTONIC time of openTraceCapture
+    uint64_t records;       //records written or buffered
+    int buffered;
+    int failed;
+    size_t recordSize;
+    uint8_t *buffer;        //TRACE_BUFFER_RECORDS records
+    pthread_mutex_t lock;
+} traceCapture_t;
+
+typedef struct queryTraceType
+{
+    int dim;
+    uint32_t sampleEvery;
+    uint64_t records;
+    size_t recordSize;
+    const uint8_t *first;   //first record inside the mapping
+    void *map;
+    size_t mapSize;
+} queryTrace_t;
+
+typedef struct traceRecordType
+{
+    uint64_t timeNs;        //since the start of the capture
+    uint32_t modelId;
+    const float *point;     //'dim' features inside the mapping
+} traceRecord_t;
+
+int openTraceCapture(const char *path, int dim, uint32_t sampleEvery, traceCapture_t *capture);
+void captureQuery(traceCapture_t *capture, uint32_t modelId, const float point[]);
+int closeTraceCapture(traceCapture_t *capture);
+int openTraceFile(const char *path, queryTrace_t *trace);
+void getTraceRecord(const queryTrace_t *trace, uint64_t index, traceRecord_t *record);
+void closeTraceFile(queryTrace_t *trace);
+
+
+// Log Drain ---------------------------------------------------------------------
+#define LOG_DRAIN_PERIOD        (1000)      //default value 1000 us between two drains of the log ring
+
+void fileLogSink(int severity, const char *message, void *context);
+int startLogDrain(logSink_t sink, void *context);
+void stopLogDrain(void);
+
+#endif //DML_DKNN_IO_H
@@ -0,0 +1,42 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           dknn_probes.h
+ * Date:                30th November 2023
+ *
+ * Description: Private header of the library "dknn.h", included by "dknn.c" and "dknn_io.c" only.
+                Defines the USDT static tracepoints of the "dknn" provider on top of <sys/sdt.h>,
+                so tools such as bpftrace and perf can attach to the classification and training
+                paths without rebuilding. Includers of "dknn.h" do not see these macros.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#ifndef DML_DKNN_PROBES_H
+#define DML_DKNN_PROBES_H
+
+// Static Tracepoints ------------------------------------------------------------
+#ifndef PROBES_ENABLED
+#define PROBES_ENABLED          (1)         //default value 1, USDT probes wherever <sys/sdt.h> is found, 0 compiles them out
+#endif
+
+#if PROBES_ENABLED && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define DKNN_PROBE1(name, a)        DTRACE_PROBE1(dknn, name, a)    //a single nop per site until a tracer attaches
+#define DKNN_PROBE2(name, a, b)     DTRACE_PROBE2(dknn, name, a, b)
+#endif
+#endif
+
+#ifndef DKNN_PROBE1
+#define DKNN_PROBE1(name, a)        ((void)0)
+#define DKNN_PROBE2(name, a, b)     ((void)0)
+#endif
+
+#endif //DML_DKNN_PROBES_H
@@ -0,0 +1,369 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           bench_compare.c
+ * Date:                30th November 2023
+ *
+ * Description: Benchmark regression gate of the library "dknn.h". Reads the JSON results of
+                "bench/bench.c" for a stored baseline and a candidate, matches the benchmarks by name
+                and parameters, and compares their per-sample latencies ("sample_ns") with a one-sided
+                Mann-Whitney U test. A benchmark regresses when the candidate is slower with
+                significance 'alpha' and its median latency grew by more than 'threshold'; both are
+                needed, so noise on a quiet laptop is not reported and neither are tiny but certain
+                slowdowns. Several result files per side (repeated runs) are pooled. Exits with 1
+                when any benchmark regressed, so it can gate commits locally.
+ *
+ *              Build: cc -std=c99 -O2 tools/bench_compare.c -lm -o dknn_bench_compare
+ *              Usage: dknn_bench_compare [--alpha 0.01] [--threshold 0.05] baseline.json[,run2.json...]
+ *                                        candidate.json[,run2.json...]
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define COMPARE_MAX_FILES       (16)
+#define COMPARE_KEY             (160)
+
+typedef struct compareSetType
+{
+    char key[COMPARE_KEY];  //name, kind and parameters of the benchmark
+    double *samples;
+    int count;
+    int capacity;
+} compareSet_t;
+
+typedef struct compareSideType
+{
+    compareSet_t *sets;
+    int count;
+    int capacity;
+} compareSide_t;
+
+typedef struct rankedType
+{
+    double value;
+    int candidate;
+} ranked_t;
+
+static char *readFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    char *text = NULL;
+    long size;
+
+    if(file == NULL)
+    {
+        return NULL;
+    }
+    if((fseek(file, 0, SEEK_END) == 0) && ((size = ftell(file)) >= 0) && (fseek(file, 0, SEEK_SET) == 0) &&
+       ((text = malloc((size_t)size + 1)) != NULL))
+    {
+        text[fread(text, 1, (size_t)size, file)] = '\0';
+    }
+    (void)fclose(file);
+
+    return text;
+}
+
+static const char *findValue(const char *object, const char *name) //value after "name": within object
+{
+    char pattern[40];
+    const char *found;
+
+    (void)snprintf(pattern, sizeof(pattern), "\"%s\":", name);
+    found = strstr(object, pattern);
+
+    return (found != NULL) ? (found + strlen(pattern) + strspn(found + strlen(pattern), " ")) : NULL;
+}
+
+static compareSet_t *findSet(compareSide_t *side, const char *key, int create)
+{
+    for(int index=0; index<side->count; index++)
+    {
+        if(strcmp(side->sets[index].key, key) == 0)
+        {
+            return &side->sets[index];
+        }
+    }
+    if(!create)
+    {
+        return NULL;
+    }
+
+    if(side->count == side->capacity)
+    {
+        side->capacity = (side->capacity == 0) ? 16 : (side->capacity * 2);
+        side->sets = realloc(side->sets, (size_t)side->capacity * sizeof(compareSet_t));
+    }
+    (void)memset(&side->sets[side->count], 0, sizeof(compareSet_t));
+    (void)snprintf(side->sets[side->count].key, COMPARE_KEY, "%s", key);
+
+    return &side->sets[side->count++];
+}
+
+static int loadResults(const char *path, compareSide_t *side)
+{
+    char *text = readFile(path);
+    char *object;
+    int loaded = 0;
+
+    if(text == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    for(object=strstr(text, "{\"name\":"); object!=NULL; object=strstr(object, "{\"name\":"))
+    {
+        char *end = strstr(object, "]}");
+        const char *name;
+        const char *kind;
+        const char *samples;
+        char key[COMPARE_KEY];
+        compareSet_t *set;
+
+        if(end == NULL)
+        {
+            break;
+        }
+        end[0] = '\0'; //bound the key search to this result
+
+        name = findValue(object, "name");
+        kind = findValue(object, "kind");
+        samples = findValue(object, "sample_ns");
+        if((name == NULL) || (kind == NULL) || (samples == NULL) || (*samples != '['))
+        {
+            object = end + 2;
+            continue;
+        }
+        (void)snprintf(key, sizeof(key), "%.*s %.*s classes=%d dim=%d batch=%d threads=%d",
+                       (int)strcspn(name + 1, "\""), name + 1, (int)strcspn(kind + 1, "\""), kind + 1,
+                       atoi(findValue(object, "classes")), atoi(findValue(object, "dim")),
+                       atoi(findValue(object, "batch")), atoi(findValue(object, "threads")));
+
+        set = findSet(side, key, 1);
+        for(samples++; *samples!='\0'; )
+        {
+            char *next;
+            double value = strtod(samples, &next);
+
+            if(next == samples)
+            {
+                break;
+            }
+            if(set->count == set->capacity)
+            {
+                set->capacity = (set->capacity == 0) ? 256 : (set->capacity * 2);
+                set->samples = realloc(set->samples, (size_t)set->capacity * sizeof(double));
+            }
+            set->samples[set->count++] = value;
+            samples = next + strspn(next, ", ");
+        }
+
+        loaded++;
+        object = end + 2;
+    }
+
+    free(text);
+    if(loaded == 0)
+    {
+        (void)fprintf(stderr, "%s: no benchmark results\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int loadSide(const char *paths, compareSide_t *side)
+{
+    char list[COMPARE_MAX_FILES * 256];
+    int files = 0;
+
+    (void)snprintf(list, sizeof(list), "%s", paths);
+    for(char *path=strtok(list, ","); path!=NULL; path=strtok(NULL, ","))
+    {
+        if((++files > COMPARE_MAX_FILES) || (loadResults(path, side) != 0))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int compareDouble(const void *one, const void *other)
+{
+    double left = *(const double *)one;
+    double right = *(const double *)other;
+
+    return (left > right) - (left < right);
+}
+
+static int compareRanked(const void *one, const void *other)
+{
+    return compareDouble(&((const ranked_t *)one)->value, &((const ranked_t *)other)->value);
+}
+
+static double median(const compareSet_t *set)
+{
+    double *sorted = malloc((size_t)set->count * sizeof(double));
+    double middle;
+
+    (void)memcpy(sorted, set->samples, (size_t)set->count * sizeof(double));
+    qsort(sorted, (size_t)set->count, sizeof(double), compareDouble);
+    middle = ((set->count % 2) == 1) ? sorted[set->count / 2] : (0.5 * (sorted[(set->count / 2) - 1] + sorted[set->count / 2]));
+    free(sorted);
+
+    return middle;
+}
+
+/* p-value of the one-sided Mann-Whitney U test that the candidate samples are larger (slower),
+ * normal approximation with tie and continuity corrections. */
+static double mannWhitney(const compareSet_t *baseline, const compareSet_t *candidate)
+{
+    int total = baseline->count + candidate->count;
+    ranked_t *ranked = malloc((size_t)total * sizeof(ranked_t));
+    double rankSum = 0;
+    double ties = 0;
+    double n1 = candidate->count;
+    double n2 = baseline->count;
+    double mean;
+    double deviation;
+    double u;
+
+    for(int index=0; index<total; index++)
+    {
+        ranked[index].candidate = (index >= baseline->count);
+        ranked[index].value = ranked[index].candidate ? candidate->samples[index - baseline->count] : baseline->samples[index];
+    }
+    qsort(ranked, (size_t)total, sizeof(ranked_t), compareRanked);
+
+    for(int first=0; first<total; )
+    {
+        int last = first;
+        double rank;
+
+        while((last + 1 < total) && (ranked[last + 1].value == ranked[first].value))
+        {
+            last++;
+        }
+        rank = 0.5 * (double)(first + last + 2); //average of the 1-based ranks of the tie group
+        for(int index=first; index<=last; index++)
+        {
+            rankSum += ranked[index].candidate ? rank : 0;
+        }
+        ties += pow((double)(last - first + 1), 3) - (double)(last - first + 1);
+        first = last + 1;
+    }
+    free(ranked);
+
+    u = rankSum - (n1 * (n1 + 1) / 2);
+    mean = n1 * n2 / 2;
+    deviation = sqrt(n1 * n2 / 12 * (((double)total + 1) - (ties / ((double)total * ((double)total - 1)))));
+    if(deviation == 0)
+    {
+        return 1.0;
+    }
+
+    return 0.5 * erfc(((u - mean - 0.5) / deviation) / sqrt(2.0));
+}
+
+int main(int argc, char *argv[])
+{
+    compareSide_t baseline = {NULL, 0, 0};
+    compareSide_t candidate = {NULL, 0, 0};
+    const char *paths[2] = {NULL, NULL};
+    double alpha = 0.01;
+    double threshold = 0.05;
+    int positional = 0;
+    int regressions = 0;
+
+    for(int index=1; index<argc; index++)
+    {
+        if((strcmp(argv[index], "--alpha") == 0) && (index + 1 < argc))             alpha = atof(argv[++index]);
+        else if((strcmp(argv[index], "--threshold") == 0) && (index + 1 < argc))    threshold = atof(argv[++index]);
+        else if((argv[index][0] != '-') && (positional < 2))                        paths[positional++] = argv[index];
+        else                                                                        positional = -1;
+
+        if(positional < 0)
+        {
+            break;
+        }
+    }
+    if((positional != 2) || (alpha <= 0) || (alpha >= 1) || (threshold < 0))
+    {
+        (void)fprintf(stderr, "usage: %s [--alpha 0.01] [--threshold 0.05] baseline.json[,run2.json...] candidate.json[,run2.json...]\n", argv[0]);
+        return 2;
+    }
+    if((loadSide(paths[0], &baseline) != 0) || (loadSide(paths[1], &candidate) != 0))
+    {
+        return 2;
+    }
+
+    (void)printf("%-72s %12s %12s %9s %10s  %s\n", "benchmark", "base p50 ns", "cand p50 ns", "change", "p", "verdict");
+    for(int index=0; index<baseline.count; index++)
+    {
+        const compareSet_t *base = &baseline.sets[index];
+        const compareSet_t *cand = findSet(&candidate, base->key, 0);
+        double baseMedian;
+        double change;
+        double slower;
+        double faster;
+        const char *verdict = "same";
+
+        if((cand == NULL) || (cand->count == 0) || (base->count == 0))
+        {
+            (void)printf("%-72s %12s %12s %9s %10s  missing\n", base->key, "-", "-", "-", "-");
+            continue;
+        }
+
+        baseMedian = median(base);
+        change = (baseMedian > 0) ? ((median(cand) / baseMedian) - 1) : 0;
+        slower = mannWhitney(base, cand);
+        faster = mannWhitney(cand, base);
+        if((slower < alpha) && (change > threshold))
+        {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if((faster < alpha) && (-change > threshold))
+        {
+            verdict = "improved";
+        }
+
+        (void)printf("%-72s %12.3f %12.3f %+8.1f%% %10.2e  %s\n", base->key, baseMedian, median(cand), change * 100,
+                     (change >= 0) ? slower : faster, verdict);
+    }
+    for(int index=0; index<candidate.count; index++)
+    {
+        if(findSet(&baseline, candidate.sets[index].key, 0) == NULL)
+        {
+            (void)printf("%-72s %12s %12s %9s %10s  new\n", candidate.sets[index].key, "-", "-", "-", "-");
+        }
+    }
+
+    (void)printf("%d regression(s) at alpha %.3g, threshold %.1f%%\n", regressions, alpha, threshold * 100);
+
+    for(int index=0; index<baseline.count; index++)
+    {
+        free(baseline.sets[index].samples);
+    }
+    for(int index=0; index<candidate.count; index++)
+    {
+        free(candidate.sets[index].samples);
+    }
+    free(baseline.sets);
+    free(candidate.sets);
+
+    return (regressions > 0) ? 1 : 0;
+}
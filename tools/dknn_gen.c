@@ -0,0 +1,302 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           dknn_gen.c
+ * Date:                30th November 2023
+ *
+ * Description: Synthetic workload generator of the library "dknn.h". Writes labeled datasets in the
+                native dataset format of "dknn_io.h" from seeded parameters, so benchmarks and
+                accuracy runs are reproducible. Rows are generated and appended batch by batch, so
+                files of 10^9 rows need no more memory than one batch. Every batch has its own
+                random stream derived from the seed and its index, so the output only depends on the
+                parameters. Scenarios:
+                blobs       one gaussian blob per class, equal class frequencies
+                multimodal  several overlapping gaussian modes per class
+                imbalanced  blobs with class frequencies falling geometrically by 'imbalance'
+                drift       blobs whose centers move along a random direction over the stream
+ *
+ *              Build: cc -std=c99 -O2 -I. tools/dknn_gen.c dknn.c dknn_io.c -lm -lpthread -o dknn_gen
+ *              Usage: dknn_gen --out train.dknn [--scenario blobs] [--rows 1000000] [--dim 2]
+ *                              [--classes 3] [--seed 1] [--sigma 1] [--separation 4] [--modes 3]
+ *                              [--imbalance 100] [--drift 5] [--chunk 4096]
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include "dknn_io.h"
+
+#define GEN_BATCH_ROWS          (65536)     //rows generated and appended at once
+#define GEN_MAX_MODES           (64)
+
+typedef struct genOptionsType
+{
+    const char *out;
+    const char *scenario;
+    long rows;
+    int dim;
+    int classes;
+    uint64_t seed;
+    double sigma;           //standard deviation of every mode
+    double separation;      //standard deviation of the mode means
+    int modes;              //modes per class, multimodal only
+    double imbalance;       //most over least frequent class, imbalanced only
+    double drift;           //center displacement over the stream in sigmas, drift only
+    int chunkRows;
+} genOptions_t;
+
+typedef struct genModelType
+{
+    int modes;
+    double *means;          //classes * modes * dim
+    double *direction;      //classes * dim, unit drift direction of every class
+    double *cumulative;     //classes, cumulative class frequencies
+    double drift;
+} genModel_t;
+
+typedef struct genRandomType
+{
+    uint64_t state;
+    int hasSpare;
+    double spare;
+} genRandom_t;
+
+static uint64_t splitMix64(uint64_t *state)
+{
+    uint64_t mixed = (*state += 0x9E3779B97F4A7C15ULL);
+
+    mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+
+    return mixed ^ (mixed >> 31);
+}
+
+static void seedRandom(genRandom_t *random, uint64_t seed, uint64_t stream)
+{
+    random->state = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    random->state = splitMix64(&random->state);
+    random->hasSpare = 0;
+}
+
+static double uniform(genRandom_t *random) //(0, 1)
+{
+    return ((double)(splitMix64(&random->state) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double normal(genRandom_t *random) //Box-Muller, pairs
+{
+    double radius;
+    double angle;
+
+    if(random->hasSpare)
+    {
+        random->hasSpare = 0;
+        return random->spare;
+    }
+
+    radius = sqrt(-2.0 * log(uniform(random)));
+    angle = 6.283185307179586 * uniform(random);
+    random->spare = radius * sin(angle);
+    random->hasSpare = 1;
+
+    return radius * cos(angle);
+}
+
+static int buildModel(const genOptions_t *opts, genModel_t *model)
+{
+    genRandom_t random;
+    double total = 0;
+    int single = (strcmp(opts->scenario, "multimodal") != 0);
+
+    if((strcmp(opts->scenario, "blobs") != 0) && (strcmp(opts->scenario, "multimodal") != 0) &&
+       (strcmp(opts->scenario, "imbalanced") != 0) && (strcmp(opts->scenario, "drift") != 0))
+    {
+        return -1;
+    }
+
+    model->modes = single ? 1 : opts->modes;
+    model->drift = (strcmp(opts->scenario, "drift") == 0) ? (opts->drift * opts->sigma) : 0;
+    model->means = malloc((size_t)opts->classes * (size_t)model->modes * (size_t)opts->dim * sizeof(double));
+    model->direction = malloc((size_t)opts->classes * (size_t)opts->dim * sizeof(double));
+    model->cumulative = malloc((size_t)opts->classes * sizeof(double));
+    if((model->means == NULL) || (model->direction == NULL) || (model->cumulative == NULL))
+    {
+        return -1;
+    }
+
+    seedRandom(&random, opts->seed, 0);
+    for(int index=0; index<(opts->classes * model->modes * opts->dim); index++)
+    {
+        model->means[index] = opts->separation * normal(&random);
+    }
+    for(int class=0; class<opts->classes; class++)
+    {
+        double *direction = &model->direction[class * opts->dim];
+        double norm = 0;
+
+        for(int feature=0; feature<opts->dim; feature++)
+        {
+            direction[feature] = normal(&random);
+            norm += direction[feature] * direction[feature];
+        }
+        for(int feature=0; feature<opts->dim; feature++)
+        {
+            direction[feature] /= sqrt(norm);
+        }
+
+        if((strcmp(opts->scenario, "imbalanced") == 0) && (opts->classes > 1))
+        {
+            total += pow(opts->imbalance, -(double)class / (double)(opts->classes - 1));
+        }
+        else
+        {
+            total += 1.0;
+        }
+        model->cumulative[class] = total;
+    }
+    for(int class=0; class<opts->classes; class++)
+    {
+        model->cumulative[class] /= total;
+    }
+
+    return 0;
+}
+
+static void generateBatch(const genOptions_t *opts, const genModel_t *model, long first, colData_t *batch, long classCounts[])
+{
+    genRandom_t random;
+
+    seedRandom(&random, opts->seed, (uint64_t)(first / GEN_BATCH_ROWS) + 1u);
+
+    for(int row=0; row<batch->rows; row++)
+    {
+        double draw = uniform(&random);
+        double progress = model->drift * ((double)(first + row) / (double)opts->rows);
+        int class = 0;
+        int mode = (model->modes > 1) ? (int)(uniform(&random) * model->modes) : 0;
+        const double *mean;
+        const double *direction;
+
+        while((class < (opts->classes - 1)) && (draw > model->cumulative[class]))
+        {
+            class++;
+        }
+        mean = &model->means[((class * model->modes) + mode) * opts->dim];
+        direction = &model->direction[class * opts->dim];
+
+        batch->class[row] = class;
+        classCounts[class]++;
+        for(int feature=0; feature<opts->dim; feature++)
+        {
+            double value = mean[feature] + (progress * direction[feature]) + (opts->sigma * normal(&random));
+
+            batch->columns[(feature * batch->stride) + row] = (float)value;
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    (void)fprintf(stderr, "usage: %s --out train.dknn [--scenario blobs|multimodal|imbalanced|drift] [--rows 1000000]"
+                          " [--dim 2] [--classes 3] [--seed 1] [--sigma 1] [--separation 4] [--modes 3]"
+                          " [--imbalance 100] [--drift 5] [--chunk 4096]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    genOptions_t opts = {NULL, "blobs", 1000000, 2, 3, 1, 1.0, 4.0, 3, 100.0, 5.0, 0};
+    genModel_t model;
+    dsWriter_t writer;
+    colData_t batch;
+    long *classCounts;
+    struct timespec begin;
+    struct timespec end;
+    double seconds;
+    int failed = 0;
+
+    for(int index=1; index<argc; index+=2)
+    {
+        const char *value = (index + 1 < argc) ? argv[index + 1] : NULL;
+
+        if(value == NULL)                                   { usage(argv[0]); return 2; }
+        else if(strcmp(argv[index], "--out") == 0)          opts.out = value;
+        else if(strcmp(argv[index], "--scenario") == 0)     opts.scenario = value;
+        else if(strcmp(argv[index], "--rows") == 0)         opts.rows = atol(value);
+        else if(strcmp(argv[index], "--dim") == 0)          opts.dim = atoi(value);
+        else if(strcmp(argv[index], "--classes") == 0)      opts.classes = atoi(value);
+        else if(strcmp(argv[index], "--seed") == 0)         opts.seed = strtoull(value, NULL, 0);
+        else if(strcmp(argv[index], "--sigma") == 0)        opts.sigma = atof(value);
+        else if(strcmp(argv[index], "--separation") == 0)   opts.separation = atof(value);
+        else if(strcmp(argv[index], "--modes") == 0)        opts.modes = atoi(value);
+        else if(strcmp(argv[index], "--imbalance") == 0)    opts.imbalance = atof(value);
+        else if(strcmp(argv[index], "--drift") == 0)        opts.drift = atof(value);
+        else if(strcmp(argv[index], "--chunk") == 0)        opts.chunkRows = atoi(value);
+        else                                                { usage(argv[0]); return 2; }
+    }
+
+    if((opts.out == NULL) || (opts.rows < 1) || (opts.rows > (long)(INT_MAX - (DATASET_PAGE / (int)sizeof(float)))) || (opts.dim < 1) || (opts.classes < 1) ||
+       (opts.modes < 1) || (opts.modes > GEN_MAX_MODES) || (opts.imbalance < 1.0) || (buildModel(&opts, &model) != 0))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    batch.rows = 0;
+    batch.cols = opts.dim;
+    batch.stride = GEN_BATCH_ROWS;
+    batch.columns = malloc((size_t)GEN_BATCH_ROWS * (size_t)opts.dim * sizeof(float));
+    batch.class = malloc((size_t)GEN_BATCH_ROWS * sizeof(int));
+    classCounts = calloc((size_t)opts.classes, sizeof(long));
+    if((batch.columns == NULL) || (batch.class == NULL) || (classCounts == NULL) ||
+       (openDatasetWriter(opts.out, (int)opts.rows, opts.dim, opts.classes, opts.chunkRows, &writer) != 0))
+    {
+        perror(opts.out);
+        return 1;
+    }
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &begin);
+    for(long first=0; (failed == 0) && (first < opts.rows); first+=GEN_BATCH_ROWS)
+    {
+        batch.rows = (int)(((opts.rows - first) < GEN_BATCH_ROWS) ? (opts.rows - first) : GEN_BATCH_ROWS);
+        generateBatch(&opts, &model, first, &batch, classCounts);
+        failed = appendDatasetRows(&writer, &batch);
+    }
+    failed |= closeDatasetWriter(&writer);
+    (void)clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if(failed != 0)
+    {
+        (void)fprintf(stderr, "%s: write failed\n", opts.out);
+        return 1;
+    }
+
+    seconds = (double)(end.tv_sec - begin.tv_sec) + ((double)(end.tv_nsec - begin.tv_nsec) * 1e-9);
+    (void)fprintf(stderr, "%s: %ld rows of %d features, scenario %s, seed %llu, %.2f s (%.1f Mrows/s)\n",
+                  opts.out, opts.rows, opts.dim, opts.scenario, (unsigned long long)opts.seed, seconds, (double)opts.rows / seconds * 1e-6);
+    for(int class=0; class<opts.classes; class++)
+    {
+        (void)fprintf(stderr, "  class %d: %ld rows\n", class, classCounts[class]);
+    }
+
+    free(batch.columns);
+    free(batch.class);
+    free(classCounts);
+    free(model.means);
+    free(model.direction);
+    free(model.cumulative);
+
+    return 0;
+}
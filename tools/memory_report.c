@@ -0,0 +1,46 @@
+/**
+ * Author(s):           Arda T. Kersu
+ * File name:           memory_report.c
+ * Date:                30th November 2023
+ *
+ * Description: Probe program of "memory_report.sh". Built once with USE_DKNN set to 1, where it trains
+                and classifies one batch with a static model, and once with USE_DKNN set to 0, where it
+                does nothing. The difference between the two images is the flash and RAM the library
+                takes in the configuration given by STATIC_CLASSES, STATIC_DIM and BATCH_SIZE.
+ *
+ * Disclaimer: This open-source project is provided "as is" without any warranty, expressed or implied.
+ *             The contributors and maintainers disclaim any an all unintended consequences or issues
+ *             that may arise from its use. Users are encouraged to review and understand the software's
+ *             characteristics before implementation.
+ *
+ *
+ * Copyright @ [Arda T. Kersu]
+ *
+ */
+
+#include "dknn.h"
+
+volatile int reportSink;
+
+#if USE_DKNN
+static staticModel_t staticModel;
+#endif
+
+int main(void)
+{
+#if USE_DKNN
+    initStaticModel(&staticModel);
+    staticModel.batch.rows = BATCH_SIZE;
+
+    accumulateColumnCenters(&staticModel.batch, 0, BATCH_SIZE, &staticModel.model, staticModel.sums, staticModel.counts);
+    finalizeVectorCenters(&staticModel.model, staticModel.sums, staticModel.counts);
+    modifyColumnDilutionPars(&staticModel.batch, 0, BATCH_SIZE, &staticModel.model);
+    classifyColumnBatch(&staticModel.batch, 0, BATCH_SIZE, &staticModel.model, staticModel.predicted);
+
+    reportSink = staticModel.predicted[0];
+#else
+    reportSink = 0;
+#endif
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#!/bin/sh
+#
+# Memory budget report of the static configuration of "dknn.h".
+#
+# Usage: tools/memory_report.sh [classes:dim:batch ...]
+#
+# For every configuration, the probe in memory_report.c is linked with and without the library, and
+# the difference of the two images is reported: flash is text + data, RAM is data + bss, and frame
+# is the largest single stack frame of the library functions the probe uses. The frame is a lower
+# bound of the stack, not the depth of any call chain, so it is listed for reference and left out of
+# the verdict. The script exits with 1 if the RAM of any configuration exceeds MEMORY_BUDGET bytes.
+#
+# Environment:
+#   CC             compiler, e.g. arm-none-eabi-gcc (default cc)
+#   SIZE           size tool (default derived from CC)
+#   CFLAGS         target and optimization flags, e.g. "-mcpu=cortex-m0 -mthumb -Os" (default -Os)
+#   LDFLAGS        link flags, e.g. "--specs=nosys.specs"
+#   MEMORY_BUDGET  budget in bytes (default 32768)
+#
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+CC=${CC:-cc}
+case "$CC" in
+    *gcc) SIZE=${SIZE:-${CC%gcc}size} ;;
+    *)    SIZE=${SIZE:-size} ;;
+esac
+CFLAGS=${CFLAGS:--Os}
+MEMORY_BUDGET=${MEMORY_BUDGET:-32768}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+[ $# -gt 0 ] || set -- 3:2:50 4:8:50 8:16:50 3:64:64
+
+image() # $1 name, $2 USE_DKNN, $3 config flags
+{
+    # shellcheck disable=SC2086
+    $CC $CFLAGS $3 -DUSE_DKNN=$2 -DMEMORY_BUDGET=$MEMORY_BUDGET -ffunction-sections -fdata-sections -fstack-usage \
+        -I"$ROOT" -c "$ROOT/tools/memory_report.c" -o "$OUT/$1_probe.o"
+    if [ "$2" = 1 ]; then
+        # shellcheck disable=SC2086
+        (cd "$OUT" && $CC $CFLAGS $3 -DMEMORY_BUDGET=$MEMORY_BUDGET -ffunction-sections -fdata-sections -fstack-usage \
+            -I"$ROOT" -c "$ROOT/dknn.c" -o "$OUT/$1_dknn.o")
+        # shellcheck disable=SC2086
+        $CC $CFLAGS "$OUT/$1_probe.o" "$OUT/$1_dknn.o" -Wl,--gc-sections $LDFLAGS -lm -o "$OUT/$1.elf"
+    else
+        # shellcheck disable=SC2086
+        $CC $CFLAGS "$OUT/$1_probe.o" -Wl,--gc-sections $LDFLAGS -lm -o "$OUT/$1.elf"
+    fi
+    "$SIZE" "$OUT/$1.elf" | awk 'NR == 2 { print $1, $2, $3 }'
+}
+
+used() # names of the library functions kept in the linked image
+{
+    nm "$OUT/$1.elf" 2>/dev/null | awk '$2 ~ /^[tT]$/ { print $3 }'
+}
+
+printf '%-14s %10s %10s %10s %10s %10s  %s\n' "config" "flash" "ram" "frame" "model" "budget" "status"
+
+status=0
+for config in "$@"; do
+    classes=${config%%:*}
+    rest=${config#*:}
+    dim=${rest%%:*}
+    batch=${rest#*:}
+    flags="-DSTATIC_CLASSES=$classes -DSTATIC_DIM=$dim -DBATCH_SIZE=$batch"
+    name="c${classes}_d${dim}_b${batch}"
+
+    if ! base=$(image "${name}_base" 0 "$flags" 2>"$OUT/err") || ! full=$(image "$name" 1 "$flags" 2>"$OUT/err"); then
+        if grep -q -E "staticBudgetCheck_t|logRingBudgetCheck_t" "$OUT/err"; then
+            printf '%-14s %10s %10s %10s %10s %10s  %s\n' "$config" "-" "-" "-" ">budget" "$MEMORY_BUDGET" "OVER (compile-time check)"
+            status=1
+            continue
+        fi
+        cat "$OUT/err" >&2
+        exit 2
+    fi
+
+    set -- $base
+    baseText=$1; baseData=$2; baseBss=$3
+    set -- $full
+    text=$(( $1 - baseText )); data=$(( $2 - baseData )); bss=$(( $3 - baseBss ))
+
+    largest=0
+    for function in $(used "$name"); do
+        frame=$(awk -F'\t' -v f=":$function" 'index($1, f) == length($1) - length(f) + 1 { print $2 }' "$OUT/${name}_dknn.su" | head -n 1)
+        [ -n "$frame" ] && [ "$frame" -gt "$largest" ] && largest=$frame
+    done
+
+    model=$(( 0x$(nm -S "$OUT/$name.elf" | awk '$4 == "staticModel" { print $2 }') ))
+    ram=$(( data + bss ))
+
+    if [ "$ram" -le "$MEMORY_BUDGET" ]; then
+        verdict="ok"
+    else
+        verdict="OVER"
+        status=1
+    fi
+    printf '%-14s %10d %10d %10d %10s %10d  %s\n' "$config" $(( text + data )) "$ram" "$largest" "$model" "$MEMORY_BUDGET" "$verdict"
+done
+
+exit $status